@@ -18,7 +18,10 @@
 
 typedef int i32;
 typedef long long int i64;
+typedef __int128 i128;
 typedef int isize;
+typedef unsigned char u8;
+typedef unsigned short int u16;
 typedef unsigned int u32;
 typedef unsigned long long int u64;
 typedef unsigned int usize;
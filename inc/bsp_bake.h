@@ -0,0 +1,22 @@
+#ifndef BSP_BAKE_H_
+#define BSP_BAKE_H_
+
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "bsp_tree.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * emits a flattened tree as C source made of static const arrays, the
+ * generated file defines `const BspFlatTree <name>` and only depends on
+ * bsp_flat.h, so linking it in gives a tree without any build at startup.
+ * false if writing failed (out's error flag is set)
+ *
+ * usage from another translation unit:
+ *   extern const BspFlatTree <name>;
+ */
+bool WriteBspFlatTreeSource(const BspFlatTree *tree, const char *name, FILE *out);
+bool BakeBspTree(BspNode *root, const char *name, const char *path);
+
+#endif // BSP_BAKE_H_
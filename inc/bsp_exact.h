@@ -0,0 +1,62 @@
+#ifndef BSP_EXACT_H_
+#define BSP_EXACT_H_
+
+#include "bsp.h"
+#include "bsp_tree.h"
+#include "f64_segment.h"
+#include "polygon.h"
+#include <stdbool.h>
+
+/*
+ * largest absolute grid coordinate the exact build accepts. with |x|, |y| <=
+ * 2^19 line coefficients fit in 20 (a, b) and 40 (c) bits, the homogeneous
+ * coordinates of any intersection of two input lines fit in an i64 and
+ * evaluating a line at such a point fits comfortably in an i128
+ */
+#define BSP_EXACT_MAX_COORD (1 << 19)
+
+/* point (x / w, y / w) in grid space, w > 0 (1 for input vertices) */
+typedef struct XPoint {
+    i64 x;
+    i64 y;
+    i64 w;
+} XPoint;
+
+/* a * x + b * y + c * w > 0 => point on left side of line (same convention as BspLine) */
+typedef struct XLine {
+    i64 a;
+    i64 b;
+    i64 c;
+} XLine;
+
+typedef struct XSegment {
+    XPoint left;
+    XPoint right;
+    XLine line;      /* supporting line of the input edge this segment is a piece of */
+    bool splitLeft;  /* left endpoint created by a split */
+    bool splitRight; /* right endpoint created by a split */
+    u32 id;          /* index of the input edge, as in DSegment */
+} XSegment;
+
+/*
+ * exact BSP build for polygons on an integer grid
+ *
+ * every segment of the build lies on one of the input edges' lines and every
+ * split point is the intersection of two of those lines, so points are kept
+ * as exact homogeneous rationals and every side test is the exact sign of a
+ * small integer polynomial. there's no epsilon anywhere, the scale to
+ * screen space is applied only when the finished nodes are handed to the
+ * renderer as DSegments
+ */
+bool PolygonIsGrid(const Polygon *polygon);
+XSegment *BuildExactSegments(const Polygon *polygon, usize *size);
+BspNode *BuildExactBspTree(XSegment *segments, usize len, BspNode *parent, PolygonFit fit);
+BspNode *BuildPolygonBspTree(const Polygon *polygon, BoundingRegion region);
+
+XLine XLineFromPoints(XPoint left, XPoint right);
+XPoint XLinesIntersection(XLine l1, XLine l2);
+DSide XLineSide(XLine line, XPoint pt);
+DSide XLineSides(XLine line, XSegment s);
+DVector2 XPointToScreen(XPoint pt, PolygonFit fit);
+
+#endif // BSP_EXACT_H_
@@ -0,0 +1,232 @@
+#ifndef BSP_FLAT_H_
+#define BSP_FLAT_H_
+
+#include "bsp.h"
+#include "bsp_tree.h"
+#include "f64_segment.h"
+#include "f64_vector.h"
+#include "raylib.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+#define BSP_NULL_IDX 0xffffffffu
+#define BSP_FILE_MAGIC 0x46505342u /* "BSPF" */
+#define BSP_FILE_VERSION 4u
+#define BSP_CACHE_LINE 64
+#define BSP_LOCATE_LANES 8     /* points BspFlatLocatePoints walks down the tree together */
+#define BSP_LOCATE_GRAIN 16384 /* points per chunk BspFlatLocatePoints hands to a thread */
+#define BSP_PACKET_MAX 16      /* widest ray packet BspFlatRayCastPackets takes */
+#define BSP_RAY_GRAIN 2048     /* rays per chunk BspFlatRayCastPackets hands to a thread */
+#define BSP_SIGHT_GRAIN 4096   /* pairs per chunk BspFlatLinesOfSight hands to a thread */
+
+/*
+ * how far past a node's line the fragments below it can lie. BspSplitSides
+ * counts ends within BSP_SPLIT_TOLERANCE of the coordinates of a line as
+ * on it, which stays under this for coordinates up to 1e7, so queries that
+ * skip a subtree for being on the wrong side of a line, or farther than
+ * the best so far, allow this much
+ */
+#define BSP_SIDE_SLACK 0.001
+
+/* solid flags of LabelBspFlatTree, one per side of a node's line */
+#define BSP_CELL_LEFT_SOLID 0x1u  /* behind the line (left child's side) is inside the polygon */
+#define BSP_CELL_RIGHT_SOLID 0x2u /* in front of the line (right child's side) is inside the polygon */
+
+/* asks the cache for addr ahead of use, traversals issue it for both children before classifying */
+#if defined(__GNUC__) || defined(__clang__)
+#define BSP_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define BSP_PREFETCH(addr) ((void)0)
+#endif
+
+typedef struct BspLine {
+    f64 a; /* a * x + b * y + c > 0 => point on left side of line */
+    f64 b;
+    f64 c;
+} BspLine;
+
+typedef struct BspFragment {
+    u32 left;   /* index of left endpoint in vertex pool */
+    u32 right;  /* index of right endpoint in vertex pool */
+    u32 source; /* id of the input segment the fragment was cut from (DSegment.id) */
+} BspFragment;
+
+typedef struct BspFragmentRange {
+    u32 first; /* index of first node fragment in fragment array */
+    u32 count; /* number of fragments for node (usually 1) */
+} BspFragmentRange;
+
+/* axis aligned box, see BoundBspFlatTree */
+typedef struct BspBox {
+    DVector2 min;
+    DVector2 max;
+} BspBox;
+
+/* only what a traversal needs, 32 bytes => two nodes per cache line */
+typedef struct BspFlatNode {
+    BspLine line; /* supporting line of node segment(s) */
+    u32 left;     /* index of left child (BSP_NULL_IDX if none) */
+    u32 right;    /* index of right child (BSP_NULL_IDX if none) */
+} BspFlatNode;
+
+/* first fragment a ray meets, see BspFlatRayCast, or closest one to a point, see BspFlatNearestFragment */
+typedef struct BspRayHit {
+    f64 distance;   /* along the ray, in units of |dir| (ray casts), from the query point (nearest) */
+    DVector2 point; /* where the ray meets the fragment / closest point on it */
+    u32 node;       /* node holding the fragment */
+    u32 source;     /* input segment the fragment was cut from (BspFragment.source) */
+} BspRayHit;
+
+/*
+ * pointer-free copy of a BspNode tree with nodes stored in pre-order (root=0)
+ * unless reordered by RelayoutBspFlatTree
+ *
+ * empty leaves are dropped, so a missing child is stored as BSP_NULL_IDX.
+ * node segments are stored as fragments indexing a shared vertex pool, a
+ * vertex shared by adjacent edges or by both halves of a split is stored
+ * once. nodes only hold the splitter and children (hot), everything else
+ * about node i lives at index i of the cold arrays so traversals never pull
+ * it into cache. trees returned by FlattenBspTree and trees baked into
+ * static const arrays by WriteBspFlatTreeSource are accessed through the
+ * exact same functions
+ */
+typedef struct BspFlatTree {
+    const BspFlatNode *nodes;        /* array of nodes (root at index 0, cache line aligned) */
+    const BspFragmentRange *ranges;  /* fragments of each node (cold) */
+    const u32 *parents;              /* parent of each node, BSP_NULL_IDX for root (cold) */
+    const Color *colors;             /* color of each node (cold, only used for stage 3) */
+    u32 *payloads;                   /* user data of each node, 0 unless set (cold) */
+    const u8 *cells;                 /* BSP_CELL_* flags of each node, NULL unless labeled (cold) */
+    const BspBox *bounds;            /* box around the fragments of each node's subtree, NULL unless bounded (cold) */
+    const BspFragment *fragments;    /* fragments of every node, grouped by node */
+    const DVector2 *vertices;        /* vertex pool shared by all fragments */
+    usize numNodes;                  /* number of nodes in tree */
+    usize numFragments;              /* number of fragments in tree */
+    usize numVertices;               /* number of vertices in pool */
+} BspFlatTree;
+
+/*
+ * node orders RelayoutBspFlatTree can put a tree in. in pre-order a node's
+ * left child sits right after it, but its right child can be anywhere.
+ * breadth first is the Eytzinger order of a complete tree generalized to
+ * the unbalanced trees BSP builds give, siblings are stored next to each
+ * other so prefetching both children costs a single cache line. van Emde
+ * Boas recursively stores the top half of the levels of every subtree
+ * before its bottom subtrees, so a root-to-leaf walk crosses O(log_B n)
+ * cache lines whatever the cache line size B is
+ */
+typedef enum BspLayout {
+    BspLayoutPreOrder,
+    BspLayoutBreadthFirst,
+    BspLayoutVanEmdeBoas,
+} BspLayout;
+
+BspFlatTree *FlattenBspTree(BspNode *root);
+BspFlatTree *RelayoutBspFlatTree(const BspFlatTree *tree, BspLayout layout);
+bool ParseBspLayout(const char *name, BspLayout *layout);
+const char *BspLayoutName(BspLayout layout);
+BspFlatTree *AllocBspFlatTree(usize numNodes, usize numFragments, usize numVertices);
+BspFlatNode *AllocBspFlatNodes(usize numNodes);
+void WeldBspFlatVertices(BspFlatTree *tree);
+usize BspFlatTreeBytes(const BspFlatTree *tree);
+void FreeBspFlatTree(BspFlatTree *tree);
+
+bool WriteBspFlatTree(const BspFlatTree *tree, FILE *out);
+BspFlatTree *ReadBspFlatTree(FILE *in);
+
+BspLine BspLineFromSegment(DSegment s);
+f64 BspLineEval(BspLine line, DVector2 pt);
+
+DSide BspFlatNodeSide(const BspFlatTree *tree, u32 idx, DVector2 pt);
+const BspFragment *BspFlatNodeFragments(const BspFlatTree *tree, u32 idx, usize *numFragments);
+DSegment BspFlatFragmentSegment(const BspFlatTree *tree, BspFragment fragment);
+bool BspFlatIsLeaf(const BspFlatTree *tree, u32 idx);
+u32 BspFlatLocatePoint(const BspFlatTree *tree, DVector2 pt, DSide *side);
+
+/*
+ * BspFlatLocatePoint over a batch, leaves[i] and sides[i] (sides may be
+ * NULL) are what it returns for points[i]. BSP_LOCATE_LANES points go down
+ * the tree side by side, batches of more than BSP_LOCATE_GRAIN points are
+ * spread over threads
+ */
+void BspFlatLocatePoints(const BspFlatTree *tree, const DVector2 *points, usize numPoints, u32 *leaves, DSide *sides);
+
+/*
+ * first fragment hit by the ray from origin along dir within maxDistance
+ * (INFINITY for no limit), false if there is none. the walk is front to
+ * back like the renderer's: the child on origin's side first, with the ray
+ * interval clipped where it crosses the node's line, then the node's own
+ * fragments at the crossing, then the far child. the first hit found this
+ * way is the closest, so only the fragments of nodes the ray actually
+ * crosses get tested. a ray running along a fragment's line doesn't hit it
+ */
+bool BspFlatRayCast(const BspFlatTree *tree, DVector2 origin, DVector2 dir, f64 maxDistance, BspRayHit *hit);
+
+/*
+ * BspFlatRayCast for numRays rays from one origin, hits[i] is the hit of
+ * dirs[i] (distance INFINITY if it hit nothing). the rays are cast in
+ * packets of packetSize (4, 8 or 16) consecutive ones walking the tree
+ * together: the packet visits a node once for all its rays, each ray
+ * keeps its own interval and rays that don't need a subtree are masked
+ * out of it. that pays off when neighbouring rays go through the same
+ * nodes, so dirs should be ordered by angle (a fan sweeping the view).
+ * where the rays of a packet go different ways, at a splitter through the
+ * origin or once one ray is left, they carry on as single rays. packets
+ * are spread over threads in chunks of BSP_RAY_GRAIN rays
+ */
+void BspFlatRayCastPackets(const BspFlatTree *tree, DVector2 origin, const DVector2 *dirs, usize numRays, usize packetSize, f64 maxDistance, BspRayHit *hits);
+
+/*
+ * whether no fragment crosses the segment from a to b. a fragment whose
+ * line passes within BSP_EPSILON of a or b doesn't count, so a and b may
+ * lie on walls, nor does one the segment runs along. the walk is
+ * BspFlatRayCast's, down only the children the segment reaches, but any
+ * crossing ends it and the fragment test is sign checks instead of
+ * computing where the hit is
+ */
+bool BspFlatLineOfSight(const BspFlatTree *tree, DVector2 a, DVector2 b);
+
+/* BspFlatLineOfSight for every from[i], to[i], spread over threads in chunks of BSP_SIGHT_GRAIN pairs */
+void BspFlatLinesOfSight(const BspFlatTree *tree, const DVector2 *from, const DVector2 *to, usize numPairs, bool *visible);
+
+/*
+ * closest fragment to pt within maxDistance (INFINITY for no limit),
+ * false if there is none. branch and bound: the child on pt's side first,
+ * then the node's own fragments and the other child, each skipped if its
+ * line is already farther from pt than the best fragment so far. with
+ * maxDistance a clearance radius, that leaves only the nodes whose lines
+ * pass within it
+ */
+bool BspFlatNearestFragment(const BspFlatTree *tree, DVector2 pt, f64 maxDistance, BspRayHit *hit);
+
+/*
+ * range queries, every fragment touching a box or a disc
+ *
+ * their indices in tree->fragments are written to fragments, the first
+ * capacity of them, and the total is returned. nothing is allocated. the
+ * walk skips the side of a node's line the query doesn't reach, and on a
+ * bounded tree any subtree whose box misses the query, which makes the
+ * cost follow the number of fragments found rather than the size of the
+ * tree. bounds are derived data like labels, bound a tree again after
+ * ReadBspFlatTree (baked trees keep theirs)
+ */
+void BoundBspFlatTree(BspFlatTree *tree);
+usize BspFlatQueryBox(const BspFlatTree *tree, BspBox box, u32 *fragments, usize capacity);
+usize BspFlatQueryCircle(const BspFlatTree *tree, DVector2 center, f64 radius, u32 *fragments, usize capacity);
+
+/*
+ * solid-leaf mode, point in polygon in one root-to-leaf walk
+ *
+ * every polygon edge is a splitter, so the cell behind a missing child is
+ * crossed by no edge and lies entirely inside or outside the polygon. the
+ * inside is on the left of every segment (BuildPolygonSegments orients
+ * rings that way), so the direction of a node's fragments along its line
+ * tells which side of the node is solid. labels are derived data and not
+ * part of the tree file, label a tree again after ReadBspFlatTree (baked
+ * trees keep theirs)
+ */
+bool LabelBspFlatTree(BspFlatTree *tree);
+bool BspFlatContainsPoint(const BspFlatTree *tree, DVector2 pt);
+void BspFlatClassifyPoints(const BspFlatTree *tree, const DVector2 *points, usize numPoints, bool *inside);
+
+#endif // BSP_FLAT_H_
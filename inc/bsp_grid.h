@@ -0,0 +1,43 @@
+#ifndef BSP_GRID_H_
+#define BSP_GRID_H_
+
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "f64_vector.h"
+
+#define BSP_GRID_LEAF 0x80000000u  /* set in a cell lying in one leaf cell, the rest is that leaf */
+#define BSP_GRID_FRONT 0x40000000u /* with BSP_GRID_LEAF, the cell is in front of the leaf's line (DSideLeft) */
+#define BSP_GRID_NODE 0x3fffffffu  /* node index bits of a cell */
+#define BSP_GRID_ROW_GRAIN 16      /* rows per chunk BuildBspGrid hands to a thread */
+
+/*
+ * uniform grid over a flat tree's bounds for point location
+ *
+ * every cell holds what BspFlatLocatePoint does for the points in it as
+ * far as that's common to all of them: a cell lying entirely on one side
+ * of each splitter down to a missing child holds that leaf and side
+ * (BSP_GRID_LEAF), answering in one lookup, any other cell holds the
+ * deepest node whose subtree every point in it ends up in, where the walk
+ * resumes. only cells crossed by a wall (or close to a splitter) need the
+ * walk, so finer grids answer more points directly at the cost of 4 bytes
+ * per cell. points off the grid are located from the root
+ */
+typedef struct BspGrid {
+    const BspFlatTree *tree; /* tree the grid indexes (not owned) */
+    u32 *cells;              /* width * height entries, row by row */
+    u32 width;               /* cells per row */
+    u32 height;              /* number of rows */
+    DVector2 origin;         /* lower corner of the grid */
+    f64 cellSize;            /* world size of a (square) cell */
+    usize numLeafCells;      /* cells holding a leaf, the share of points answered in one lookup */
+} BspGrid;
+
+/* resolution is the number of cells along the longer side of the bounds of the tree's vertices */
+BspGrid *BuildBspGrid(const BspFlatTree *tree, u32 resolution);
+void FreeBspGrid(BspGrid *grid);
+usize BspGridBytes(const BspGrid *grid);
+
+/* same result as BspFlatLocatePoint */
+u32 BspGridLocatePoint(const BspGrid *grid, DVector2 pt, DSide *side);
+
+#endif // BSP_GRID_H_
@@ -0,0 +1,32 @@
+#ifndef BSP_MERGE_H_
+#define BSP_MERGE_H_
+
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "f64_segment.h"
+
+typedef enum BspSetOp {
+    BspSetUnion,
+    BspSetIntersection,
+    BspSetDifference, /* a minus b */
+} BspSetOp;
+
+/*
+ * boolean operations on solid-leaf trees by merging them (Naylor,
+ * Amanatides and Thibault, "Merging BSP Trees Yields Polyhedral Set
+ * Operations")
+ *
+ * b is partitioned by a's splitters as the merge walks down a, so neither
+ * polygon's edges are classified from scratch. whenever one side reaches a
+ * leaf the other side's subtree is taken as is (or dropped) depending on the
+ * operation. both trees have to be labeled (LabelBspFlatTree) and the result
+ * comes back labeled, its fragments are the pieces of the splitters that
+ * separate a solid cell from an empty one, which are also returned (inside
+ * on the left, like BuildPolygonSegments) in *boundary if it isn't NULL.
+ * splitters that ended up bounding nothing stay in the result as nodes with
+ * no fragments. the solid-leaf queries handle them, quantizing (which
+ * needs a fragment per node) refuses such trees
+ */
+BspFlatTree *MergeBspFlatTrees(const BspFlatTree *a, const BspFlatTree *b, BspSetOp op, DSegment **boundary, usize *numBoundary);
+
+#endif // BSP_MERGE_H_
@@ -0,0 +1,27 @@
+#ifndef BSP_OOC_H_
+#define BSP_OOC_H_
+
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "f64_segment.h"
+#include <stdbool.h>
+
+#define BSP_OOC_PATH_SIZE 512
+#define BSP_OOC_DEFAULT_BUDGET (256ull << 20) /* bytes of segments built in memory at once */
+
+/*
+ * out-of-core BSP tree build
+ *
+ * segment files are raw native DSegment arrays (no header). the top levels of
+ * the tree are split by streaming passes over memory-mapped scratch files in
+ * scratchDirectory, once a subtree's segments fit in memoryBudget bytes it is
+ * handed to BuildBspTree. the tree is streamed straight into outputPath in the
+ * on-disk flat tree format (see WriteBspFlatTree), so neither the segments
+ * nor the finished tree have to fit in memory. node and segment indices of
+ * the output are u32 like every other flat tree
+ */
+bool BuildBspTreeOutOfCore(const char *segmentsPath, const char *outputPath, const char *scratchDirectory, u64 memoryBudget);
+
+bool WriteSegmentFile(const char *path, const DSegment *segments, u64 numSegments);
+
+#endif // BSP_OOC_H_
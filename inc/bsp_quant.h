@@ -0,0 +1,74 @@
+#ifndef BSP_QUANT_H_
+#define BSP_QUANT_H_
+
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "f64_segment.h"
+#include "f64_vector.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+#define BSP_QUANT_MAGIC 0x51505342u /* "BSPQ" */
+#define BSP_QUANT_VERSION 3u
+#define BSP_QUANT_MAX 65535.0
+#define BSP_QUANT_HAS_LEFT 0x80000000u /* set in links if node has a left child (stored right after it) */
+#define BSP_QUANT_NO_RIGHT 0x7fffffffu /* right child index of node without right child */
+
+/* 16-bit point on the tree grid or on a node's grid */
+typedef struct BspQuantPoint {
+    u16 x;
+    u16 y;
+} BspQuantPoint;
+
+typedef struct BspQuantNode {
+    BspQuantPoint min; /* box around the node's fragments on the tree grid (rounded outward) */
+    BspQuantPoint max; /* its cells are the node's grid */
+    u32 links;         /* BSP_QUANT_HAS_LEFT | index of right child (BSP_QUANT_NO_RIGHT if none) */
+} BspQuantNode;
+
+typedef struct BspQuantFragment {
+    BspQuantPoint left;  /* endpoints on the grid of the node holding the fragment */
+    BspQuantPoint right;
+    u32 source;          /* id of the input segment the fragment was cut from (BspFragment.source) */
+} BspQuantFragment;
+
+/*
+ * compact 12 byte per node copy of a flat tree
+ *
+ * the tree bounds are stored once and split into a 16-bit tree grid. each
+ * node stores the box around its fragments on that grid, and its fragment
+ * endpoints are on a 16-bit grid inside that box, so precision follows the
+ * size of the node rather than the size of the map. the splitter is the
+ * node's first fragment, as in the flat tree, so the line is read from
+ * there rather than stored twice. nodes keep the flat tree's pre-order
+ * numbering and carry their own fragment ranges and source ids, a
+ * quantized tree read back on its own answers the same queries as the
+ * flat tree it was built from. only classifications within the rounding
+ * error of a splitter need the exact splitter: with the flat tree attached
+ * as exact they are redone on it and every side test agrees with
+ * BspFlatNodeSide, without it they are made on the quantized line, which
+ * is within half a node grid cell of the real one
+ */
+typedef struct BspQuantTree {
+    const BspFlatTree *exact;    /* exact tree for points near a splitter (not owned, may be NULL) */
+    BspQuantNode *nodes;         /* nodes in pre-order (root=0) */
+    BspFragmentRange *ranges;    /* fragments of each node */
+    BspQuantFragment *fragments; /* fragments of every node, grouped by node */
+    usize numNodes;              /* number of nodes in tree */
+    usize numFragments;          /* number of fragments in tree */
+    DVector2 origin;             /* lower corner of tree bounds */
+    DVector2 scale;              /* tree grid cells per world unit along x and y */
+} BspQuantTree;
+
+BspQuantTree *QuantizeBspFlatTree(const BspFlatTree *tree);
+void FreeBspQuantTree(BspQuantTree *tree);
+
+bool WriteBspQuantTree(const BspQuantTree *tree, FILE *out);
+BspQuantTree *ReadBspQuantTree(FILE *in, const BspFlatTree *exact);
+
+DSide BspQuantNodeSide(const BspQuantTree *tree, u32 idx, DVector2 pt);
+u32 BspQuantLocatePoint(const BspQuantTree *tree, DVector2 pt, DSide *side);
+const BspQuantFragment *BspQuantNodeFragments(const BspQuantTree *tree, u32 idx, usize *numFragments);
+DSegment BspQuantFragmentSegment(const BspQuantTree *tree, u32 idx, BspQuantFragment fragment);
+
+#endif // BSP_QUANT_H_
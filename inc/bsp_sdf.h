@@ -0,0 +1,48 @@
+#ifndef BSP_SDF_H_
+#define BSP_SDF_H_
+
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "f64_vector.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+#define BSP_SDF_MAGIC 0x44505342u /* "BSPD" */
+#define BSP_SDF_VERSION 1u
+#define BSP_SDF_ROW_GRAIN 4 /* rows per chunk BakeBspSdf hands to a thread */
+
+/*
+ * signed distance field of a polygon sampled on a regular grid
+ *
+ * sample (x, y) sits at origin + (x, y) * cellSize and holds the distance
+ * from there to the closest wall, negative inside the polygon and clamped
+ * to +-maxDistance. collision and soft shadow lookups read it in O(1)
+ * instead of walking the tree
+ */
+typedef struct BspSdf {
+    f32 *distances;  /* width * height samples, row by row from origin */
+    u32 width;       /* samples per row */
+    u32 height;      /* number of rows */
+    DVector2 origin; /* world position of sample (0, 0) */
+    f64 cellSize;    /* world distance between neighbouring samples */
+    f64 maxDistance; /* distances are clamped to it (INFINITY for no limit) */
+} BspSdf;
+
+/*
+ * bakes the field of a labeled tree (LabelBspFlatTree), NULL if it isn't.
+ * the distance is BspFlatNearestFragment's and the sign
+ * BspFlatContainsPoint's. rows are spread over threads in chunks of
+ * BSP_SDF_ROW_GRAIN, along a row each nearest search starts bounded by
+ * the previous sample's distance plus a cell, which a distance field
+ * can't exceed
+ */
+BspSdf *BakeBspSdf(const BspFlatTree *tree, DVector2 origin, f64 cellSize, u32 width, u32 height, f64 maxDistance);
+void FreeBspSdf(BspSdf *sdf);
+
+/* bilinear between the four samples around pt, points off the grid take the closest edge samples */
+f32 BspSdfSample(const BspSdf *sdf, DVector2 pt);
+
+bool WriteBspSdf(const BspSdf *sdf, FILE *out);
+BspSdf *ReadBspSdf(FILE *in);
+
+#endif // BSP_SDF_H_
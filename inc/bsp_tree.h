@@ -7,6 +7,8 @@
 #include "region.h"
 #include <stdbool.h>
 
+#define BSP_SPLIT_TOLERANCE 1e-10 /* distance to a splitter that counts as on it, relative to the coordinates, see BspSplitSides */
+
 typedef struct BspNode {
     struct BspNode *left;   /* pointer to left child (if exists) */
     struct BspNode *right;  /* pointer to right child (if exists) */
@@ -44,9 +46,29 @@ typedef struct BspTreeMeta {
 
 BspNode *BuildBspTree(DSegment *segments, usize len, BspNode *parent);
 void FreeBspTree(BspNode *node);
+
+/*
+ * how both builds (BuildBspTree and BuildBspTreeOutOfCore) sort a segment
+ * against the splitting segment, and cut it if it crosses the line
+ *
+ * the side tests are exact, but segments are rounded (scaled input
+ * vertices and split points), so two pieces of one straight edge can come
+ * out a hair apart. an endpoint within BSP_SPLIT_TOLERANCE times the
+ * largest coordinate involved of the line counts as on it, so the
+ * tolerance follows the rounding whatever the units of the map: a segment
+ * with both ends on the line stays in the node, and one crossing the line
+ * with an end on it goes whole to the side of its other end rather than
+ * leaving a sliver whose direction is rounding noise. what queries of the
+ * built tree rely on follows from this: the fragments below a node lie on
+ * their child's side of the node's line, except for ends that close to it
+ * (see BSP_SIDE_SLACK)
+ */
+DSide BspSplitSides(DSegment splitter, DSegment s);
+void BspSplitSegment(DSegment splitter, DSegment s, DSegment *behind, DSegment *inFront);
 void CopyBspTree(const BspTreeMeta *src, BspTreeMeta *dst);
 
 BspTreeMeta *BuildBspTreeMeta(DSegment *segments, usize len, BoundingRegion region);
+BspTreeMeta *WrapBspTreeMeta(BspNode *root, BoundingRegion region);
 void FreeBspTreeMeta(BspTreeMeta *tree);
 void BuildTreeRegions(BspTreeMeta *tree, usize idx);
 void DrawBspTreeMeta(BspTreeMeta *tree);
@@ -0,0 +1,30 @@
+#ifndef BSP_VISIBILITY_H_
+#define BSP_VISIBILITY_H_
+
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "f64_vector.h"
+
+#define BSP_VISIBILITY_ARC_STEP (PI / 16.0) /* widest angle between two vertices on a closing arc */
+
+/*
+ * visibility polygon (isovist) of a viewpoint, the part of the plane it
+ * sees past every fragment of the tree
+ *
+ * the result is star-shaped around the viewpoint, its numVertices
+ * vertices go counterclockwise and are malloc'd (free them). the tree is
+ * walked front to back like the renderer's, so a fragment can only be
+ * hidden by fragments met before it: each one is seen where its angle
+ * around the viewpoint isn't taken yet by an occlusion list of those
+ * angles, which it then joins. the walk skips the far side of a node
+ * whose half-plane is already behind occluded angles, on a bounded tree
+ * any subtree whose box is, and stops once the full angle is taken, which
+ * inside a closed room is after the walls around the viewpoint. angles
+ * nothing stops are closed by an arc at maxDistance (finite, beyond the
+ * map for an unlimited view), walls farther than that aren't cut.
+ * fragments the viewpoint lies on the line of are seen edge on and hide
+ * nothing
+ */
+DVector2 *BuildBspVisibilityPolygon(const BspFlatTree *tree, DVector2 viewpoint, f64 maxDistance, usize *numVertices);
+
+#endif // BSP_VISIBILITY_H_
@@ -4,6 +4,8 @@
 #include "bsp.h"
 #include "f64_segment.h"
 #include "f64_vector.h"
+#include "polygon.h"
+#include <stdbool.h>
 
 typedef struct VertexEntry VertexEntry;
 typedef struct FaceEntry FaceEntry;
@@ -16,8 +18,9 @@ typedef struct VertexEntry {
 
 typedef struct FaceEntry {
     HalfEdgeEntry *outerComponent;
-    HalfEdgeEntry **innerComponents;
+    HalfEdgeEntry **innerComponents; /* one half-edge of each hole (or island) boundary in the face */
     usize numInnerComponents;
+    bool hole; /* inside of a hole ring, not part of the polygon */
 } FaceEntry;
 
 typedef struct HalfEdgeEntry {
@@ -31,18 +34,20 @@ typedef struct HalfEdgeEntry {
 /*
  * this datastructure does not cover all cases needed to be a proper DCEL...
  *
- * 1. assumes no holes, only the unbounded face has inner components
- * 2. inner component size assumed to be 1 (still malloc it tho *shrug*)
- * 3. assumes at least 3 edges (6 half-edges)
- * 4. assumes graph stored follows euler's formula
- * 5. assumes when adding a diagonal, it's an actual diagonal and the two
+ * 1. faces are only ever split (diagonals) or joined to a hole inside of
+ *    them (bridges), never merged
+ * 2. assumes at least 3 edges (6 half-edges)
+ * 3. assumes graph stored follows euler's formula, f - e + n == 1 + c for
+ *    c connected components (one per ring until bridges join them)
+ * 4. assumes when adding a diagonal, it's an actual diagonal and the two
  *    vertices provided share an incident face
  *    i.  it will loop infinitely if diagonals aren't proper
  *        (diagonals only added in triangulation alg tho so no worries)
  *
- * i know this isn't all that ideal, but currently this is only getting used
- * for triangluating BSP tree regions which are all convex with around 4-6
- * edges so i didn't really care to make it full-proof
+ * BSP tree regions are a single convex ring with around 4-6 edges, polygons
+ * from BuildPolygonSegments are any number of outer rings and holes. each
+ * ring gets a face for its inside, a hole's face is marked as such and the
+ * boundary of the hole is an inner component of the face around it
  */
 typedef struct DCEL {
     VertexEntry **vertices;
@@ -51,6 +56,7 @@ typedef struct DCEL {
     usize numVertices;
     usize numFaces;
     usize numHalfEdges;
+    usize numComponents; /* connected components of the edge graph */
     usize openVertex;
     usize openFace;
     usize openHalfEdge;
@@ -58,10 +64,13 @@ typedef struct DCEL {
 
 DCEL *NewDCEL(usize numVertices, usize numFaces, usize numEdges);
 DCEL *BuildSimpleDCEL(DSegment *segments, usize numSegments);
+DCEL *BuildDCEL(DSegment *segments, const usize *ringSizes, const RingKind *ringKinds, usize numRings);
 void FreeDCEL(DCEL *dcel);
 
-void ResizeDCEL(DCEL *dcel, usize numVertices, usize numFaces, usize numHalfEdges);
+void ResizeDCEL(DCEL *dcel, usize numVertices, usize numFaces, usize numHalfEdges, usize numComponents);
 void AddDiagonalDCEL(DCEL *dcel, VertexEntry *v1, VertexEntry *v2);
+void SplitFaceDCEL(DCEL *dcel, HalfEdgeEntry *from, HalfEdgeEntry *to);
+void AddBridgeDCEL(DCEL *dcel, HalfEdgeEntry *outer, HalfEdgeEntry *inner);
 void PrintDCEL(DCEL *dcel);
 
 #endif // DCEL_H_
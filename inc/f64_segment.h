@@ -3,6 +3,7 @@
 
 #include "f64_vector.h"
 #include "i32_vector.h"
+#include "polygon.h"
 #include "raylib.h"
 #include <stdbool.h>
 
@@ -11,8 +12,15 @@ typedef struct DSegment {
     DVector2 right;
     bool splitLeft;
     bool splitRight;
+    u32 id; /* index of the input segment this one was cut from */
 } DSegment;
 
+/* uniform scale + offset that fits a polygon's bounds into a screen region */
+typedef struct PolygonFit {
+    f64 scale;
+    DVector2 padding;
+} PolygonFit;
+
 typedef enum DSide {
     DSideLeft,
     DSideRight,
@@ -21,6 +29,8 @@ typedef enum DSide {
 } DSide;
 
 DSegment *BuildSegments(IVector2 *polygon, usize numVertices, BoundingRegion region, usize *size);
+DSegment *BuildPolygonSegments(const Polygon *polygon, BoundingRegion region, usize *size);
+PolygonFit FitPolygon(const Polygon *polygon, BoundingRegion region);
 void FreeSegments(DSegment *segments);
 void DrawSegment(DSegment segment, f32 thick, Color color, bool hasNormal);
 void DrawSegments(DSegment *segments, usize len);
@@ -33,5 +43,8 @@ DVector2 DSegmentIntersection(DSegment s1, DSegment s2);
 bool DSegmentContainsPoint(DSegment s, DVector2 pt);
 bool DSegmentsParallel(DSegment s1, DSegment s2);
 bool DSegentsIntersect(DSegment s1, DSegment s2);
+bool DSegmentRayHit(DSegment s, DVector2 origin, DVector2 dir, f64 *t);
+DVector2 DSegmentClosestPoint(DSegment s, DVector2 pt);
+bool DSegmentIntersectsBox(DSegment s, DVector2 lo, DVector2 hi);
 
 #endif // F64_SEGMENT_H_
@@ -0,0 +1,29 @@
+#ifndef IMPORT_H_
+#define IMPORT_H_
+
+#include "bsp.h"
+#include "polygon.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+#define IMPORT_BUFFER_SIZE 4096
+#define IMPORT_TOKEN_SIZE 64
+
+/*
+ * fixed size read buffer over a file, importers pull one character at a time
+ * so input text is never held in memory beyond IMPORT_BUFFER_SIZE bytes
+ */
+typedef struct ImportStream {
+    FILE *file;
+    char buffer[IMPORT_BUFFER_SIZE];
+    usize length; /* number of valid bytes in buffer */
+    usize pos;    /* index of next unread byte in buffer */
+} ImportStream;
+
+Polygon *ImportPolygon(const char *path);
+bool ImportWKT(FILE *file, Polygon *polygon);
+bool ImportGeoJSON(FILE *file, Polygon *polygon);
+bool ImportSVG(FILE *file, Polygon *polygon);
+bool ImportSVGPath(FILE *file, Polygon *polygon);
+
+#endif // IMPORT_H_
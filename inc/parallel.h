@@ -0,0 +1,26 @@
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include "bsp.h"
+
+/* work on items [first, last) of a ParallelFor, ctx is passed through untouched */
+typedef void (*ParallelTask)(void *ctx, usize first, usize last);
+
+/*
+ * fork-join loop over count items
+ *
+ * the items are handed out in chunks of grain to one thread per core (the
+ * calling thread being one of them), the call returns once every chunk is
+ * done. the other threads are started by the first call and then sleep
+ * between loops, so a loop costs waking them rather than starting them.
+ * fewer than two chunks, a build without threads (the web), or a loop
+ * started while another one has the threads (from inside a task, or from
+ * a second thread) run task on the calling thread alone. chunks are
+ * claimed as threads get to them, so uneven chunks don't leave threads
+ * idle, but a chunk is never split: grain should be large enough to dwarf
+ * the cost of waking a thread
+ */
+void ParallelFor(usize count, usize grain, ParallelTask task, void *ctx);
+usize ParallelWorkerCount(void);
+
+#endif // PARALLEL_H_
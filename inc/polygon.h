@@ -0,0 +1,44 @@
+#ifndef POLYGON_H_
+#define POLYGON_H_
+
+#include "bsp.h"
+#include "f64_vector.h"
+#include "i32_vector.h"
+#include <stdbool.h>
+
+typedef enum RingKind {
+    RingOuter, /* boundary of a room, the inside is part of the polygon */
+    RingHole,  /* boundary of an obstacle inside an outer ring, the inside is not */
+} RingKind;
+
+/*
+ * one or more closed rings of vertices
+ *
+ * rings are stored back to back in a single vertex array, the ring being
+ * built is always the tail of that array until PolygonCloseRing is called.
+ * the winding of a ring doesn't matter, its kind says which side is inside
+ * (BuildPolygonSegments winds holes opposite to outer rings)
+ */
+typedef struct Polygon {
+    DVector2 *vertices;   /* vertices of every ring, stored back to back */
+    usize *ringSizes;     /* number of vertices in each closed ring */
+    RingKind *ringKinds;  /* outer boundary or hole, for each closed ring */
+    usize numVertices;    /* number of vertices (including unclosed ring) */
+    usize numRings;       /* number of closed rings */
+    usize vertexCapacity; /* allocated size of vertex array */
+    usize ringCapacity;   /* allocated size of ring size array */
+    usize ringStart;      /* index of first vertex of ring being built */
+} Polygon;
+
+Polygon *NewPolygon(void);
+Polygon *PolygonFromGrid(const IVector2 *polygon, usize numVertices);
+void FreePolygon(Polygon *polygon);
+
+void PolygonAddVertex(Polygon *polygon, DVector2 vertex);
+bool PolygonCloseRing(Polygon *polygon);
+bool PolygonCloseRingKind(Polygon *polygon, RingKind kind);
+usize PolygonClassifyRings(Polygon *polygon);
+
+usize SimplifyPolygon(Polygon *polygon, f64 tolerance);
+
+#endif // POLYGON_H_
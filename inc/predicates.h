@@ -0,0 +1,19 @@
+#ifndef PREDICATES_H_
+#define PREDICATES_H_
+
+#include "bsp.h"
+#include "f64_vector.h"
+
+/*
+ * robust orientation predicates on f64 inputs
+ *
+ * the determinant is first evaluated in plain f64 together with a static
+ * bound on its rounding error (Shewchuk's ccwerrboundA). only if the result
+ * is within that bound of zero is it recomputed exactly with floating point
+ * expansions, so the sign returned is always the sign of the exact
+ * determinant of the inputs as given and 0 means exactly collinear/parallel
+ */
+f64 Orient2D(DVector2 a, DVector2 b, DVector2 c);
+f64 CrossDiff(DVector2 a, DVector2 b, DVector2 c, DVector2 d);
+
+#endif // PREDICATES_H_
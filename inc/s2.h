@@ -4,11 +4,15 @@
 #include "bsp.h"
 #include "bsp_tree.h"
 #include "i32_vector.h"
+#include "polygon.h"
+#include "triangulation.h"
 #include <stdbool.h>
 
 typedef struct S2 {
     DSegment *segments; /* line segments of polygon from S1 */
     usize numSegments;  /* number of line segments in polygon from S1 */
+    Triangle *floor;    /* triangulation of the inside of the polygon (holes left out) */
+    usize floorSize;    /* number of triangles in floor */
     BspTreeMeta *tree;  /* BSP tree with metadata for visual display */
     Vector2 helpButton;
 
@@ -46,7 +50,7 @@ static const char S2_PT2_HELP_MENU[9][128] = {
 };
 /* clang-format on */
 
-BspStage S2_Init(IVector2 *polygon, u32 numVertices, S2 *scene);
+BspStage S2_Init(const Polygon *polygon, S2 *scene);
 BspStage S2_Render(S2 *scene);
 BspStage S2_RenderFailure(S2 *scene);
 void S2_Free(S2 *scene);
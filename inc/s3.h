@@ -2,8 +2,12 @@
 #define S3_H_
 
 #include "bsp.h"
+#include "bsp_flat.h"
 #include "bsp_tree.h"
 #include "f32_segment.h"
+#include "polygon.h"
+#include "tile.h"
+#include "tile_cache.h"
 
 typedef struct Player {
     Vector2 pos;
@@ -16,6 +20,14 @@ typedef struct Player {
     f32 vfov;
 } Player;
 
+/* per frame view space data of a world vertex, shared by every wall using it */
+typedef struct ViewVertex {
+    Vector2 pos;    /* world position */
+    Side leftSide;  /* side of player's left view boundary */
+    Side rightSide; /* side of player's right view boundary */
+    f32 depth;      /* distance along player's viewing direction */
+} ViewVertex;
+
 typedef struct S3 {
     Player player;
     usize numSegments;
@@ -23,6 +35,13 @@ typedef struct S3 {
     FSegment *minimap;
     BoundingRegion minimapRegion;
     BspNode *tree;
+    BspFlatTree *flat;   /* flattened copy of tree that is rendered (NULL if tiled) */
+    TileCache *tiles;    /* streamed tiles of a tiled world (NULL unless tiled) */
+    u32 *resident;       /* resident tiles this frame (front-to-back) */
+    usize numResident;   /* number of resident tiles this frame */
+    Vector2 lastPos;     /* player position last frame, used to predict movement */
+    ViewVertex *view;    /* view space vertices of tree being drawn */
+    usize viewCapacity;  /* allocated size of view vertex array */
     Vector2 helpButton;
     bool useBspTree;
     bool initialized;
@@ -30,7 +49,7 @@ typedef struct S3 {
 } S3;
 
 /* clang-format off */
-static const char S3_HELP_MENU[7][128] = {
+static const char S3_HELP_MENU[8][128] = {
     "- toggle help menu : H",
     "- quit demonstration : Q",
     "- restart from beginning : R",
@@ -38,10 +57,12 @@ static const char S3_HELP_MENU[7][128] = {
     "- rotate viewing direction : LEFT/RIGHT",
     "- increase/decrease field of view : UP/DOWN",
     "- toggle on/off BSP Tree rendering : SPACE",
+    "- export BSP tree as C source : E",
 };
 /* clang-format on */
 
-BspStage S3_Init(IVector2 *polygon, usize numVertices, S3 *scene);
+BspStage S3_Init(const Polygon *polygon, S3 *scene);
+BspStage S3_InitTiles(const TileIndex *index, usize memoryCap, S3 *scene);
 BspStage S3_Render(S3 *scene);
 BspStage S3_RenderFailure(S3 *scene);
 void S3_Free(S3 *scene);
@@ -0,0 +1,87 @@
+#ifndef SPATIAL_INDEX_H_
+#define SPATIAL_INDEX_H_
+
+#include "bsp.h"
+#include "f64_segment.h"
+#include "f64_vector.h"
+#include <stdbool.h>
+
+typedef enum SpatialBackend {
+    SpatialBackendBsp,
+    SpatialBackendKdTree,
+    SpatialBackendBvh,
+    SpatialBackendGrid,
+} SpatialBackend;
+
+typedef struct SpatialBox {
+    DVector2 min;
+    DVector2 max;
+} SpatialBox;
+
+typedef struct SpatialHit {
+    f64 distance;   /* along the ray (ray casts) or from the query point (nearest) */
+    DVector2 point; /* closest point of / first point on the segment */
+    u32 segment;    /* index of the segment in the array the index was built from */
+} SpatialHit;
+
+/* what every backend implements, a NULL query isn't supported by that backend */
+typedef struct SpatialIndexOps {
+    bool (*containsPoint)(const void *impl, DVector2 pt);
+    bool (*rayCast)(const void *impl, DVector2 origin, DVector2 dir, f64 maxDistance, SpatialHit *hit);
+    usize (*queryBox)(const void *impl, SpatialBox box, u32 *segments, usize capacity);
+    bool (*nearest)(const void *impl, DVector2 pt, SpatialHit *hit);
+    usize (*memoryUsage)(const void *impl);
+    void (*free)(void *impl);
+} SpatialIndexOps;
+
+/*
+ * common query interface over interchangeable acceleration structures
+ *
+ * every backend is built from the same DSegment array (a polygon's
+ * segments, inside on the left) and answers the same queries, so one
+ * workload can be timed on each of them:
+ *   - containsPoint: point in polygon
+ *   - rayCast: first segment hit within maxDistance (dir needn't be unit,
+ *     distances are in units of |dir|)
+ *   - queryBox: ids of every segment touching the box, the first capacity
+ *     of them are written to segments and the total is returned
+ *   - nearest: closest segment to a point
+ * results are identical across backends up to ties between segments and
+ * points right on the boundary
+ */
+typedef struct SpatialIndex {
+    SpatialBackend backend;
+    const SpatialIndexOps *ops;
+    void *impl;        /* backend's own structure */
+    usize numSegments; /* number of segments indexed */
+} SpatialIndex;
+
+SpatialIndex *BuildSpatialIndex(SpatialBackend backend, const DSegment *segments, usize numSegments);
+void FreeSpatialIndex(SpatialIndex *index);
+bool ParseSpatialBackend(const char *name, SpatialBackend *backend);
+const char *SpatialBackendName(SpatialBackend backend);
+
+bool SpatialContainsPoint(const SpatialIndex *index, DVector2 pt);
+bool SpatialRayCast(const SpatialIndex *index, DVector2 origin, DVector2 dir, f64 maxDistance, SpatialHit *hit);
+usize SpatialQueryBox(const SpatialIndex *index, SpatialBox box, u32 *segments, usize capacity);
+bool SpatialNearest(const SpatialIndex *index, DVector2 pt, SpatialHit *hit);
+usize SpatialMemoryUsage(const SpatialIndex *index);
+
+/* backends, impl is handed to the matching ops */
+void *BuildBspSpatialIndex(const DSegment *segments, usize numSegments);
+void *BuildKdSpatialIndex(const DSegment *segments, usize numSegments);
+void *BuildBvhSpatialIndex(const DSegment *segments, usize numSegments);
+void *BuildGridSpatialIndex(const DSegment *segments, usize numSegments);
+extern const SpatialIndexOps BspSpatialOps;
+extern const SpatialIndexOps KdSpatialOps;
+extern const SpatialIndexOps BvhSpatialOps;
+extern const SpatialIndexOps GridSpatialOps;
+
+/* helpers shared by the backends */
+SpatialBox SpatialSegmentBox(DSegment s);
+bool SpatialBoxContains(SpatialBox box, DVector2 pt);
+f64 SpatialBoxDistance(SpatialBox box, DVector2 pt);
+bool SpatialRayBox(SpatialBox box, DVector2 origin, DVector2 dir, f64 *tMin, f64 *tMax);
+bool SpatialCrossesRight(DSegment s, DVector2 pt, f64 *x);
+
+#endif // SPATIAL_INDEX_H_
@@ -0,0 +1,49 @@
+#ifndef TILE_H_
+#define TILE_H_
+
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "f64_segment.h"
+#include "f64_vector.h"
+#include <stdbool.h>
+
+#define TILE_PATH_SIZE 512
+#define TILE_INDEX_NAME "tiles.idx"
+#define TILE_INDEX_VERSION 1
+
+typedef struct TileGrid {
+    DVector2 origin; /* top left corner of tile (0, 0) */
+    f64 tileWidth;   /* width of a single tile */
+    f64 tileHeight;  /* height of a single tile */
+    u32 cols;        /* number of tile columns */
+    u32 rows;        /* number of tile rows */
+} TileGrid;
+
+/*
+ * top-level index of a tiled world
+ *
+ * every tile with at least one segment has its own tree file in the on-disk
+ * flat tree format (see WriteBspFlatTree) next to the index, named after its
+ * column and row. a tile whose file is missing failed to build and can be
+ * rebuilt on its own with RetryTile
+ */
+typedef struct TileIndex {
+    TileGrid grid;
+    u32 *numSegments;                 /* segment count of each tile (row major) */
+    char directory[TILE_PATH_SIZE];   /* directory holding index and tile files */
+} TileIndex;
+
+TileGrid BuildTileGrid(BoundingRegion region, u32 cols, u32 rows);
+DSegment *ClipTileSegments(const DSegment *segments, usize numSegments, TileGrid grid, u32 col, u32 row, usize *size);
+
+usize BuildTileWorld(const DSegment *segments, usize numSegments, TileGrid grid, const char *directory, usize maxWorkers);
+bool RetryTile(const char *directory, const DSegment *segments, usize numSegments, u32 col, u32 row);
+bool BuildTile(const DSegment *segments, usize numSegments, TileGrid grid, u32 col, u32 row, const char *directory);
+
+TileIndex *ReadTileIndex(const char *directory);
+void FreeTileIndex(TileIndex *index);
+BspFlatTree *ReadTile(const TileIndex *index, u32 col, u32 row);
+/* false (and an error logged) if the path doesn't fit in TILE_PATH_SIZE */
+bool TilePath(const char *directory, u32 col, u32 row, char *path);
+
+#endif // TILE_H_
@@ -0,0 +1,67 @@
+#ifndef TILE_CACHE_H_
+#define TILE_CACHE_H_
+
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "raylib.h"
+#include "tile.h"
+#include <stdbool.h>
+#ifndef __EMSCRIPTEN__
+#include <pthread.h>
+#endif
+
+#define TILE_LOOKAHEAD 1.0f /* seconds of movement used to predict which tiles get prefetched */
+#define TILE_MAX_WANTED 18  /* 3x3 block around the player + 3x3 block around the predicted position */
+
+typedef enum TileState {
+    TileUnloaded,
+    TileQueued,
+    TileLoading,
+    TileResident,
+    TileEmpty,   /* tile has no segments, nothing to load */
+    TileMissing, /* tile file couldn't be read */
+} TileState;
+
+typedef struct TileSlot {
+    BspFlatTree *tree; /* tile tree (only while resident) */
+    usize bytes;       /* memory used by tile tree */
+    u64 lastWanted;    /* last frame tile was near the player */
+    TileState state;
+} TileSlot;
+
+/*
+ * keeps the tiles around the player resident, loading neighbors on a
+ * background thread and evicting the least recently wanted tiles once the
+ * resident trees go over memoryCap. the cap is soft: tiles wanted this
+ * frame are never evicted, so resident trees can go over it by up to
+ * TILE_MAX_WANTED tiles
+ *
+ * only the loader thread moves tiles from queued to resident and only
+ * TileCacheUpdate evicts, so trees handed out by an update stay valid until
+ * the next update. without a loader thread (on the web, or if it couldn't
+ * be started) TileCacheUpdate loads the queued tiles itself
+ */
+typedef struct TileCache {
+    const TileIndex *index; /* index of tiled world (not owned) */
+    TileSlot *slots;        /* one slot per tile (row major) */
+    usize memoryCap;        /* bytes of resident tile trees to evict down to (soft, see above) */
+    usize residentBytes;    /* bytes of resident tile trees */
+    u64 frame;              /* number of updates so far */
+    u32 *queue;             /* tiles waiting to be loaded (highest priority first) */
+    usize queueHead;        /* index of next tile in queue to load */
+    usize queueSize;        /* number of tiles in queue */
+    bool quit;              /* tells loader thread to exit */
+    bool synchronous;       /* no loader thread, TileCacheUpdate loads queued tiles */
+#ifndef __EMSCRIPTEN__
+    pthread_t loader;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+#endif
+} TileCache;
+
+TileCache *NewTileCache(const TileIndex *index, usize memoryCap);
+void FreeTileCache(TileCache *cache);
+usize TileCacheUpdate(TileCache *cache, Vector2 pos, Vector2 velocity, u32 *resident, usize maxResident);
+const BspFlatTree *TileCacheTree(const TileCache *cache, u32 tile);
+
+#endif // TILE_CACHE_H_
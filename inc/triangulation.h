@@ -12,6 +12,8 @@ typedef struct Triangle {
 
 Triangle *MonotoneTriangulation(DSegment *segments, usize numSegments);
 void MonotoneTriangulateDCEL(DCEL *polygon);
+Triangle *TriangulatePolygon(DSegment *segments, const usize *ringSizes, const RingKind *ringKinds, usize numRings, usize *numTriangles);
+void TriangulateDCEL(DCEL *dcel);
 Vector2 TriangleCenter(Triangle t);
 
 #endif // TRIANGULATION_H_
@@ -0,0 +1,145 @@
+#include "bsp_bake.h"
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "bsp_tree.h"
+#include "raylib.h"
+#include <stdio.h>
+
+/* ******************** helpers ******************** */
+void writeFlatIdx(u32 idx, FILE *out);
+/* ************************************************* */
+
+bool
+WriteBspFlatTreeSource(const BspFlatTree *tree, const char *name, FILE *out)
+{
+    /* floats are written as hex literals (%a) so the baked tree is bit-identical to the runtime one */
+    fprintf(out, "/* generated by WriteBspFlatTreeSource, do not edit */\n");
+    fprintf(out, "#include \"bsp_flat.h\"\n\n");
+
+    if (tree->numNodes > 0)
+    {
+        fprintf(out, "static const _Alignas(BSP_CACHE_LINE) BspFlatNode %sNodes[%u] = {\n", name, (u32)tree->numNodes);
+        for (usize i = 0; i < tree->numNodes; i++)
+        {
+            BspFlatNode node = tree->nodes[i];
+            fprintf(out, "    { .line = { .a = %a, .b = %a, .c = %a }, .left = ", node.line.a, node.line.b, node.line.c);
+            writeFlatIdx(node.left, out);
+            fprintf(out, ", .right = ");
+            writeFlatIdx(node.right, out);
+            fprintf(out, " },\n");
+        }
+        fprintf(out, "};\n\n");
+
+        fprintf(out, "static const BspFragmentRange %sRanges[%u] = {\n", name, (u32)tree->numNodes);
+        for (usize i = 0; i < tree->numNodes; i++)
+            fprintf(out, "    { .first = %u, .count = %u },\n", tree->ranges[i].first, tree->ranges[i].count);
+        fprintf(out, "};\n\n");
+
+        fprintf(out, "static const u32 %sParents[%u] = {\n", name, (u32)tree->numNodes);
+        for (usize i = 0; i < tree->numNodes; i++)
+        {
+            fprintf(out, "    ");
+            writeFlatIdx(tree->parents[i], out);
+            fprintf(out, ",\n");
+        }
+        fprintf(out, "};\n\n");
+
+        fprintf(out, "static const Color %sColors[%u] = {\n", name, (u32)tree->numNodes);
+        for (usize i = 0; i < tree->numNodes; i++)
+        {
+            Color c = tree->colors[i];
+            fprintf(out, "    { %u, %u, %u, %u },\n", c.r, c.g, c.b, c.a);
+        }
+        fprintf(out, "};\n\n");
+
+        /* payloads stay writable so users can attach data to a baked tree */
+        fprintf(out, "static u32 %sPayloads[%u] = {\n", name, (u32)tree->numNodes);
+        for (usize i = 0; i < tree->numNodes; i++)
+            fprintf(out, "    %u,\n", tree->payloads[i]);
+        fprintf(out, "};\n\n");
+
+        if (tree->cells)
+        {
+            fprintf(out, "static const u8 %sCells[%u] = {\n", name, (u32)tree->numNodes);
+            for (usize i = 0; i < tree->numNodes; i++)
+                fprintf(out, "    %u,\n", tree->cells[i]);
+            fprintf(out, "};\n\n");
+        }
+
+        if (tree->bounds)
+        {
+            fprintf(out, "static const BspBox %sBounds[%u] = {\n", name, (u32)tree->numNodes);
+            for (usize i = 0; i < tree->numNodes; i++)
+            {
+                BspBox b = tree->bounds[i];
+                fprintf(out, "    { .min = { .x = %a, .y = %a }, .max = { .x = %a, .y = %a } },\n", b.min.x, b.min.y, b.max.x, b.max.y);
+            }
+            fprintf(out, "};\n\n");
+        }
+    }
+
+    if (tree->numFragments > 0)
+    {
+        fprintf(out, "static const BspFragment %sFragments[%u] = {\n", name, (u32)tree->numFragments);
+        for (usize i = 0; i < tree->numFragments; i++)
+            fprintf(out, "    { .left = %u, .right = %u, .source = %u },\n", tree->fragments[i].left, tree->fragments[i].right, tree->fragments[i].source);
+        fprintf(out, "};\n\n");
+    }
+
+    if (tree->numVertices > 0)
+    {
+        fprintf(out, "static const DVector2 %sVertices[%u] = {\n", name, (u32)tree->numVertices);
+        for (usize i = 0; i < tree->numVertices; i++)
+            fprintf(out, "    { .x = %a, .y = %a },\n", tree->vertices[i].x, tree->vertices[i].y);
+        fprintf(out, "};\n\n");
+    }
+
+    fprintf(out, "const BspFlatTree %s = {\n", name);
+    if (tree->numNodes > 0)
+    {
+        fprintf(out, "    .nodes = %sNodes,\n", name);
+        fprintf(out, "    .ranges = %sRanges,\n", name);
+        fprintf(out, "    .parents = %sParents,\n", name);
+        fprintf(out, "    .colors = %sColors,\n", name);
+        fprintf(out, "    .payloads = %sPayloads,\n", name);
+    }
+    else fprintf(out, "    .nodes = NULL,\n    .ranges = NULL,\n    .parents = NULL,\n    .colors = NULL,\n    .payloads = NULL,\n");
+    if (tree->numNodes > 0 && tree->cells) fprintf(out, "    .cells = %sCells,\n", name);
+    else fprintf(out, "    .cells = NULL,\n");
+    if (tree->numNodes > 0 && tree->bounds) fprintf(out, "    .bounds = %sBounds,\n", name);
+    else fprintf(out, "    .bounds = NULL,\n");
+    if (tree->numFragments > 0) fprintf(out, "    .fragments = %sFragments,\n", name);
+    else fprintf(out, "    .fragments = NULL,\n");
+    if (tree->numVertices > 0) fprintf(out, "    .vertices = %sVertices,\n", name);
+    else fprintf(out, "    .vertices = NULL,\n");
+    fprintf(out, "    .numNodes = %u,\n", (u32)tree->numNodes);
+    fprintf(out, "    .numFragments = %u,\n", (u32)tree->numFragments);
+    fprintf(out, "    .numVertices = %u,\n", (u32)tree->numVertices);
+    fprintf(out, "};\n");
+    return !ferror(out);
+}
+
+bool
+BakeBspTree(BspNode *root, const char *name, const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        TraceLog(LOG_WARNING, "BAKE: could not open %s for writing", path);
+        return false;
+    }
+    BspFlatTree *tree = FlattenBspTree(root);
+    bool ok = WriteBspFlatTreeSource(tree, name, out);
+    FreeBspFlatTree(tree);
+    ok = (fclose(out) == 0) && ok;
+    if (!ok) TraceLog(LOG_WARNING, "BAKE: could not write %s", path);
+    else TraceLog(LOG_INFO, "BAKE: wrote tree '%s' to %s", name, path);
+    return ok;
+}
+
+void
+writeFlatIdx(u32 idx, FILE *out)
+{
+    if (idx == BSP_NULL_IDX) fprintf(out, "BSP_NULL_IDX");
+    else fprintf(out, "%u", idx);
+}
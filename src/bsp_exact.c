@@ -0,0 +1,269 @@
+#include "bsp_exact.h"
+#include "bsp.h"
+#include "bsp_tree.h"
+#include "f64_segment.h"
+#include "polygon.h"
+#include "raylib.h"
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ******************** helpers ******************** */
+i32 xSign(i128 v);
+DSegment xSegmentToScreen(XSegment s, PolygonFit fit);
+/* ************************************************* */
+
+bool
+PolygonIsGrid(const Polygon *polygon)
+{
+    for (usize i = 0; i < polygon->numVertices; i++)
+    {
+        DVector2 v = polygon->vertices[i];
+        if (v.x != floor(v.x) || v.y != floor(v.y)) return false;
+        if (babs(v.x) > BSP_EXACT_MAX_COORD || babs(v.y) > BSP_EXACT_MAX_COORD) return false;
+    }
+    return polygon->numVertices > 0;
+}
+
+XSegment *
+BuildExactSegments(const Polygon *polygon, usize *size)
+{
+    assert(PolygonIsGrid(polygon));
+    usize numSegments = polygon->numVertices;
+    XSegment *segments = (XSegment *)malloc(numSegments * sizeof(XSegment));
+
+    /* same ring orientation (holes clockwise) and segment order as BuildPolygonSegments, just without the scale */
+    usize ringStart = 0;
+    for (usize r = 0; r < polygon->numRings; r++)
+    {
+        usize ringSize = polygon->ringSizes[r];
+        const DVector2 *ring = &polygon->vertices[ringStart];
+
+        /* twice the signed area, exact since every vertex is on the grid */
+        i64 signedArea = 0;
+        for (usize i = 0; i < ringSize; i++)
+        {
+            usize j = (i + 1) % ringSize;
+            signedArea += ((i64)ring[i].x * (i64)ring[j].y) - ((i64)ring[j].x * (i64)ring[i].y);
+        }
+
+        bool forward = (signedArea >= 0) == (polygon->ringKinds[r] == RingOuter);
+        for (usize i = 0; i < ringSize; i++)
+        {
+            usize j = (i + 1) % ringSize;
+            usize leftIdx = forward ? i : j;
+            usize rightIdx = forward ? j : i;
+            usize segmentIdx = forward ? i : ringSize - 1 - i;
+            XPoint left = { (i64)ring[leftIdx].x, (i64)ring[leftIdx].y, 1 };
+            XPoint right = { (i64)ring[rightIdx].x, (i64)ring[rightIdx].y, 1 };
+            segments[ringStart + segmentIdx] = (XSegment){
+                .left = left,
+                .right = right,
+                .line = XLineFromPoints(left, right),
+                .splitLeft = false,
+                .splitRight = false,
+                .id = (u32)(ringStart + segmentIdx),
+            };
+        }
+        ringStart += ringSize;
+    }
+
+    *size = numSegments;
+    return segments;
+}
+
+BspNode *
+BuildExactBspTree(XSegment *segments, usize len, BspNode *parent, PolygonFit fit)
+{ /*
+   * same splitter choice and segment order as BuildBspTree, so both builds
+   * give the same tree wherever BSP_EPSILON didn't change a classification
+   */
+    BspNode *node = (BspNode *)malloc(sizeof(BspNode));
+    node->left = NULL;
+    node->right = NULL;
+    node->parent = parent;
+    node->color = BLANK;
+
+    if (len <= 1)
+    {
+        node->segments = (len > 0) ? (DSegment *)malloc(sizeof(DSegment)) : NULL;
+        node->numSegments = len;
+        if (len > 0) node->segments[0] = xSegmentToScreen(segments[0], fit);
+        free(segments);
+        return node;
+    }
+
+    /* use free split as partitioning segment if one exists */
+    usize splitIdx = 0;
+    for (usize i = 0; i < len; i++)
+    {
+        if (segments[i].splitLeft && segments[i].splitRight)
+        {
+            splitIdx = i;
+            break;
+        }
+    }
+    XLine splitter = segments[splitIdx].line;
+
+    /* first pass - classify once and find size needed for sub-trees */
+    DSide *sides = (DSide *)malloc(len * sizeof(DSide));
+    usize numBehind = 0, numInFront = 0, numInside = 0;
+    for (usize i = 0; i < len; i++)
+    {
+        sides[i] = XLineSides(splitter, segments[i]);
+        numInside += (sides[i] == DSideInside);
+        numInFront += (sides[i] == DSideLeft || sides[i] == DSideBoth);
+        numBehind += (sides[i] == DSideRight || sides[i] == DSideBoth);
+    }
+
+    assert(numInside >= 1);
+    node->segments = (DSegment *)malloc(numInside * sizeof(DSegment));
+    node->numSegments = numInside;
+    XSegment *segmentsBehind = (numBehind > 0) ? (XSegment *)malloc(numBehind * sizeof(XSegment)) : NULL;
+    XSegment *segmentsInFront = (numInFront > 0) ? (XSegment *)malloc(numInFront * sizeof(XSegment)) : NULL;
+
+    /* second pass - add segments to middle node and recurse into left/right children */
+    usize behindIdx = 0, inFrontIdx = 0, insideIdx = 0;
+    for (usize i = 0; i < len; i++)
+    {
+        switch (sides[i])
+        {
+        case DSideInside:
+            /* splitter goes first, the node's line is taken from segments[0] (regions, flat trees) */
+            if (i == splitIdx && insideIdx > 0)
+            {
+                node->segments[insideIdx++] = node->segments[0];
+                node->segments[0] = xSegmentToScreen(segments[i], fit);
+            }
+            else node->segments[insideIdx++] = xSegmentToScreen(segments[i], fit);
+            break;
+        case DSideLeft:
+            segmentsInFront[inFrontIdx++] = segments[i];
+            break;
+        case DSideRight:
+            segmentsBehind[behindIdx++] = segments[i];
+            break;
+        case DSideBoth: {
+            /* the endpoints are strictly on opposite sides, so the lines can't be parallel */
+            XSegment behind = segments[i], inFront = segments[i];
+            XPoint intersection = XLinesIntersection(splitter, segments[i].line);
+            if (XLineSide(splitter, segments[i].left) == DSideRight)
+            {
+                behind.splitRight = true;
+                inFront.splitLeft = true;
+                behind.right = intersection;
+                inFront.left = intersection;
+            }
+            else
+            {
+                behind.splitLeft = true;
+                inFront.splitRight = true;
+                behind.left = intersection;
+                inFront.right = intersection;
+            }
+            segmentsBehind[behindIdx++] = behind;
+            segmentsInFront[inFrontIdx++] = inFront;
+        }
+        break;
+        }
+    }
+    free(sides);
+    free(segments);
+
+    node->left = BuildExactBspTree(segmentsBehind, numBehind, node, fit);
+    node->right = BuildExactBspTree(segmentsInFront, numInFront, node, fit);
+    return node;
+}
+
+BspNode *
+BuildPolygonBspTree(const Polygon *polygon, BoundingRegion region)
+{
+    /* grid polygons (everything drawn in stage 1) get the exact build, anything else the f64 one */
+    if (PolygonIsGrid(polygon))
+    {
+        usize numSegments = 0;
+        XSegment *segments = BuildExactSegments(polygon, &numSegments);
+        return BuildExactBspTree(segments, numSegments, NULL, FitPolygon(polygon, region));
+    }
+    usize numSegments = 0;
+    DSegment *segments = BuildPolygonSegments(polygon, region, &numSegments);
+    return BuildBspTree(segments, numSegments, NULL);
+}
+
+XLine
+XLineFromPoints(XPoint left, XPoint right)
+{
+    /* only input vertices start a line, so both points are on the grid */
+    assert(left.w == 1 && right.w == 1);
+    return (XLine){
+        .a = left.y - right.y,
+        .b = right.x - left.x,
+        .c = (left.x * right.y) - (right.x * left.y),
+    };
+}
+
+XPoint
+XLinesIntersection(XLine l1, XLine l2)
+{ /*
+   * the cross product of the two coefficient vectors, a point (x, y, w) on
+   * both lines. its w is the determinant of the lines, negated if needed so
+   * w > 0 (a point with w < 0 would flip the sign of every side test)
+   */
+    i128 x = (i128)l1.b * l2.c - (i128)l1.c * l2.b;
+    i128 y = (i128)l1.c * l2.a - (i128)l1.a * l2.c;
+    i128 w = (i128)l1.a * l2.b - (i128)l1.b * l2.a;
+    assert(w != 0);
+    i64 s = (w > 0) ? 1 : -1;
+    return (XPoint){ s * (i64)x, s * (i64)y, s * (i64)w };
+}
+
+DSide
+XLineSide(XLine line, XPoint pt)
+{
+    static const DSide sides[3] = { DSideRight, DSideInside, DSideLeft };
+    return sides[xSign((i128)line.a * pt.x + (i128)line.b * pt.y + (i128)line.c * pt.w) + 1];
+}
+
+DSide
+XLineSides(XLine line, XSegment s)
+{ /*
+   * signs of both endpoints index a table instead of a chain of comparisons:
+   * on the line or touching it from one side counts as that side
+   */
+    static const DSide sides[3][3] = {
+        { DSideRight, DSideRight, DSideBoth },
+        { DSideRight, DSideInside, DSideLeft },
+        { DSideBoth, DSideLeft, DSideLeft },
+    };
+    i32 left = xSign((i128)line.a * s.left.x + (i128)line.b * s.left.y + (i128)line.c * s.left.w);
+    i32 right = xSign((i128)line.a * s.right.x + (i128)line.b * s.right.y + (i128)line.c * s.right.w);
+    return sides[left + 1][right + 1];
+}
+
+DVector2
+XPointToScreen(XPoint pt, PolygonFit fit)
+{
+    return (DVector2){
+        .x = fit.scale * ((f64)pt.x / (f64)pt.w) + fit.padding.x,
+        .y = fit.scale * ((f64)pt.y / (f64)pt.w) + fit.padding.y,
+    };
+}
+
+i32
+xSign(i128 v)
+{
+    return (v > 0) - (v < 0);
+}
+
+DSegment
+xSegmentToScreen(XSegment s, PolygonFit fit)
+{
+    return (DSegment){
+        .left = XPointToScreen(s.left, fit),
+        .right = XPointToScreen(s.right, fit),
+        .splitLeft = s.splitLeft,
+        .splitRight = s.splitRight,
+        .id = s.id,
+    };
+}
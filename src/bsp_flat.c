@@ -0,0 +1,1169 @@
+#include "bsp_flat.h"
+#include "bsp.h"
+#include "bsp_tree.h"
+#include "f64_segment.h"
+#include "parallel.h"
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct VertexPool {
+    DVector2 *vertices; /* unique vertices in insertion order */
+    u32 *table;         /* open addressing hash table of vertex indices (BSP_NULL_IDX if empty) */
+    usize numVertices;  /* number of unique vertices */
+    usize tableSize;    /* size of hash table (power of 2) */
+} VertexPool;
+
+/* writable views of the arrays of a tree being flattened */
+typedef struct FlatBuilder {
+    BspFlatNode *nodes;
+    BspFragmentRange *ranges;
+    u32 *parents;
+    Color *colors;
+    BspFragment *fragments;
+    DVector2 *vertices; /* two per fragment, welded once the whole tree is filled */
+    u32 numNodes;     /* nodes filled so far */
+    u32 numFragments; /* fragments filled so far */
+} FlatBuilder;
+
+/* what the threads of BspFlatRayCastPackets share */
+typedef struct RayBatch {
+    const BspFlatTree *tree;
+    DVector2 origin;
+    const DVector2 *dirs;
+    usize numRays;
+    usize packetSize;
+    f64 maxDistance;
+    BspRayHit *hits;
+} RayBatch;
+
+/* the rays of one packet, lane by lane */
+typedef struct RayPacket {
+    f64 dx[BSP_PACKET_MAX]; /* directions, split by coordinate so lane loops vectorize */
+    f64 dy[BSP_PACKET_MAX];
+    f64 tMin[BSP_PACKET_MAX]; /* the interval each lane starts with at the root */
+    f64 tMax[BSP_PACKET_MAX];
+    BspRayHit hits[BSP_PACKET_MAX];
+    u32 width; /* lanes in use, the packet size */
+} RayPacket;
+
+/* what the threads of BspFlatLinesOfSight share */
+typedef struct SightBatch {
+    const BspFlatTree *tree;
+    const DVector2 *from;
+    const DVector2 *to;
+    bool *visible;
+} SightBatch;
+
+/* a range query on its way down the tree */
+typedef struct RangeQuery {
+    BspBox box;      /* the query box, or the disc's bounding box */
+    DVector2 center; /* center of the disc */
+    f64 radius;      /* radius of the disc, negative for a box query */
+    u32 *fragments;  /* caller's buffer */
+    usize capacity;  /* size of fragments */
+    usize found;     /* fragments found so far, including those that didn't fit */
+} RangeQuery;
+
+/* what the threads of BspFlatLocatePoints share */
+typedef struct LocateBatch {
+    const BspFlatTree *tree;
+    const DVector2 *points;
+    u32 *leaves;
+    DSide *sides; /* NULL if the caller doesn't want them */
+} LocateBatch;
+
+/* ************** helpers ************** */
+usize countFlatNodes(BspNode *node, usize *numFragments);
+u32 flattenNode(BspNode *node, u32 parent, FlatBuilder *builder);
+u32 *subtreeSizes(const BspFlatTree *tree);
+usize layoutVanEmdeBoas(const BspFlatTree *tree, const u32 *sizes, u32 idx, u32 levels, u32 *order, usize numOrdered);
+usize gatherLevel(const BspFlatTree *tree, u32 idx, u32 depth, u32 *level, usize numLevel);
+u32 poolVertex(VertexPool *pool, DVector2 v);
+u64 hashVertex(DVector2 v);
+bool onNodeFragment(const BspFlatTree *tree, u32 idx, DVector2 pt);
+void locateRange(void *ctx, usize first, usize last);
+bool rayCastNode(const BspFlatTree *tree, u32 idx, DVector2 origin, DVector2 dir, f64 tMin, f64 tMax, BspRayHit *hit);
+bool rayHitFragments(const BspFlatTree *tree, u32 idx, DVector2 origin, DVector2 dir, f64 tMin, f64 tMax, BspRayHit *hit);
+void rayPacketRange(void *ctx, usize first, usize last);
+bool sightBlocked(const BspFlatTree *tree, u32 idx, DVector2 a, DVector2 b, f64 tMin, f64 tMax);
+bool sightBlockedByFragments(const BspFlatTree *tree, u32 idx, DVector2 a, DVector2 b);
+void sightRange(void *ctx, usize first, usize last);
+void nearestNode(const BspFlatTree *tree, u32 idx, DVector2 pt, BspRayHit *best);
+BspBox boundNode(const BspFlatTree *tree, u32 idx, BspBox *bounds);
+void rangeNode(const BspFlatTree *tree, u32 idx, RangeQuery *query);
+bool rangeMeetsBox(const RangeQuery *query, BspBox box);
+u32 rayCastPacketNode(const BspFlatTree *tree, u32 idx, DVector2 origin, RayPacket *packet, u32 mask, const f64 *tMin, const f64 *tMax);
+/* ************************************* */
+
+BspFlatTree *
+FlattenBspTree(BspNode *root)
+{
+    usize numFragments = 0;
+    usize numNodes = countFlatNodes(root, &numFragments);
+    BspFlatTree *tree = AllocBspFlatTree(numNodes, numFragments, 2 * numFragments);
+    FlatBuilder builder = {
+        .nodes = (BspFlatNode *)tree->nodes,
+        .ranges = (BspFragmentRange *)tree->ranges,
+        .parents = (u32 *)tree->parents,
+        .colors = (Color *)tree->colors,
+        .fragments = (BspFragment *)tree->fragments,
+        .vertices = (DVector2 *)tree->vertices,
+        .numNodes = 0,
+        .numFragments = 0,
+    };
+
+    flattenNode(root, BSP_NULL_IDX, &builder);
+    assert(builder.numNodes == numNodes);
+    assert(builder.numFragments == numFragments);
+    tree->numVertices = 2 * numFragments;
+    WeldBspFlatVertices(tree);
+    return tree;
+}
+
+BspFlatTree *
+RelayoutBspFlatTree(const BspFlatTree *tree, BspLayout layout)
+{ /*
+   * returns a copy of tree with its nodes (and cold arrays) permuted into
+   * layout, fragments and vertices are shared by index so they're copied as is
+   */
+    usize n = tree->numNodes;
+    u32 *order = (u32 *)malloc(max(n, 1) * sizeof(u32)); /* order[k] = old index of new node k */
+    usize numOrdered = 0;
+    if (n > 0 && layout == BspLayoutPreOrder)
+    {
+        /* explicit stack, pushing right before left pops the left subtree first */
+        u32 *stack = (u32 *)malloc(n * sizeof(u32));
+        usize top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            u32 idx = stack[--top];
+            order[numOrdered++] = idx;
+            if (tree->nodes[idx].right != BSP_NULL_IDX) stack[top++] = tree->nodes[idx].right;
+            if (tree->nodes[idx].left != BSP_NULL_IDX) stack[top++] = tree->nodes[idx].left;
+        }
+        free(stack);
+    }
+    else if (n > 0 && layout == BspLayoutBreadthFirst)
+    {
+        /* order doubles as the queue */
+        order[numOrdered++] = 0;
+        for (usize head = 0; head < numOrdered; head++)
+        {
+            const BspFlatNode *node = &tree->nodes[order[head]];
+            if (node->left != BSP_NULL_IDX) order[numOrdered++] = node->left;
+            if (node->right != BSP_NULL_IDX) order[numOrdered++] = node->right;
+        }
+    }
+    else if (n > 0 && layout == BspLayoutVanEmdeBoas)
+    {
+        u32 *sizes = subtreeSizes(tree);
+        numOrdered = layoutVanEmdeBoas(tree, sizes, 0, 0, order, 0);
+        free(sizes);
+    }
+    assert(numOrdered == n);
+
+    u32 *newIdx = (u32 *)malloc(max(n, 1) * sizeof(u32));
+    for (usize k = 0; k < n; k++)
+        newIdx[order[k]] = k;
+
+    BspFlatTree *copy = AllocBspFlatTree(n, tree->numFragments, tree->numVertices);
+    copy->numVertices = tree->numVertices;
+    BspFlatNode *nodes = (BspFlatNode *)copy->nodes;
+    BspFragmentRange *ranges = (BspFragmentRange *)copy->ranges;
+    u32 *parents = (u32 *)copy->parents;
+    Color *colors = (Color *)copy->colors;
+    for (usize k = 0; k < n; k++)
+    {
+        u32 old = order[k];
+        nodes[k] = tree->nodes[old];
+        if (nodes[k].left != BSP_NULL_IDX) nodes[k].left = newIdx[nodes[k].left];
+        if (nodes[k].right != BSP_NULL_IDX) nodes[k].right = newIdx[nodes[k].right];
+        ranges[k] = tree->ranges[old];
+        parents[k] = (tree->parents[old] == BSP_NULL_IDX) ? BSP_NULL_IDX : newIdx[tree->parents[old]];
+        colors[k] = tree->colors[old];
+        copy->payloads[k] = tree->payloads[old];
+    }
+    if (tree->cells)
+    {
+        u8 *cells = (u8 *)malloc(max(n, 1) * sizeof(u8));
+        for (usize k = 0; k < n; k++)
+            cells[k] = tree->cells[order[k]];
+        copy->cells = cells;
+    }
+    if (tree->bounds)
+    {
+        BspBox *bounds = (BspBox *)malloc(max(n, 1) * sizeof(BspBox));
+        for (usize k = 0; k < n; k++)
+            bounds[k] = tree->bounds[order[k]];
+        copy->bounds = bounds;
+    }
+    memcpy((BspFragment *)copy->fragments, tree->fragments, tree->numFragments * sizeof(BspFragment));
+    memcpy((DVector2 *)copy->vertices, tree->vertices, tree->numVertices * sizeof(DVector2));
+
+    free(order);
+    free(newIdx);
+    return copy;
+}
+
+bool
+ParseBspLayout(const char *name, BspLayout *layout)
+{
+    for (BspLayout l = BspLayoutPreOrder; l <= BspLayoutVanEmdeBoas; l++)
+    {
+        if (strcmp(name, BspLayoutName(l)) != 0) continue;
+        *layout = l;
+        return true;
+    }
+    return false;
+}
+
+const char *
+BspLayoutName(BspLayout layout)
+{
+    switch (layout)
+    {
+    case BspLayoutPreOrder: return "preorder";
+    case BspLayoutBreadthFirst: return "bfs";
+    case BspLayoutVanEmdeBoas: return "veb";
+    }
+    return "unknown";
+}
+
+BspFlatTree *
+AllocBspFlatTree(usize numNodes, usize numFragments, usize numVertices)
+{
+    /* every array sized for the given counts, numVertices is left at 0 for the caller to set once they're filled */
+    BspFlatTree *tree = (BspFlatTree *)malloc(sizeof(BspFlatTree));
+    tree->numNodes = numNodes;
+    tree->numFragments = numFragments;
+    tree->numVertices = 0;
+    tree->nodes = AllocBspFlatNodes(numNodes);
+    tree->ranges = (BspFragmentRange *)malloc(max(numNodes, 1) * sizeof(BspFragmentRange));
+    tree->parents = (u32 *)malloc(max(numNodes, 1) * sizeof(u32));
+    tree->colors = (Color *)malloc(max(numNodes, 1) * sizeof(Color));
+    tree->payloads = (u32 *)calloc(max(numNodes, 1), sizeof(u32));
+    tree->cells = NULL;
+    tree->bounds = NULL;
+    tree->fragments = (BspFragment *)malloc(max(numFragments, 1) * sizeof(BspFragment));
+    tree->vertices = (DVector2 *)malloc(max(numVertices, 1) * sizeof(DVector2));
+    return tree;
+}
+
+BspFlatNode *
+AllocBspFlatNodes(usize numNodes)
+{
+    /* aligned so every cache line holds whole nodes, aligned_alloc wants a multiple of the alignment */
+    usize size = max(numNodes, 1) * sizeof(BspFlatNode);
+    return (BspFlatNode *)aligned_alloc(BSP_CACHE_LINE, (size + BSP_CACHE_LINE - 1) / BSP_CACHE_LINE * BSP_CACHE_LINE);
+}
+
+void
+WeldBspFlatVertices(BspFlatTree *tree)
+{
+    /* at most 2 vertices per fragment, table is kept at most half full */
+    VertexPool pool = { (DVector2 *)malloc(max(tree->numVertices, 1) * sizeof(DVector2)), NULL, 0, 1 };
+    while (pool.tableSize < 2 * tree->numVertices)
+        pool.tableSize *= 2;
+    pool.table = (u32 *)malloc(pool.tableSize * sizeof(u32));
+    memset(pool.table, 0xff, pool.tableSize * sizeof(u32));
+
+    BspFragment *fragments = (BspFragment *)tree->fragments;
+    for (usize i = 0; i < tree->numFragments; i++)
+    {
+        fragments[i].left = poolVertex(&pool, tree->vertices[fragments[i].left]);
+        fragments[i].right = poolVertex(&pool, tree->vertices[fragments[i].right]);
+    }
+    free(pool.table);
+    free((DVector2 *)tree->vertices);
+    tree->vertices = (DVector2 *)realloc(pool.vertices, max(pool.numVertices, 1) * sizeof(DVector2));
+    tree->numVertices = pool.numVertices;
+}
+
+usize
+BspFlatTreeBytes(const BspFlatTree *tree)
+{
+    usize coldBytes = sizeof(BspFragmentRange) + sizeof(u32) + sizeof(Color) + sizeof(u32) + (tree->cells ? sizeof(u8) : 0) + (tree->bounds ? sizeof(BspBox) : 0);
+    return sizeof(BspFlatTree) + tree->numNodes * (sizeof(BspFlatNode) + coldBytes) + tree->numFragments * sizeof(BspFragment) + tree->numVertices * sizeof(DVector2);
+}
+
+void
+FreeBspFlatTree(BspFlatTree *tree)
+{
+    /* only valid for trees from FlattenBspTree, baked trees live in static storage */
+    free((BspFlatNode *)tree->nodes);
+    free((BspFragmentRange *)tree->ranges);
+    free((u32 *)tree->parents);
+    free((Color *)tree->colors);
+    free(tree->payloads);
+    free((u8 *)tree->cells);
+    free((BspBox *)tree->bounds);
+    free((BspFragment *)tree->fragments);
+    free((DVector2 *)tree->vertices);
+    free(tree);
+}
+
+bool
+WriteBspFlatTree(const BspFlatTree *tree, FILE *out)
+{ /*
+   * on-disk format (native byte order and struct layout):
+   *   u32 magic, u32 version, u32 numNodes, u32 numFragments, u32 numVertices
+   *   BspFlatNode[numNodes]
+   *   BspFragmentRange[numNodes]
+   *   u32 parents[numNodes]
+   *   Color colors[numNodes]
+   *   u32 payloads[numNodes]
+   *   BspFragment[numFragments]
+   *   DVector2[numVertices]
+   */
+    usize n = tree->numNodes;
+    u32 header[5] = { BSP_FILE_MAGIC, BSP_FILE_VERSION, (u32)n, (u32)tree->numFragments, (u32)tree->numVertices };
+    if (fwrite(header, sizeof(u32), 5, out) != 5) return false;
+    if (fwrite(tree->nodes, sizeof(BspFlatNode), n, out) != n) return false;
+    if (fwrite(tree->ranges, sizeof(BspFragmentRange), n, out) != n) return false;
+    if (fwrite(tree->parents, sizeof(u32), n, out) != n) return false;
+    if (fwrite(tree->colors, sizeof(Color), n, out) != n) return false;
+    if (fwrite(tree->payloads, sizeof(u32), n, out) != n) return false;
+    if (fwrite(tree->fragments, sizeof(BspFragment), tree->numFragments, out) != tree->numFragments) return false;
+    if (fwrite(tree->vertices, sizeof(DVector2), tree->numVertices, out) != tree->numVertices) return false;
+    return true;
+}
+
+BspFlatTree *
+ReadBspFlatTree(FILE *in)
+{
+    u32 header[5];
+    if (fread(header, sizeof(u32), 5, in) != 5) return NULL;
+    if (header[0] != BSP_FILE_MAGIC || header[1] != BSP_FILE_VERSION) return NULL;
+
+    usize n = header[2];
+    BspFlatTree *tree = AllocBspFlatTree(n, header[3], header[4]);
+    tree->numVertices = header[4];
+    if (fread((BspFlatNode *)tree->nodes, sizeof(BspFlatNode), n, in) != n || fread((BspFragmentRange *)tree->ranges, sizeof(BspFragmentRange), n, in) != n
+        || fread((u32 *)tree->parents, sizeof(u32), n, in) != n || fread((Color *)tree->colors, sizeof(Color), n, in) != n
+        || fread(tree->payloads, sizeof(u32), n, in) != n || fread((BspFragment *)tree->fragments, sizeof(BspFragment), tree->numFragments, in) != tree->numFragments
+        || fread((DVector2 *)tree->vertices, sizeof(DVector2), tree->numVertices, in) != tree->numVertices)
+    {
+        FreeBspFlatTree(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+BspLine
+BspLineFromSegment(DSegment s)
+{ /*
+   * same sign convention as DSegmentSide, evaluating the line at a point
+   * gives the determinant of (right - left) and (pt - left)
+   */
+    return (BspLine){
+        .a = s.left.y - s.right.y,
+        .b = s.right.x - s.left.x,
+        .c = (s.left.x * s.right.y) - (s.right.x * s.left.y),
+    };
+}
+
+f64
+BspLineEval(BspLine line, DVector2 pt)
+{
+    return line.a * pt.x + line.b * pt.y + line.c;
+}
+
+DSide
+BspFlatNodeSide(const BspFlatTree *tree, u32 idx, DVector2 pt)
+{
+    f64 det = BspLineEval(tree->nodes[idx].line, pt);
+    if (babs(det) < BSP_EPSILON) return DSideInside;
+    else if (det >= 0.0) return DSideLeft;
+    else return DSideRight;
+}
+
+const BspFragment *
+BspFlatNodeFragments(const BspFlatTree *tree, u32 idx, usize *numFragments)
+{
+    *numFragments = tree->ranges[idx].count;
+    return &tree->fragments[tree->ranges[idx].first];
+}
+
+DSegment
+BspFlatFragmentSegment(const BspFlatTree *tree, BspFragment fragment)
+{
+    return (DSegment){ .left = tree->vertices[fragment.left], .right = tree->vertices[fragment.right], .id = fragment.source };
+}
+
+bool
+BspFlatIsLeaf(const BspFlatTree *tree, u32 idx)
+{
+    return tree->nodes[idx].left == BSP_NULL_IDX && tree->nodes[idx].right == BSP_NULL_IDX;
+}
+
+u32
+BspFlatLocatePoint(const BspFlatTree *tree, DVector2 pt, DSide *side)
+{ /*
+   * walks down to the node whose child on pt's side is missing (or whose
+   * splitter pt lies on) and returns it, side is pt's side of that node
+   */
+    if (tree->numNodes == 0) return BSP_NULL_IDX;
+    u32 idx = 0;
+    while (true)
+    {
+        /* both children are requested before the side test decides which one is needed */
+        const BspFlatNode *node = &tree->nodes[idx];
+        if (node->left != BSP_NULL_IDX) BSP_PREFETCH(&tree->nodes[node->left]);
+        if (node->right != BSP_NULL_IDX) BSP_PREFETCH(&tree->nodes[node->right]);
+        *side = BspFlatNodeSide(tree, idx, pt);
+        u32 next = BSP_NULL_IDX;
+        if (*side == DSideLeft) next = tree->nodes[idx].right;
+        else if (*side == DSideRight) next = tree->nodes[idx].left;
+        if (next == BSP_NULL_IDX) return idx;
+        idx = next;
+    }
+}
+
+void
+BspFlatLocatePoints(const BspFlatTree *tree, const DVector2 *points, usize numPoints, u32 *leaves, DSide *sides)
+{
+    LocateBatch batch = { tree, points, leaves, sides };
+    ParallelFor(numPoints, BSP_LOCATE_GRAIN, locateRange, &batch);
+}
+
+void
+locateRange(void *ctx, usize first, usize last)
+{ /*
+   * BspFlatLocatePoint on BSP_LOCATE_LANES points at once. the side tests
+   * of all lanes are one branch-free loop the compiler turns into vector
+   * code, and the lanes' node loads don't depend on each other, so their
+   * cache misses overlap instead of queueing up behind a single walk. a
+   * lane that reaches its leaf takes the next point right away rather than
+   * waiting for the deepest walk of the block
+   */
+    const LocateBatch *batch = (const LocateBatch *)ctx;
+    const BspFlatTree *tree = batch->tree;
+    if (tree->numNodes == 0)
+    {
+        for (usize i = first; i < last; i++)
+        {
+            batch->leaves[i] = BSP_NULL_IDX;
+            if (batch->sides) batch->sides[i] = DSideInside;
+        }
+        return;
+    }
+
+    f64 x[BSP_LOCATE_LANES], y[BSP_LOCATE_LANES], det[BSP_LOCATE_LANES];
+    u32 idx[BSP_LOCATE_LANES];
+    usize point[BSP_LOCATE_LANES]; /* point each lane is locating, last once it's idle */
+    usize next = first;
+    usize numBusy = 0;
+    for (usize lane = 0; lane < BSP_LOCATE_LANES; lane++)
+    {
+        /* idle lanes keep testing the root with a dummy point, so the loop never has to skip one */
+        point[lane] = (next < last) ? next++ : last;
+        numBusy += point[lane] < last;
+        DVector2 pt = batch->points[(point[lane] < last) ? point[lane] : first];
+        x[lane] = pt.x;
+        y[lane] = pt.y;
+        idx[lane] = 0;
+    }
+    while (numBusy > 0)
+    {
+        for (usize lane = 0; lane < BSP_LOCATE_LANES; lane++)
+        {
+            BspLine line = tree->nodes[idx[lane]].line;
+            det[lane] = line.a * x[lane] + line.b * y[lane] + line.c;
+        }
+        for (usize lane = 0; lane < BSP_LOCATE_LANES; lane++)
+        {
+            if (point[lane] == last) continue;
+            /* same classification as BspFlatNodeSide */
+            DSide side = (babs(det[lane]) < BSP_EPSILON) ? DSideInside : ((det[lane] >= 0.0) ? DSideLeft : DSideRight);
+            const BspFlatNode *node = &tree->nodes[idx[lane]];
+            u32 child = (side == DSideLeft) ? node->right : ((side == DSideRight) ? node->left : BSP_NULL_IDX);
+            if (child != BSP_NULL_IDX)
+            {
+                BSP_PREFETCH(&tree->nodes[child]);
+                idx[lane] = child;
+                continue;
+            }
+            batch->leaves[point[lane]] = idx[lane];
+            if (batch->sides) batch->sides[point[lane]] = side;
+            idx[lane] = 0;
+            if (next < last)
+            {
+                point[lane] = next++;
+                x[lane] = batch->points[point[lane]].x;
+                y[lane] = batch->points[point[lane]].y;
+            }
+            else
+            {
+                point[lane] = last;
+                numBusy--;
+            }
+        }
+    }
+}
+
+bool
+BspFlatRayCast(const BspFlatTree *tree, DVector2 origin, DVector2 dir, f64 maxDistance, BspRayHit *hit)
+{
+    hit->distance = INFINITY;
+    if (tree->numNodes == 0) return false;
+    rayCastNode(tree, 0, origin, dir, 0.0, maxDistance, hit);
+    return hit->distance < INFINITY;
+}
+
+bool
+rayCastNode(const BspFlatTree *tree, u32 idx, DVector2 origin, DVector2 dir, f64 tMin, f64 tMax, BspRayHit *hit)
+{ /*
+   * whether a hit within [tMin, tMax] was found below idx. the ray's value
+   * on the line is det + t * slope, so it crosses the line at
+   * t = -det / slope
+   */
+    if (idx == BSP_NULL_IDX || hit->distance < tMin) return false;
+    const BspFlatNode *node = &tree->nodes[idx];
+    f64 det = BspLineEval(node->line, origin);
+    f64 slope = node->line.a * dir.x + node->line.b * dir.y;
+
+    if (babs(det) < BSP_EPSILON)
+    {
+        /*
+         * starts on the line: a fragment under origin is hit at once, so is
+         * anything behind the line ending at origin. after that the ray
+         * stays on the side it heads to, unless it runs along the line (or
+         * close enough that rounding can't tell), when what touches the line
+         * from either side can be hit
+         */
+        if (babs(slope) < BSP_EPSILON)
+        {
+            bool found = rayCastNode(tree, node->right, origin, dir, tMin, tMax, hit);
+            return rayCastNode(tree, node->left, origin, dir, tMin, tMax, hit) || found;
+        }
+        u32 ahead = (slope > 0.0) ? node->right : node->left;
+        u32 behind = (slope > 0.0) ? node->left : node->right;
+        if (tMin <= BSP_EPSILON)
+        {
+            bool found = rayHitFragments(tree, idx, origin, dir, 0.0, BSP_EPSILON, hit);
+            found = rayCastNode(tree, behind, origin, dir, tMin, BSP_EPSILON, hit) || found;
+            if (found) return true;
+        }
+        return rayCastNode(tree, ahead, origin, dir, tMin, tMax, hit);
+    }
+
+    u32 near = (det > 0.0) ? node->right : node->left;
+    u32 far = (det > 0.0) ? node->left : node->right;
+    f64 tSplit = (slope != 0.0) ? -det / slope : -1.0;
+    if (tSplit < 0.0 || tSplit > tMax) return rayCastNode(tree, near, origin, dir, tMin, tMax, hit);
+    if (tSplit < tMin) return rayCastNode(tree, far, origin, dir, tMin, tMax, hit);
+    if (rayCastNode(tree, near, origin, dir, tMin, tSplit, hit)) return true;
+    if (rayHitFragments(tree, idx, origin, dir, tMin, tMax, hit)) return true;
+    return rayCastNode(tree, far, origin, dir, tSplit, tMax, hit);
+}
+
+bool
+rayHitFragments(const BspFlatTree *tree, u32 idx, DVector2 origin, DVector2 dir, f64 tMin, f64 tMax, BspRayHit *hit)
+{
+    /* a fragment hit just outside [tMin, tMax] is still taken, the crossing was computed from the line rather than the fragment */
+    usize numFragments = 0;
+    const BspFragment *fragments = BspFlatNodeFragments(tree, idx, &numFragments);
+    bool found = false;
+    for (usize i = 0; i < numFragments; i++)
+    {
+        f64 t;
+        if (!DSegmentRayHit(BspFlatFragmentSegment(tree, fragments[i]), origin, dir, &t)) continue;
+        if (t < tMin - BSP_EPSILON || t > tMax + BSP_EPSILON || t >= hit->distance) continue;
+        hit->distance = t;
+        hit->point = (DVector2){ origin.x + t * dir.x, origin.y + t * dir.y };
+        hit->node = idx;
+        hit->source = fragments[i].source;
+        found = true;
+    }
+    return found;
+}
+
+void
+BspFlatRayCastPackets(const BspFlatTree *tree, DVector2 origin, const DVector2 *dirs, usize numRays, usize packetSize, f64 maxDistance, BspRayHit *hits)
+{
+    packetSize = clamp(packetSize, 1, BSP_PACKET_MAX);
+    RayBatch batch = { tree, origin, dirs, numRays, packetSize, maxDistance, hits };
+    usize numPackets = (numRays + packetSize - 1) / packetSize;
+    ParallelFor(numPackets, max(BSP_RAY_GRAIN / packetSize, 1), rayPacketRange, &batch);
+}
+
+void
+rayPacketRange(void *ctx, usize first, usize last)
+{
+    const RayBatch *batch = (const RayBatch *)ctx;
+    RayPacket packet;
+    packet.width = (u32)batch->packetSize;
+    for (usize lane = 0; lane < BSP_PACKET_MAX; lane++)
+    {
+        packet.tMin[lane] = 0.0;
+        packet.tMax[lane] = batch->maxDistance;
+    }
+    for (usize p = first; p < last; p++)
+    {
+        /* lanes past the packet's rays repeat its last one and stay out of every mask */
+        usize firstRay = p * batch->packetSize;
+        usize numLanes = min(batch->packetSize, batch->numRays - firstRay);
+        for (usize lane = 0; lane < BSP_PACKET_MAX; lane++)
+        {
+            DVector2 dir = batch->dirs[firstRay + min(lane, numLanes - 1)];
+            packet.dx[lane] = dir.x;
+            packet.dy[lane] = dir.y;
+            packet.hits[lane].distance = INFINITY;
+        }
+        if (batch->tree->numNodes > 0)
+            rayCastPacketNode(batch->tree, 0, batch->origin, &packet, (1u << numLanes) - 1, packet.tMin, packet.tMax);
+        memcpy(&batch->hits[firstRay], packet.hits, numLanes * sizeof(BspRayHit));
+    }
+}
+
+u32
+rayCastPacketNode(const BspFlatTree *tree, u32 idx, DVector2 origin, RayPacket *packet, u32 mask, const f64 *tMin, const f64 *tMax)
+{ /*
+   * rayCastNode for the lanes in mask, returns the lanes that found a hit.
+   * the rays share their origin, so they're all on the same side of the
+   * node's line and agree on the near child, only where they cross the
+   * line differs. a lane can skip the near child (crossing before its
+   * interval starts), the far one (crossing after it ends or never) or
+   * neither. the lane loops run over the whole packet whatever the mask,
+   * so they compile to vector code
+   */
+    BspRayHit *hits = packet->hits;
+    u32 width = packet->width;
+    while (idx != BSP_NULL_IDX)
+    {
+        u32 alive = 0;
+        for (u32 lane = 0; lane < width; lane++)
+            alive |= (u32)(hits[lane].distance >= tMin[lane]) << lane;
+        mask &= alive;
+        if (mask == 0) return 0;
+
+        const BspFlatNode *node = &tree->nodes[idx];
+        f64 det = BspLineEval(node->line, origin);
+        if (babs(det) < BSP_EPSILON || (mask & (mask - 1)) == 0)
+        {
+            /* the lanes go their own ways from a splitter through the origin, and one lane is a single ray anyway */
+            u32 found = 0;
+            for (u32 lane = 0; lane < width; lane++)
+            {
+                DVector2 dir = { packet->dx[lane], packet->dy[lane] };
+                if ((mask & (1u << lane)) && rayCastNode(tree, idx, origin, dir, tMin[lane], tMax[lane], &hits[lane])) found |= 1u << lane;
+            }
+            return found;
+        }
+
+        /* a crossing at -det / slope in [tMin, tMax] without dividing, the sign flipped so the ray heads for the line when s > 0 */
+        f64 d = babs(det);
+        f64 a = (det > 0.0) ? -node->line.a : node->line.a;
+        f64 b = (det > 0.0) ? -node->line.b : node->line.b;
+        u32 nearMask = 0, farMask = 0, bothMask = 0;
+        for (u32 lane = 0; lane < width; lane++)
+        {
+            f64 s = a * packet->dx[lane] + b * packet->dy[lane];
+            bool beforeEnd = s > 0.0 && d <= s * tMax[lane];
+            bool afterStart = d >= s * tMin[lane];
+            nearMask |= (u32)!beforeEnd << lane;
+            farMask |= (u32)(beforeEnd & !afterStart) << lane;
+            bothMask |= (u32)(beforeEnd & afterStart) << lane;
+        }
+        nearMask &= mask;
+        farMask &= mask;
+        bothMask &= mask;
+        u32 near = (det > 0.0) ? node->right : node->left;
+        u32 far = (det > 0.0) ? node->left : node->right;
+
+        /* deep in the tree the whole packet mostly stays on one side, that's a step down rather than a call */
+        if ((bothMask | farMask) == 0)
+        {
+            idx = near;
+            continue;
+        }
+        if ((bothMask | nearMask) == 0)
+        {
+            idx = far;
+            continue;
+        }
+
+        f64 nearMax[BSP_PACKET_MAX], farMin[BSP_PACKET_MAX];
+        for (u32 lane = 0; lane < width; lane++)
+        {
+            f64 tSplit = d / (a * packet->dx[lane] + b * packet->dy[lane]);
+            bool both = bothMask & (1u << lane);
+            nearMax[lane] = both ? tSplit : tMax[lane];
+            farMin[lane] = both ? tSplit : tMin[lane];
+        }
+        u32 found = rayCastPacketNode(tree, near, origin, packet, nearMask | bothMask, tMin, nearMax);
+        for (u32 lane = 0; lane < width; lane++)
+        {
+            DVector2 dir = { packet->dx[lane], packet->dy[lane] };
+            if ((bothMask & ~found & (1u << lane)) && rayHitFragments(tree, idx, origin, dir, tMin[lane], tMax[lane], &hits[lane])) found |= 1u << lane;
+        }
+        return found | rayCastPacketNode(tree, far, origin, packet, (farMask | bothMask) & ~found, farMin, tMax);
+    }
+    return 0;
+}
+
+bool
+BspFlatLineOfSight(const BspFlatTree *tree, DVector2 a, DVector2 b)
+{
+    DVector2 dir = DVector2Subtract(b, a);
+    if (tree->numNodes == 0 || DVector2DotProduct(dir, dir) <= 4.0 * BSP_EPSILON * BSP_EPSILON) return true;
+    return !sightBlocked(tree, 0, a, b, 0.0, 1.0);
+}
+
+bool
+sightBlocked(const BspFlatTree *tree, u32 idx, DVector2 a, DVector2 b, f64 tMin, f64 tMax)
+{ /*
+   * rayCastNode's walk along a + t * (b - a) for t in [tMin, tMax], front
+   * to back as well since a blocking fragment is likeliest close to a, but
+   * with no hit to keep: the first crossing ends it
+   */
+    if (idx == BSP_NULL_IDX) return false;
+    const BspFlatNode *node = &tree->nodes[idx];
+    f64 det = BspLineEval(node->line, a);
+    f64 slope = node->line.a * (b.x - a.x) + node->line.b * (b.y - a.y);
+    if (babs(det) < BSP_EPSILON)
+    {
+        /* starting on the line, rounding can't be trusted to tell which side the rest of the segment is on */
+        return sightBlockedByFragments(tree, idx, a, b) || sightBlocked(tree, node->right, a, b, tMin, tMax) || sightBlocked(tree, node->left, a, b, tMin, tMax);
+    }
+
+    u32 near = (det > 0.0) ? node->right : node->left;
+    u32 far = (det > 0.0) ? node->left : node->right;
+    f64 tSplit = (slope != 0.0) ? -det / slope : -1.0;
+    if (tSplit < 0.0 || tSplit > tMax) return sightBlocked(tree, near, a, b, tMin, tMax);
+    if (tSplit < tMin) return sightBlocked(tree, far, a, b, tMin, tMax);
+    return sightBlocked(tree, near, a, b, tMin, tSplit) || sightBlockedByFragments(tree, idx, a, b) || sightBlocked(tree, far, a, b, tSplit, tMax);
+}
+
+bool
+sightBlockedByFragments(const BspFlatTree *tree, u32 idx, DVector2 a, DVector2 b)
+{ /*
+   * a fragment blocks if a and b are strictly on either side of its line,
+   * both more than BSP_EPSILON away, and its ends aren't strictly on the
+   * same side of the segment's line. signs only, nothing to divide
+   */
+    usize numFragments = 0;
+    const BspFragment *fragments = BspFlatNodeFragments(tree, idx, &numFragments);
+    for (usize i = 0; i < numFragments; i++)
+    {
+        DSegment s = BspFlatFragmentSegment(tree, fragments[i]);
+        DVector2 e = DVector2Subtract(s.right, s.left);
+        f64 da = DVector2Determinant(e, DVector2Subtract(a, s.left));
+        f64 db = DVector2Determinant(e, DVector2Subtract(b, s.left));
+        f64 tolerance = BSP_EPSILON * BSP_EPSILON * DVector2DotProduct(e, e);
+        if ((da > 0.0) == (db > 0.0) || da * da <= tolerance || db * db <= tolerance) continue;
+        DVector2 ab = DVector2Subtract(b, a);
+        f64 dl = DVector2Determinant(ab, DVector2Subtract(s.left, a));
+        f64 dr = DVector2Determinant(ab, DVector2Subtract(s.right, a));
+        if ((dl > 0.0 && dr > 0.0) || (dl < 0.0 && dr < 0.0)) continue;
+        return true;
+    }
+    return false;
+}
+
+void
+BspFlatLinesOfSight(const BspFlatTree *tree, const DVector2 *from, const DVector2 *to, usize numPairs, bool *visible)
+{
+    SightBatch batch = { tree, from, to, visible };
+    ParallelFor(numPairs, BSP_SIGHT_GRAIN, sightRange, &batch);
+}
+
+void
+sightRange(void *ctx, usize first, usize last)
+{
+    const SightBatch *batch = (const SightBatch *)ctx;
+    for (usize i = first; i < last; i++)
+        batch->visible[i] = BspFlatLineOfSight(batch->tree, batch->from[i], batch->to[i]);
+}
+
+bool
+BspFlatNearestFragment(const BspFlatTree *tree, DVector2 pt, f64 maxDistance, BspRayHit *hit)
+{
+    /* a fragment right at maxDistance counts, the bound is only met by something strictly closer */
+    hit->distance = maxDistance;
+    hit->node = BSP_NULL_IDX;
+    if (tree->numNodes > 0) nearestNode(tree, 0, pt, hit);
+    if (hit->node != BSP_NULL_IDX) return true;
+    hit->distance = INFINITY;
+    return false;
+}
+
+void
+nearestNode(const BspFlatTree *tree, u32 idx, DVector2 pt, BspRayHit *best)
+{ /*
+   * everything below the far child is on the far side of the node's line
+   * (up to BSP_SIDE_SLACK past it), and its fragments on the line,
+   * so neither is closer than the line. lines aren't normalized, the
+   * distance to one is |det| / |(a, b)|, compared squared
+   */
+    while (idx != BSP_NULL_IDX)
+    {
+        const BspFlatNode *node = &tree->nodes[idx];
+        f64 det = BspLineEval(node->line, pt);
+        u32 near = (det > 0.0) ? node->right : node->left;
+        u32 far = (det > 0.0) ? node->left : node->right;
+        nearestNode(tree, near, pt, best);
+
+        f64 norm2 = node->line.a * node->line.a + node->line.b * node->line.b;
+        f64 reach = best->distance + BSP_SIDE_SLACK;
+        if (norm2 > 0.0 && det * det > reach * reach * norm2) return;
+        usize numFragments = 0;
+        const BspFragment *fragments = BspFlatNodeFragments(tree, idx, &numFragments);
+        for (usize i = 0; i < numFragments; i++)
+        {
+            DVector2 closest = DSegmentClosestPoint(BspFlatFragmentSegment(tree, fragments[i]), pt);
+            f64 distance = DVector2Length(DVector2Subtract(closest, pt));
+            if (distance > best->distance || (distance == best->distance && best->node != BSP_NULL_IDX)) continue;
+            *best = (BspRayHit){ distance, closest, idx, fragments[i].source };
+        }
+        idx = far;
+    }
+}
+
+void
+BoundBspFlatTree(BspFlatTree *tree)
+{
+    BspBox *bounds = (BspBox *)malloc(max(tree->numNodes, 1) * sizeof(BspBox));
+    if (tree->numNodes > 0) boundNode(tree, 0, bounds);
+    free((BspBox *)tree->bounds);
+    tree->bounds = bounds;
+}
+
+BspBox
+boundNode(const BspFlatTree *tree, u32 idx, BspBox *bounds)
+{
+    /* a subtree without fragments (merged trees) gets a box that is empty rather than infinite, so baked trees can print it */
+    BspBox box = { { DBL_MAX, DBL_MAX }, { -DBL_MAX, -DBL_MAX } };
+    usize numFragments = 0;
+    const BspFragment *fragments = BspFlatNodeFragments(tree, idx, &numFragments);
+    for (usize i = 0; i < numFragments; i++)
+    {
+        DVector2 ends[2] = { tree->vertices[fragments[i].left], tree->vertices[fragments[i].right] };
+        for (usize e = 0; e < 2; e++)
+        {
+            box.min = (DVector2){ min(box.min.x, ends[e].x), min(box.min.y, ends[e].y) };
+            box.max = (DVector2){ max(box.max.x, ends[e].x), max(box.max.y, ends[e].y) };
+        }
+    }
+    u32 children[2] = { tree->nodes[idx].left, tree->nodes[idx].right };
+    for (usize c = 0; c < 2; c++)
+    {
+        if (children[c] == BSP_NULL_IDX) continue;
+        BspBox child = boundNode(tree, children[c], bounds);
+        box.min = (DVector2){ min(box.min.x, child.min.x), min(box.min.y, child.min.y) };
+        box.max = (DVector2){ max(box.max.x, child.max.x), max(box.max.y, child.max.y) };
+    }
+    bounds[idx] = box;
+    return box;
+}
+
+usize
+BspFlatQueryBox(const BspFlatTree *tree, BspBox box, u32 *fragments, usize capacity)
+{
+    RangeQuery query = { box, { 0.0, 0.0 }, -1.0, fragments, capacity, 0 };
+    if (tree->numNodes > 0) rangeNode(tree, 0, &query);
+    return query.found;
+}
+
+usize
+BspFlatQueryCircle(const BspFlatTree *tree, DVector2 center, f64 radius, u32 *fragments, usize capacity)
+{
+    BspBox box = { { center.x - radius, center.y - radius }, { center.x + radius, center.y + radius } };
+    RangeQuery query = { box, center, radius, fragments, capacity, 0 };
+    if (tree->numNodes > 0 && radius >= 0.0) rangeNode(tree, 0, &query);
+    return query.found;
+}
+
+void
+rangeNode(const BspFlatTree *tree, u32 idx, RangeQuery *query)
+{ /*
+   * a subtree's fragments lie on its side of the node's line, give or take
+   * BSP_SIDE_SLACK, so the walk only takes one side when the whole query is
+   * farther than that past the line
+   */
+    while (idx != BSP_NULL_IDX)
+    {
+        if (tree->bounds && !rangeMeetsBox(query, tree->bounds[idx])) return;
+        const BspFlatNode *node = &tree->nodes[idx];
+        f64 norm = sqrt(node->line.a * node->line.a + node->line.b * node->line.b);
+        f64 lo, hi;
+        if (query->radius < 0.0)
+        {
+            /* the line's extremes over the box are at the corners its normal points to and away from */
+            f64 ax = (node->line.a > 0.0) ? query->box.max.x : query->box.min.x;
+            f64 ay = (node->line.b > 0.0) ? query->box.max.y : query->box.min.y;
+            f64 bx = (node->line.a > 0.0) ? query->box.min.x : query->box.max.x;
+            f64 by = (node->line.b > 0.0) ? query->box.min.y : query->box.max.y;
+            hi = node->line.a * ax + node->line.b * ay + node->line.c;
+            lo = node->line.a * bx + node->line.b * by + node->line.c;
+        }
+        else
+        {
+            f64 det = BspLineEval(node->line, query->center);
+            hi = det + query->radius * norm;
+            lo = det - query->radius * norm;
+        }
+        if (lo > BSP_SIDE_SLACK * norm)
+        {
+            idx = node->right;
+            continue;
+        }
+        if (hi < -BSP_SIDE_SLACK * norm)
+        {
+            idx = node->left;
+            continue;
+        }
+
+        usize numFragments = 0;
+        const BspFragment *fragments = BspFlatNodeFragments(tree, idx, &numFragments);
+        for (usize i = 0; i < numFragments; i++)
+        {
+            DSegment s = BspFlatFragmentSegment(tree, fragments[i]);
+            bool touches = (query->radius < 0.0) ? DSegmentIntersectsBox(s, query->box.min, query->box.max)
+                                                 : DVector2Length(DVector2Subtract(DSegmentClosestPoint(s, query->center), query->center)) <= query->radius;
+            if (!touches) continue;
+            if (query->found < query->capacity) query->fragments[query->found] = (u32)(tree->ranges[idx].first + i);
+            query->found++;
+        }
+        rangeNode(tree, node->left, query);
+        idx = node->right;
+    }
+}
+
+bool
+rangeMeetsBox(const RangeQuery *query, BspBox box)
+{
+    if (box.max.x < query->box.min.x || box.min.x > query->box.max.x || box.max.y < query->box.min.y || box.min.y > query->box.max.y) return false;
+    if (query->radius < 0.0) return true;
+    /* the disc against the box, from the box point closest to the center */
+    DVector2 closest = { clamp(query->center.x, box.min.x, box.max.x), clamp(query->center.y, box.min.y, box.max.y) };
+    return DVector2Length(DVector2Subtract(closest, query->center)) <= query->radius;
+}
+
+bool
+LabelBspFlatTree(BspFlatTree *tree)
+{ /*
+   * a fragment running along its node's line (b, -a) has the inside on the
+   * line's left, the in front side. collinear fragments of one node can
+   * face opposite ways (an edge of a hole on the line of an outer edge),
+   * which only makes the label ambiguous if a child is missing: a valid
+   * polygon can't have both orientations bounding the same empty cell
+   */
+    u8 *cells = (u8 *)malloc(max(tree->numNodes, 1) * sizeof(u8));
+    bool consistent = true;
+    for (usize i = 0; i < tree->numNodes; i++)
+    {
+        BspLine line = tree->nodes[i].line;
+        usize numFragments = 0, numAlong = 0;
+        const BspFragment *fragments = BspFlatNodeFragments(tree, i, &numFragments);
+        if (numFragments == 0)
+        {
+            /* splitter that bounds nothing (merged trees), only an existing label can say anything about it */
+            cells[i] = tree->cells ? tree->cells[i] : 0;
+            consistent &= (tree->cells != NULL);
+            continue;
+        }
+        for (usize j = 0; j < numFragments; j++)
+        {
+            DSegment s = BspFlatFragmentSegment(tree, fragments[j]);
+            numAlong += ((s.right.x - s.left.x) * line.b - (s.right.y - s.left.y) * line.a > 0.0);
+        }
+
+        /* the splitter (first fragment) decides, the flags are only read where a child is missing */
+        DSegment splitter = BspFlatFragmentSegment(tree, fragments[0]);
+        bool inFront = (splitter.right.x - splitter.left.x) * line.b - (splitter.right.y - splitter.left.y) * line.a > 0.0;
+        cells[i] = inFront ? BSP_CELL_RIGHT_SOLID : BSP_CELL_LEFT_SOLID;
+        if (numAlong > 0 && numAlong < numFragments && (tree->nodes[i].left == BSP_NULL_IDX || tree->nodes[i].right == BSP_NULL_IDX))
+        {
+            TraceLog(LOG_WARNING, "BSP: node %u has fragments facing both ways next to an empty cell, polygon isn't simple", (u32)i);
+            consistent = false;
+        }
+    }
+    free((u8 *)tree->cells);
+    tree->cells = cells;
+    return consistent;
+}
+
+bool
+BspFlatContainsPoint(const BspFlatTree *tree, DVector2 pt)
+{ /*
+   * same descent as BspFlatLocatePoint. points on the boundary count as
+   * inside, a point on a node's line but off its fragments is inside
+   * exactly when the points next to it are, so it carries on behind
+   */
+    assert(tree->cells);
+    if (tree->numNodes == 0) return false;
+    u32 idx = 0;
+    while (true)
+    {
+        const BspFlatNode *node = &tree->nodes[idx];
+        if (node->left != BSP_NULL_IDX) BSP_PREFETCH(&tree->nodes[node->left]);
+        if (node->right != BSP_NULL_IDX) BSP_PREFETCH(&tree->nodes[node->right]);
+        DSide side = BspFlatNodeSide(tree, idx, pt);
+        if (side == DSideInside && onNodeFragment(tree, idx, pt)) return true;
+        u32 next = (side == DSideLeft) ? node->right : node->left;
+        if (next == BSP_NULL_IDX) return tree->cells[idx] & ((side == DSideLeft) ? BSP_CELL_RIGHT_SOLID : BSP_CELL_LEFT_SOLID);
+        idx = next;
+    }
+}
+
+void
+BspFlatClassifyPoints(const BspFlatTree *tree, const DVector2 *points, usize numPoints, bool *inside)
+{
+    for (usize i = 0; i < numPoints; i++)
+        inside[i] = BspFlatContainsPoint(tree, points[i]);
+}
+
+usize
+countFlatNodes(BspNode *node, usize *numFragments)
+{
+    if (!node || node->numSegments == 0) return 0;
+    *numFragments += node->numSegments;
+    return 1 + countFlatNodes(node->left, numFragments) + countFlatNodes(node->right, numFragments);
+}
+
+u32
+flattenNode(BspNode *node, u32 parent, FlatBuilder *builder)
+{
+    if (!node || node->numSegments == 0) return BSP_NULL_IDX;
+
+    u32 idx = builder->numNodes++;
+    builder->nodes[idx].line = BspLineFromSegment(node->segments[0]);
+    builder->ranges[idx] = (BspFragmentRange){ builder->numFragments, node->numSegments };
+    builder->parents[idx] = parent;
+    builder->colors[idx] = node->color;
+    for (usize i = 0; i < node->numSegments; i++)
+    {
+        u32 k = builder->numFragments++;
+        builder->vertices[2 * k] = node->segments[i].left;
+        builder->vertices[2 * k + 1] = node->segments[i].right;
+        builder->fragments[k] = (BspFragment){ 2 * k, 2 * k + 1, node->segments[i].id };
+    }
+
+    /* children are filled after the parent so the array stays in pre-order */
+    u32 left = flattenNode(node->left, idx, builder);
+    u32 right = flattenNode(node->right, idx, builder);
+    builder->nodes[idx].left = left;
+    builder->nodes[idx].right = right;
+    return idx;
+}
+
+u32 *
+subtreeSizes(const BspFlatTree *tree)
+{
+    /* children come after their parent in breadth first order, so walking it backwards sees them first */
+    u32 *queue = (u32 *)malloc(tree->numNodes * sizeof(u32));
+    usize size = 0;
+    queue[size++] = 0;
+    for (usize head = 0; head < size; head++)
+    {
+        const BspFlatNode *node = &tree->nodes[queue[head]];
+        if (node->left != BSP_NULL_IDX) queue[size++] = node->left;
+        if (node->right != BSP_NULL_IDX) queue[size++] = node->right;
+    }
+    u32 *sizes = (u32 *)malloc(tree->numNodes * sizeof(u32));
+    for (usize k = size; k-- > 0;)
+    {
+        const BspFlatNode *node = &tree->nodes[queue[k]];
+        u32 left = (node->left == BSP_NULL_IDX) ? 0 : sizes[node->left];
+        u32 right = (node->right == BSP_NULL_IDX) ? 0 : sizes[node->right];
+        sizes[queue[k]] = 1 + left + right;
+    }
+    free(queue);
+    return sizes;
+}
+
+usize
+layoutVanEmdeBoas(const BspFlatTree *tree, const u32 *sizes, u32 idx, u32 levels, u32 *order, usize numOrdered)
+{ /*
+   * appends the nodes of the first levels levels below idx (its whole
+   * subtree if levels is 0) in van Emde Boas order: the top half of the
+   * levels first, then each subtree hanging off the bottom of the top half,
+   * left to right. BSP trees are far from balanced, so a whole subtree is
+   * split at half the height a balanced tree of its size would have rather
+   * than half its real height, which keeps every block close to sqrt(size)
+   * nodes even below a long chain
+   */
+    u32 height = levels;
+    if (levels == 0)
+        for (height = 0; ((u64)1 << height) <= sizes[idx]; height++) {}
+    if (height <= 1)
+    {
+        order[numOrdered] = idx;
+        return numOrdered + 1;
+    }
+    u32 top = height / 2;
+    numOrdered = layoutVanEmdeBoas(tree, sizes, idx, top, order, numOrdered);
+
+    /* roots of the bottom subtrees, counted first (level == NULL) */
+    usize numLevel = gatherLevel(tree, idx, top, NULL, 0);
+    u32 *level = (u32 *)malloc(max(numLevel, 1) * sizeof(u32));
+    gatherLevel(tree, idx, top, level, 0);
+    for (usize i = 0; i < numLevel; i++)
+        numOrdered = layoutVanEmdeBoas(tree, sizes, level[i], (levels == 0) ? 0 : levels - top, order, numOrdered);
+    free(level);
+    return numOrdered;
+}
+
+usize
+gatherLevel(const BspFlatTree *tree, u32 idx, u32 depth, u32 *level, usize numLevel)
+{
+    /* collects the nodes exactly depth levels below idx, left to right (only counts them if level is NULL) */
+    if (idx == BSP_NULL_IDX) return numLevel;
+    if (depth == 0)
+    {
+        if (level) level[numLevel] = idx;
+        return numLevel + 1;
+    }
+    numLevel = gatherLevel(tree, tree->nodes[idx].left, depth - 1, level, numLevel);
+    return gatherLevel(tree, tree->nodes[idx].right, depth - 1, level, numLevel);
+}
+
+u32
+poolVertex(VertexPool *pool, DVector2 v)
+{
+    /*
+     * vertices are merged only when bit-identical, which is exactly the case
+     * for shared polygon corners and for the split point both halves get
+     */
+    usize mask = pool->tableSize - 1;
+    for (usize slot = hashVertex(v) & mask;; slot = (slot + 1) & mask)
+    {
+        u32 idx = pool->table[slot];
+        if (idx == BSP_NULL_IDX)
+        {
+            pool->table[slot] = pool->numVertices;
+            pool->vertices[pool->numVertices] = v;
+            return pool->numVertices++;
+        }
+        if (pool->vertices[idx].x == v.x && pool->vertices[idx].y == v.y) return idx;
+    }
+}
+
+u64
+hashVertex(DVector2 v)
+{
+    /* + 0.0 maps -0.0 onto 0.0 so both hash the same, they compare equal */
+    f64 xy[2] = { v.x + 0.0, v.y + 0.0 };
+    u64 bits[2];
+    memcpy(bits, xy, sizeof(bits));
+    u64 h = bits[0] * 0x9e3779b97f4a7c15ull ^ (bits[1] + 0x632be59bd9b4e019ull);
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ull;
+    return h ^ (h >> 32);
+}
+
+bool
+onNodeFragment(const BspFlatTree *tree, u32 idx, DVector2 pt)
+{
+    usize numFragments = 0;
+    const BspFragment *fragments = BspFlatNodeFragments(tree, idx, &numFragments);
+    for (usize i = 0; i < numFragments; i++)
+        if (DSegmentContainsPoint(BspFlatFragmentSegment(tree, fragments[i]), pt)) return true;
+    return false;
+}
@@ -0,0 +1,122 @@
+#include "bsp_grid.h"
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "parallel.h"
+#include "raylib.h"
+#include <math.h>
+#include <stdlib.h>
+
+/* ******************** helpers ******************** */
+void buildGridRows(void *ctx, usize first, usize last);
+u32 gridCell(const BspFlatTree *tree, DVector2 lo, DVector2 hi);
+/* ************************************************* */
+
+BspGrid *
+BuildBspGrid(const BspFlatTree *tree, u32 resolution)
+{
+    if (tree->numNodes > BSP_GRID_NODE)
+    {
+        TraceLog(LOG_ERROR, "GRID: %u nodes don't fit in a grid cell", (u32)tree->numNodes);
+        return NULL;
+    }
+    BspGrid *grid = (BspGrid *)malloc(sizeof(BspGrid));
+    grid->tree = tree;
+    grid->numLeafCells = 0;
+
+    DVector2 lo = { 0.0, 0.0 }, hi = { 0.0, 0.0 };
+    for (usize i = 0; i < tree->numVertices; i++)
+    {
+        DVector2 v = tree->vertices[i];
+        lo = (i == 0) ? v : (DVector2){ min(lo.x, v.x), min(lo.y, v.y) };
+        hi = (i == 0) ? v : (DVector2){ max(hi.x, v.x), max(hi.y, v.y) };
+    }
+    resolution = max(resolution, 1);
+    f64 extent = max(hi.x - lo.x, hi.y - lo.y);
+    grid->origin = lo;
+    grid->cellSize = (extent > 0.0) ? extent / resolution : 1.0;
+    grid->width = (tree->numNodes > 0) ? clamp((u32)ceil((hi.x - lo.x) / grid->cellSize), 1, resolution) : 0;
+    grid->height = (tree->numNodes > 0) ? clamp((u32)ceil((hi.y - lo.y) / grid->cellSize), 1, resolution) : 0;
+    grid->cells = (u32 *)malloc(max((usize)grid->width * grid->height, 1) * sizeof(u32));
+
+    ParallelFor(grid->height, BSP_GRID_ROW_GRAIN, buildGridRows, grid);
+    for (usize i = 0; i < (usize)grid->width * grid->height; i++)
+        grid->numLeafCells += (grid->cells[i] & BSP_GRID_LEAF) != 0;
+    return grid;
+}
+
+void
+buildGridRows(void *ctx, usize first, usize last)
+{
+    BspGrid *grid = (BspGrid *)ctx;
+    for (usize y = first; y < last; y++)
+    {
+        for (usize x = 0; x < grid->width; x++)
+        {
+            DVector2 lo = { grid->origin.x + x * grid->cellSize, grid->origin.y + y * grid->cellSize };
+            DVector2 hi = { lo.x + grid->cellSize, lo.y + grid->cellSize };
+            grid->cells[y * grid->width + x] = gridCell(grid->tree, lo, hi);
+        }
+    }
+}
+
+u32
+gridCell(const BspFlatTree *tree, DVector2 lo, DVector2 hi)
+{ /*
+   * BspFlatLocatePoint for the whole box at once, as long as the box is
+   * on one side of each line. the extremes of a line over the box are at
+   * the corners its normal points to and away from. the margin keeps
+   * points that round differently from the corners (and DSideInside) out
+   * of cells taken as one side
+   */
+    u32 idx = 0;
+    while (true)
+    {
+        BspLine line = tree->nodes[idx].line;
+        f64 most = line.a * ((line.a > 0.0) ? hi.x : lo.x) + line.b * ((line.b > 0.0) ? hi.y : lo.y) + line.c;
+        f64 least = line.a * ((line.a > 0.0) ? lo.x : hi.x) + line.b * ((line.b > 0.0) ? lo.y : hi.y) + line.c;
+        bool front = least > 2.0 * BSP_EPSILON;
+        if (!front && most >= -2.0 * BSP_EPSILON) return idx;
+        u32 next = front ? tree->nodes[idx].right : tree->nodes[idx].left;
+        if (next == BSP_NULL_IDX) return BSP_GRID_LEAF | (front ? BSP_GRID_FRONT : 0) | idx;
+        idx = next;
+    }
+}
+
+void
+FreeBspGrid(BspGrid *grid)
+{
+    free(grid->cells);
+    free(grid);
+}
+
+usize
+BspGridBytes(const BspGrid *grid)
+{
+    return sizeof(BspGrid) + (usize)grid->width * grid->height * sizeof(u32);
+}
+
+u32
+BspGridLocatePoint(const BspGrid *grid, DVector2 pt, DSide *side)
+{
+    f64 fx = floor((pt.x - grid->origin.x) / grid->cellSize);
+    f64 fy = floor((pt.y - grid->origin.y) / grid->cellSize);
+    if (fx < 0.0 || fy < 0.0 || fx >= grid->width || fy >= grid->height) return BspFlatLocatePoint(grid->tree, pt, side);
+
+    u32 cell = grid->cells[(usize)fy * grid->width + (usize)fx];
+    if (cell & BSP_GRID_LEAF)
+    {
+        *side = (cell & BSP_GRID_FRONT) ? DSideLeft : DSideRight;
+        return cell & BSP_GRID_NODE;
+    }
+    /* the rest of BspFlatLocatePoint's walk */
+    u32 idx = cell;
+    while (true)
+    {
+        *side = BspFlatNodeSide(grid->tree, idx, pt);
+        u32 next = BSP_NULL_IDX;
+        if (*side == DSideLeft) next = grid->tree->nodes[idx].right;
+        else if (*side == DSideRight) next = grid->tree->nodes[idx].left;
+        if (next == BSP_NULL_IDX) return idx;
+        idx = next;
+    }
+}
@@ -0,0 +1,487 @@
+#include "bsp_merge.h"
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "f64_segment.h"
+#include "f64_vector.h"
+#include "raylib.h"
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+#define MERGE_BOX_MARGIN 1.0
+
+/* explicit tree of a merge, leaves are real nodes so they can carry a label */
+typedef struct MergeNode {
+    BspLine line;            /* splitter, unused in leaves */
+    struct MergeNode *left;  /* behind the line, NULL in leaves */
+    struct MergeNode *right; /* in front of the line, NULL in leaves */
+    bool solid;              /* label of a leaf */
+    u32 firstPiece;          /* boundary pieces on the line (final tree only) */
+    u32 numPieces;
+} MergeNode;
+
+/* subtrees are shared between partitions and results, so nodes are only freed once the merge is done */
+typedef struct MergeArena {
+    MergeNode **nodes;
+    usize numNodes;
+    usize capacity;
+    DSegment *pieces; /* boundary pieces of the final tree, grouped by node */
+    usize numPieces;
+    usize pieceCapacity;
+} MergeArena;
+
+/* part [t0, t1] of a chord and the label of the cell next to it */
+typedef struct ChordSpan {
+    f64 t0;
+    f64 t1;
+    bool solid;
+} ChordSpan;
+
+typedef struct SpanList {
+    ChordSpan *spans;
+    usize numSpans;
+    usize capacity;
+} SpanList;
+
+/* ************************** helpers ************************** */
+MergeNode *newMergeNode(MergeArena *arena, BspLine line, MergeNode *left, MergeNode *right, bool solid);
+MergeNode *importFlatNode(MergeArena *arena, const BspFlatTree *tree, u32 idx, bool invert);
+MergeNode *joinMergeNodes(MergeArena *arena, BspLine line, MergeNode *left, MergeNode *right);
+MergeNode *mergeNodes(MergeArena *arena, MergeNode *a, MergeNode *b, BspSetOp op, const DVector2 *cell, usize n);
+MergeNode *mergeLeaf(MergeNode *a, MergeNode *b, BspSetOp op);
+void partitionNode(MergeArena *arena, MergeNode *t, BspLine line, const DVector2 *cell, usize n, MergeNode **behind, MergeNode **inFront);
+void partitionPart(MergeArena *arena, MergeNode *t, BspLine line, const DVector2 *cell, usize n, MergeNode **behind, MergeNode **inFront);
+MergeNode *finishNode(MergeArena *arena, MergeNode *node, const DVector2 *cell, usize n);
+void extractBoundary(MergeArena *arena, MergeNode *node, const DVector2 *cell, usize n);
+void pushSpans(SpanList *list, const MergeNode *node, BspLine chord, f64 t0, f64 t1, DVector2 normal);
+void addPiece(MergeArena *arena, BspLine chord, f64 t0, f64 t1, bool inFront, bool extend);
+usize countMergeNodes(const MergeNode *node);
+u32 flattenMergeNode(const MergeNode *node, u32 parent, const MergeArena *arena, BspFlatTree *tree, u8 *cells, u32 *numNodes, u32 *numFragments);
+DSide cellSide(const DVector2 *cell, usize n, BspLine line);
+usize clipCell(const DVector2 *cell, usize n, BspLine line, DSide keep, DVector2 *out);
+DVector2 cellLerp(DVector2 p, DVector2 q, f64 t);
+f64 lineDistance(BspLine line, DVector2 pt);
+DVector2 linePoint(BspLine line, f64 t);
+f64 lineParam(BspLine line, DVector2 pt);
+/* ************************************************************* */
+
+BspFlatTree *
+MergeBspFlatTrees(const BspFlatTree *a, const BspFlatTree *b, BspSetOp op, DSegment **boundary, usize *numBoundary)
+{
+    if (!a->cells || !b->cells)
+    {
+        TraceLog(LOG_ERROR, "MERGE: both trees have to be labeled with LabelBspFlatTree first");
+        return NULL;
+    }
+    MergeArena arena = { NULL, 0, 0, NULL, 0, 0 };
+
+    /* a - b is a and the complement of b, complementing a solid-leaf tree only flips its labels */
+    MergeNode *rootA = (a->numNodes > 0) ? importFlatNode(&arena, a, 0, false) : newMergeNode(&arena, (BspLine){ 0 }, NULL, NULL, false);
+    MergeNode *rootB = (b->numNodes > 0) ? importFlatNode(&arena, b, 0, op == BspSetDifference) : newMergeNode(&arena, (BspLine){ 0 }, NULL, NULL, op == BspSetDifference);
+
+    /*
+     * cells are clipped to a box around both trees instead of being
+     * unbounded. nothing outside of it is solid in either tree, the box's
+     * own edges wrap the result so it stays empty out there too
+     */
+    DVector2 lo = { 0.0, 0.0 }, hi = { 0.0, 0.0 };
+    for (usize i = 0; i < a->numVertices + b->numVertices; i++)
+    {
+        DVector2 v = (i < a->numVertices) ? a->vertices[i] : b->vertices[i - a->numVertices];
+        lo = (i == 0) ? v : (DVector2){ min(lo.x, v.x), min(lo.y, v.y) };
+        hi = (i == 0) ? v : (DVector2){ max(hi.x, v.x), max(hi.y, v.y) };
+    }
+    f64 margin = MERGE_BOX_MARGIN + 0.01 * max(hi.x - lo.x, hi.y - lo.y);
+    DVector2 box[4] = {
+        { lo.x - margin, lo.y - margin },
+        { hi.x + margin, lo.y - margin },
+        { hi.x + margin, hi.y + margin },
+        { lo.x - margin, hi.y + margin },
+    };
+
+    MergeNode *root = mergeNodes(&arena, rootA, rootB, (op == BspSetUnion) ? BspSetUnion : BspSetIntersection, box, 4);
+    root = finishNode(&arena, root, box, 4);
+    if (root->left || root->solid)
+    {
+        /* box edges run counter-clockwise, so in front of each is inside */
+        MergeNode *empty = newMergeNode(&arena, (BspLine){ 0 }, NULL, NULL, false);
+        for (usize i = 4; i-- > 0;)
+            root = newMergeNode(&arena, BspLineFromSegment((DSegment){ .left = box[i], .right = box[(i + 1) % 4] }), empty, root, false);
+    }
+
+    usize numNodes = countMergeNodes(root);
+    BspFlatTree *tree = AllocBspFlatTree(numNodes, arena.numPieces, 2 * arena.numPieces);
+    u8 *cells = (u8 *)malloc(max(numNodes, 1) * sizeof(u8));
+    u32 filledNodes = 0, filledFragments = 0;
+    if (root->left) flattenMergeNode(root, BSP_NULL_IDX, &arena, tree, cells, &filledNodes, &filledFragments);
+    assert(filledNodes == numNodes && filledFragments == arena.numPieces);
+    tree->cells = cells;
+    tree->numVertices = 2 * arena.numPieces;
+    WeldBspFlatVertices(tree);
+
+    if (boundary)
+    {
+        *boundary = (DSegment *)malloc(max(tree->numFragments, 1) * sizeof(DSegment));
+        for (usize i = 0; i < tree->numFragments; i++)
+            (*boundary)[i] = BspFlatFragmentSegment(tree, tree->fragments[i]);
+        *numBoundary = tree->numFragments;
+    }
+
+    for (usize i = 0; i < arena.numNodes; i++)
+        free(arena.nodes[i]);
+    free(arena.nodes);
+    free(arena.pieces);
+    return tree;
+}
+
+MergeNode *
+newMergeNode(MergeArena *arena, BspLine line, MergeNode *left, MergeNode *right, bool solid)
+{
+    if (arena->numNodes == arena->capacity)
+    {
+        arena->capacity = max(2 * arena->capacity, 64);
+        arena->nodes = (MergeNode **)realloc(arena->nodes, arena->capacity * sizeof(MergeNode *));
+    }
+    MergeNode *node = (MergeNode *)malloc(sizeof(MergeNode));
+    *node = (MergeNode){ line, left, right, solid, 0, 0 };
+    arena->nodes[arena->numNodes++] = node;
+    return node;
+}
+
+MergeNode *
+importFlatNode(MergeArena *arena, const BspFlatTree *tree, u32 idx, bool invert)
+{
+    /* missing children become explicit leaves with the label of the cell they stand for */
+    BspFlatNode flat = tree->nodes[idx];
+    bool leftSolid = ((tree->cells[idx] & BSP_CELL_LEFT_SOLID) != 0) != invert;
+    bool rightSolid = ((tree->cells[idx] & BSP_CELL_RIGHT_SOLID) != 0) != invert;
+    MergeNode *left = (flat.left == BSP_NULL_IDX) ? newMergeNode(arena, flat.line, NULL, NULL, leftSolid) : importFlatNode(arena, tree, flat.left, invert);
+    MergeNode *right = (flat.right == BSP_NULL_IDX) ? newMergeNode(arena, flat.line, NULL, NULL, rightSolid) : importFlatNode(arena, tree, flat.right, invert);
+    return newMergeNode(arena, flat.line, left, right, false);
+}
+
+MergeNode *
+joinMergeNodes(MergeArena *arena, BspLine line, MergeNode *left, MergeNode *right)
+{
+    /* a splitter between two cells with the same label separates nothing */
+    if (!left->left && !right->left && left->solid == right->solid) return left;
+    return newMergeNode(arena, line, left, right, false);
+}
+
+MergeNode *
+mergeNodes(MergeArena *arena, MergeNode *a, MergeNode *b, BspSetOp op, const DVector2 *cell, usize n)
+{ /*
+   * merges a and b inside the convex cell both of them cover. a's splitter
+   * is kept and b is partitioned by it, a splitter that misses the cell
+   * leaves only one of its children to merge with
+   */
+    if (!a->left || !b->left) return mergeLeaf(a, b, op);
+    DSide side = cellSide(cell, n, a->line);
+    if (side != DSideBoth) return mergeNodes(arena, (side == DSideRight) ? a->left : a->right, b, op, cell, n);
+
+    DVector2 *behind = (DVector2 *)malloc((n + 2) * sizeof(DVector2));
+    DVector2 *inFront = (DVector2 *)malloc((n + 2) * sizeof(DVector2));
+    usize numBehind = clipCell(cell, n, a->line, DSideRight, behind);
+    usize numInFront = clipCell(cell, n, a->line, DSideLeft, inFront);
+    MergeNode *bBehind, *bInFront;
+    partitionNode(arena, b, a->line, cell, n, &bBehind, &bInFront);
+    MergeNode *left = mergeNodes(arena, a->left, bBehind, op, behind, numBehind);
+    MergeNode *right = mergeNodes(arena, a->right, bInFront, op, inFront, numInFront);
+    free(behind);
+    free(inFront);
+    return joinMergeNodes(arena, a->line, left, right);
+}
+
+MergeNode *
+mergeLeaf(MergeNode *a, MergeNode *b, BspSetOp op)
+{
+    /* a solid leaf decides a union, an empty one an intersection, otherwise the other tree does */
+    bool aLeaf = !a->left;
+    if (op == BspSetUnion) return aLeaf ? (a->solid ? a : b) : (b->solid ? b : a);
+    return aLeaf ? (a->solid ? b : a) : (b->solid ? a : b);
+}
+
+void
+partitionNode(MergeArena *arena, MergeNode *t, BspLine line, const DVector2 *cell, usize n, MergeNode **behind, MergeNode **inFront)
+{ /*
+   * splits t, which covers cell, into the trees covering the parts of cell
+   * behind and in front of line. t's splitter is kept on a side only if it
+   * still divides that side's part of the cell, subtrees that lie entirely
+   * on one side of line are moved over without being visited
+   */
+    if (!t->left)
+    {
+        *behind = t;
+        *inFront = t;
+        return;
+    }
+    DSide side = cellSide(cell, n, t->line);
+    if (side != DSideBoth)
+    {
+        partitionNode(arena, (side == DSideRight) ? t->left : t->right, line, cell, n, behind, inFront);
+        return;
+    }
+
+    DVector2 *cellBehind = (DVector2 *)malloc((n + 2) * sizeof(DVector2));
+    DVector2 *cellInFront = (DVector2 *)malloc((n + 2) * sizeof(DVector2));
+    usize numBehind = clipCell(cell, n, t->line, DSideRight, cellBehind);
+    usize numInFront = clipCell(cell, n, t->line, DSideLeft, cellInFront);
+    MergeNode *leftBehind, *leftInFront, *rightBehind, *rightInFront;
+    partitionPart(arena, t->left, line, cellBehind, numBehind, &leftBehind, &leftInFront);
+    partitionPart(arena, t->right, line, cellInFront, numInFront, &rightBehind, &rightInFront);
+    free(cellBehind);
+    free(cellInFront);
+
+    /* both NULL only if line misses cell on that side, nothing there is ever reached */
+    if (leftBehind && rightBehind) *behind = joinMergeNodes(arena, t->line, leftBehind, rightBehind);
+    else *behind = leftBehind ? leftBehind : (rightBehind ? rightBehind : t);
+    if (leftInFront && rightInFront) *inFront = joinMergeNodes(arena, t->line, leftInFront, rightInFront);
+    else *inFront = leftInFront ? leftInFront : (rightInFront ? rightInFront : t);
+}
+
+void
+partitionPart(MergeArena *arena, MergeNode *t, BspLine line, const DVector2 *cell, usize n, MergeNode **behind, MergeNode **inFront)
+{
+    /* NULL on the side of line that cell doesn't reach */
+    DSide side = cellSide(cell, n, line);
+    *behind = NULL;
+    *inFront = NULL;
+    if (side == DSideBoth) partitionNode(arena, t, line, cell, n, behind, inFront);
+    else if (side == DSideRight) *behind = t;
+    else *inFront = t;
+}
+
+MergeNode *
+finishNode(MergeArena *arena, MergeNode *node, const DVector2 *cell, usize n)
+{ /*
+   * copies the merged tree without the splitters that miss their cell
+   * (subtrees taken over whole still have them) and without the ones left
+   * separating two cells with the same label, then cuts the boundary out of
+   * every remaining splitter. the copy is a proper tree, the merge result
+   * can share subtrees
+   */
+    if (!node->left) return node;
+    DSide side = cellSide(cell, n, node->line);
+    if (side != DSideBoth) return finishNode(arena, (side == DSideRight) ? node->left : node->right, cell, n);
+
+    DVector2 *behind = (DVector2 *)malloc((n + 2) * sizeof(DVector2));
+    DVector2 *inFront = (DVector2 *)malloc((n + 2) * sizeof(DVector2));
+    usize numBehind = clipCell(cell, n, node->line, DSideRight, behind);
+    usize numInFront = clipCell(cell, n, node->line, DSideLeft, inFront);
+    MergeNode *left = finishNode(arena, node->left, behind, numBehind);
+    MergeNode *right = finishNode(arena, node->right, inFront, numInFront);
+    free(behind);
+    free(inFront);
+    if (!left->left && !right->left && left->solid == right->solid) return left;
+
+    MergeNode *finished = newMergeNode(arena, node->line, left, right, false);
+    extractBoundary(arena, finished, cell, n);
+    return finished;
+}
+
+void
+extractBoundary(MergeArena *arena, MergeNode *node, const DVector2 *cell, usize n)
+{ /*
+   * the chord of the cell along the splitter is pushed down both children,
+   * each labels the pieces of it from its side. where the labels differ the
+   * piece is boundary, running along the line if the solid side is in front
+   */
+    f64 from = 0.0, to = 0.0;
+    bool found = false;
+    for (usize i = 0; i < n; i++)
+    {
+        DVector2 p = cell[i], q = cell[(i + 1) % n];
+        f64 dp = lineDistance(node->line, p), dq = lineDistance(node->line, q);
+        f64 t;
+        if (babs(dp) <= BSP_EPSILON) t = lineParam(node->line, p);
+        else if ((dp > BSP_EPSILON && dq < -BSP_EPSILON) || (dp < -BSP_EPSILON && dq > BSP_EPSILON)) t = lineParam(node->line, cellLerp(p, q, dp / (dp - dq)));
+        else continue;
+        from = found ? min(from, t) : t;
+        to = found ? max(to, t) : t;
+        found = true;
+    }
+    node->firstPiece = arena->numPieces;
+    if (!found || to - from <= BSP_EPSILON) return;
+
+    f64 norm = hypot(node->line.a, node->line.b);
+    DVector2 normal = { node->line.a / norm, node->line.b / norm };
+    SpanList behind = { NULL, 0, 0 }, inFront = { NULL, 0, 0 };
+    pushSpans(&behind, node->left, node->line, from, to, (DVector2){ -normal.x, -normal.y });
+    pushSpans(&inFront, node->right, node->line, from, to, normal);
+
+    /* both lists cover [from, to] in order, walk them together */
+    usize i = 0, j = 0;
+    f64 t = from, lastEnd = from;
+    bool lastInFront = false, any = false;
+    while (i < behind.numSpans && j < inFront.numSpans)
+    {
+        f64 end = min(behind.spans[i].t1, inFront.spans[j].t1);
+        bool solidBehind = behind.spans[i].solid, solidInFront = inFront.spans[j].solid;
+        if (solidBehind != solidInFront && end - t > BSP_EPSILON)
+        {
+            addPiece(arena, node->line, t, end, solidInFront, any && lastEnd == t && lastInFront == solidInFront);
+            lastEnd = end;
+            lastInFront = solidInFront;
+            any = true;
+        }
+        if (behind.spans[i].t1 <= end) i++;
+        if (inFront.spans[j].t1 <= end) j++;
+        t = end;
+    }
+    free(behind.spans);
+    free(inFront.spans);
+    node->numPieces = arena->numPieces - node->firstPiece;
+}
+
+void
+pushSpans(SpanList *list, const MergeNode *node, BspLine chord, f64 t0, f64 t1, DVector2 normal)
+{
+    /* normal points from the chord into the cells being labeled, it decides for splitters on the chord's line */
+    if (!node->left)
+    {
+        if (list->numSpans == list->capacity)
+        {
+            list->capacity = max(2 * list->capacity, 8);
+            list->spans = (ChordSpan *)realloc(list->spans, list->capacity * sizeof(ChordSpan));
+        }
+        list->spans[list->numSpans++] = (ChordSpan){ t0, t1, node->solid };
+        return;
+    }
+    f64 d0 = lineDistance(node->line, linePoint(chord, t0));
+    f64 d1 = lineDistance(node->line, linePoint(chord, t1));
+    if (babs(d0) <= BSP_EPSILON && babs(d1) <= BSP_EPSILON)
+    {
+        bool inFront = node->line.a * normal.x + node->line.b * normal.y > 0.0;
+        pushSpans(list, inFront ? node->right : node->left, chord, t0, t1, normal);
+    }
+    else if (d0 >= -BSP_EPSILON && d1 >= -BSP_EPSILON) pushSpans(list, node->right, chord, t0, t1, normal);
+    else if (d0 <= BSP_EPSILON && d1 <= BSP_EPSILON) pushSpans(list, node->left, chord, t0, t1, normal);
+    else
+    {
+        f64 t = t0 + (t1 - t0) * d0 / (d0 - d1);
+        pushSpans(list, (d0 > 0.0) ? node->right : node->left, chord, t0, t, normal);
+        pushSpans(list, (d1 > 0.0) ? node->right : node->left, chord, t, t1, normal);
+    }
+}
+
+void
+addPiece(MergeArena *arena, BspLine chord, f64 t0, f64 t1, bool inFront, bool extend)
+{
+    /* a piece right after one with the same orientation just extends it */
+    if (extend)
+    {
+        DSegment *last = &arena->pieces[arena->numPieces - 1];
+        if (inFront) last->right = linePoint(chord, t1);
+        else last->left = linePoint(chord, t1);
+        return;
+    }
+    if (arena->numPieces == arena->pieceCapacity)
+    {
+        arena->pieceCapacity = max(2 * arena->pieceCapacity, 64);
+        arena->pieces = (DSegment *)realloc(arena->pieces, arena->pieceCapacity * sizeof(DSegment));
+    }
+    DVector2 from = linePoint(chord, t0), to = linePoint(chord, t1);
+    arena->pieces[arena->numPieces++] = (DSegment){
+        .left = inFront ? from : to,
+        .right = inFront ? to : from,
+        .splitLeft = false,
+        .splitRight = false,
+    };
+}
+
+usize
+countMergeNodes(const MergeNode *node)
+{
+    if (!node->left) return 0;
+    return 1 + countMergeNodes(node->left) + countMergeNodes(node->right);
+}
+
+u32
+flattenMergeNode(const MergeNode *node, u32 parent, const MergeArena *arena, BspFlatTree *tree, u8 *cells, u32 *numNodes, u32 *numFragments)
+{
+    /* pre-order like FlattenBspTree, leaves become missing children labeled in cells */
+    if (!node->left) return BSP_NULL_IDX;
+    u32 idx = (*numNodes)++;
+    BspFlatNode *nodes = (BspFlatNode *)tree->nodes;
+    nodes[idx].line = node->line;
+    ((BspFragmentRange *)tree->ranges)[idx] = (BspFragmentRange){ *numFragments, node->numPieces };
+    ((u32 *)tree->parents)[idx] = parent;
+    ((Color *)tree->colors)[idx] = BLANK;
+    for (u32 i = 0; i < node->numPieces; i++)
+    {
+        u32 k = (*numFragments)++;
+        ((DVector2 *)tree->vertices)[2 * k] = arena->pieces[node->firstPiece + i].left;
+        ((DVector2 *)tree->vertices)[2 * k + 1] = arena->pieces[node->firstPiece + i].right;
+        /* a merged tree's fragments come from no input segment, they're their own sources (the index in *boundary) */
+        ((BspFragment *)tree->fragments)[k] = (BspFragment){ 2 * k, 2 * k + 1, k };
+    }
+    cells[idx] = ((!node->left->left && node->left->solid) ? BSP_CELL_LEFT_SOLID : 0)
+                 | ((!node->right->left && node->right->solid) ? BSP_CELL_RIGHT_SOLID : 0);
+
+    u32 left = flattenMergeNode(node->left, idx, arena, tree, cells, numNodes, numFragments);
+    u32 right = flattenMergeNode(node->right, idx, arena, tree, cells, numNodes, numFragments);
+    nodes[idx].left = left;
+    nodes[idx].right = right;
+    return idx;
+}
+
+DSide
+cellSide(const DVector2 *cell, usize n, BspLine line)
+{
+    /* DSideBoth if line cuts through cell, DSideInside if cell is too thin to tell */
+    bool inFront = false, behind = false;
+    for (usize i = 0; i < n; i++)
+    {
+        f64 d = lineDistance(line, cell[i]);
+        inFront |= (d > BSP_EPSILON);
+        behind |= (d < -BSP_EPSILON);
+    }
+    if (inFront && behind) return DSideBoth;
+    else if (inFront) return DSideLeft;
+    else if (behind) return DSideRight;
+    else return DSideInside;
+}
+
+usize
+clipCell(const DVector2 *cell, usize n, BspLine line, DSide keep, DVector2 *out)
+{
+    /* Sutherland-Hodgman against one line, vertices on it are kept on both sides. out holds n + 2 */
+    f64 s = (keep == DSideLeft) ? 1.0 : -1.0;
+    usize m = 0;
+    for (usize i = 0; i < n; i++)
+    {
+        DVector2 p = cell[i], q = cell[(i + 1) % n];
+        f64 dp = s * lineDistance(line, p), dq = s * lineDistance(line, q);
+        if (dp >= -BSP_EPSILON) out[m++] = p;
+        if ((dp > BSP_EPSILON && dq < -BSP_EPSILON) || (dp < -BSP_EPSILON && dq > BSP_EPSILON)) out[m++] = cellLerp(p, q, dp / (dp - dq));
+    }
+    assert(m <= n + 2);
+    return m;
+}
+
+DVector2
+cellLerp(DVector2 p, DVector2 q, f64 t)
+{
+    return (DVector2){ p.x + t * (q.x - p.x), p.y + t * (q.y - p.y) };
+}
+
+f64
+lineDistance(BspLine line, DVector2 pt)
+{
+    return BspLineEval(line, pt) / hypot(line.a, line.b);
+}
+
+DVector2
+linePoint(BspLine line, f64 t)
+{
+    /* t runs along the line's direction (b, -a) from the point closest to the origin */
+    f64 norm2 = line.a * line.a + line.b * line.b;
+    f64 norm = sqrt(norm2);
+    return (DVector2){ -line.a * line.c / norm2 + t * line.b / norm, -line.b * line.c / norm2 - t * line.a / norm };
+}
+
+f64
+lineParam(BspLine line, DVector2 pt)
+{
+    return (pt.x * line.b - pt.y * line.a) / hypot(line.a, line.b);
+}
@@ -0,0 +1,413 @@
+#define _POSIX_C_SOURCE 200809L
+#include "bsp_ooc.h"
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "bsp_tree.h"
+#include "f64_segment.h"
+#include "raylib.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define OOC_HEADER_SIZE (5 * sizeof(u32))
+#define OOC_SCRATCH_NAME "%s/ooc_%d_%llu.seg" /* scratch directory, process id, scratch counter */
+
+/* cold data of a node that is known as soon as the node is reserved */
+typedef struct OocCold {
+    BspFragmentRange range; /* fragments of node */
+    u32 parent;             /* parent of node (BSP_NULL_IDX for root) */
+} OocCold;
+
+typedef struct OocBuild {
+    FILE *out;                                /* output tree file, nodes are written to it in pre-order */
+    FILE *cold;                               /* scratch file of OocCold records, split into cold arrays at the end */
+    FILE *fragments;                          /* scratch file of node fragments, appended to out at the end */
+    FILE *vertices;                           /* scratch file of vertex pool, appended to out after fragments */
+    u64 numNodes;                             /* nodes written so far */
+    u64 numFragments;                         /* node fragments written so far */
+    u64 numVertices;                          /* pool vertices written so far */
+    u64 memoryBudget;                         /* max bytes of segments handed to BuildBspTree */
+    u64 numScratch;                           /* scratch files created so far (used for unique names) */
+    char scratchDirectory[BSP_OOC_PATH_SIZE]; /* directory holding scratch files */
+    bool failed;                              /* set on any i/o error */
+} OocBuild;
+
+/* ********************** helpers ********************** */
+u32 buildRange(OocBuild *build, const char *path, u64 numSegments, u32 parent, bool owned);
+u32 buildInMemory(OocBuild *build, const DSegment *segments, u64 numSegments, u32 parent);
+u32 reserveNode(OocBuild *build, BspFragmentRange range, u32 parent);
+void writeNode(OocBuild *build, u32 idx, BspFlatNode node);
+bool scratchPath(OocBuild *build, char *path);
+bool appendScratch(FILE *out, FILE *scratch);
+bool appendCold(FILE *out, FILE *cold, bool parents);
+bool appendColors(FILE *out, u64 numNodes);
+bool appendZeros(FILE *out, u64 size);
+const DSegment *mapSegments(const char *path, u64 numSegments);
+DSegment *createSegments(const char *path, u64 numSegments);
+void unmapSegments(const DSegment *segments, u64 numSegments);
+/* ***************************************************** */
+
+bool
+BuildBspTreeOutOfCore(const char *segmentsPath, const char *outputPath, const char *scratchDirectory, u64 memoryBudget)
+{
+    struct stat st;
+    if (stat(segmentsPath, &st) != 0)
+    {
+        TraceLog(LOG_ERROR, "OOC: could not open %s", segmentsPath);
+        return false;
+    }
+    u64 numSegments = (u64)st.st_size / sizeof(DSegment);
+    /* every scratch name fits if the longest possible one does */
+    if (snprintf(NULL, 0, OOC_SCRATCH_NAME, scratchDirectory, (i32)getpid(), ~0ull) >= BSP_OOC_PATH_SIZE)
+    {
+        TraceLog(LOG_ERROR, "OOC: scratch directory %s is too long for scratch file names", scratchDirectory);
+        return false;
+    }
+    OocBuild build = {
+        .out = fopen(outputPath, "w+b"),
+        .cold = NULL,
+        .fragments = NULL,
+        .vertices = NULL,
+        .memoryBudget = max(memoryBudget, sizeof(DSegment)),
+    };
+    snprintf(build.scratchDirectory, BSP_OOC_PATH_SIZE, "%s", scratchDirectory);
+    if (!build.out)
+    {
+        TraceLog(LOG_ERROR, "OOC: could not open %s", outputPath);
+        return false;
+    }
+    mkdir(scratchDirectory, 0755);
+
+    char coldScratch[BSP_OOC_PATH_SIZE], fragmentsScratch[BSP_OOC_PATH_SIZE], verticesScratch[BSP_OOC_PATH_SIZE];
+    bool named = scratchPath(&build, coldScratch) && scratchPath(&build, fragmentsScratch) && scratchPath(&build, verticesScratch);
+    build.cold = named ? fopen(coldScratch, "w+b") : NULL;
+    build.fragments = named ? fopen(fragmentsScratch, "w+b") : NULL;
+    build.vertices = named ? fopen(verticesScratch, "w+b") : NULL;
+    if (!build.cold || !build.fragments || !build.vertices)
+    {
+        TraceLog(LOG_ERROR, "OOC: could not create scratch files in %s", scratchDirectory);
+        if (build.cold) fclose(build.cold);
+        if (build.fragments) fclose(build.fragments);
+        if (build.vertices) fclose(build.vertices);
+        if (build.cold) remove(coldScratch);
+        if (build.fragments) remove(fragmentsScratch);
+        if (build.vertices) remove(verticesScratch);
+        fclose(build.out);
+        return false;
+    }
+
+    /* header gets patched once the node, fragment and vertex counts are known */
+    u32 header[5] = { BSP_FILE_MAGIC, BSP_FILE_VERSION, 0, 0, 0 };
+    build.failed = fwrite(header, sizeof(u32), 5, build.out) != 5;
+    if (!build.failed) buildRange(&build, segmentsPath, numSegments, BSP_NULL_IDX, false);
+    if (build.numNodes >= BSP_NULL_IDX || build.numFragments > 0xffffffffu || build.numVertices >= BSP_NULL_IDX)
+    {
+        TraceLog(LOG_ERROR, "OOC: tree has too many nodes or segments for the flat tree format");
+        build.failed = true;
+    }
+
+    { /* append cold arrays (payloads start out zeroed), fragments and vertex pool after the nodes */
+        fseeko(build.out, 0, SEEK_END);
+        build.failed = build.failed || !appendCold(build.out, build.cold, false);
+        build.failed = build.failed || !appendCold(build.out, build.cold, true);
+        build.failed = build.failed || !appendColors(build.out, build.numNodes);
+        build.failed = build.failed || !appendZeros(build.out, build.numNodes * sizeof(u32));
+        build.failed = build.failed || !appendScratch(build.out, build.fragments);
+        build.failed = build.failed || !appendScratch(build.out, build.vertices);
+        header[2] = (u32)build.numNodes;
+        header[3] = (u32)build.numFragments;
+        header[4] = (u32)build.numVertices;
+        fseeko(build.out, 0, SEEK_SET);
+        build.failed = build.failed || fwrite(header, sizeof(u32), 5, build.out) != 5;
+    }
+
+    fclose(build.cold);
+    fclose(build.fragments);
+    fclose(build.vertices);
+    remove(coldScratch);
+    remove(fragmentsScratch);
+    remove(verticesScratch);
+    if (fclose(build.out) != 0) build.failed = true;
+    if (build.failed)
+    {
+        TraceLog(LOG_ERROR, "OOC: could not build tree into %s", outputPath);
+        remove(outputPath);
+        return false;
+    }
+    TraceLog(LOG_INFO, "OOC: built %llu node(s) from %llu segment(s) into %s", build.numNodes, numSegments, outputPath);
+    return true;
+}
+
+bool
+WriteSegmentFile(const char *path, const DSegment *segments, u64 numSegments)
+{
+    FILE *out = fopen(path, "wb");
+    if (!out) return false;
+    bool ok = fwrite(segments, sizeof(DSegment), numSegments, out) == numSegments;
+    return (fclose(out) == 0) && ok;
+}
+
+u32
+buildRange(OocBuild *build, const char *path, u64 numSegments, u32 parent, bool owned)
+{ /*
+   * streaming version of BuildBspTree, every pass walks the mapped segments
+   * front to back so the kernel only has to keep a window of pages resident
+   */
+    if (build->failed || numSegments == 0)
+    {
+        if (owned) remove(path);
+        return BSP_NULL_IDX;
+    }
+
+    const DSegment *segments = mapSegments(path, numSegments);
+    if (!segments)
+    {
+        build->failed = true;
+        return BSP_NULL_IDX;
+    }
+
+    if (numSegments * sizeof(DSegment) <= build->memoryBudget)
+    {
+        u32 idx = buildInMemory(build, segments, numSegments, parent);
+        unmapSegments(segments, numSegments);
+        if (owned) remove(path);
+        return idx;
+    }
+
+    /* use free split as partitioning segment if one exists */
+    u64 splitIdx = 0;
+    for (u64 i = 0; i < numSegments; i++)
+        if (segments[i].splitLeft && segments[i].splitRight)
+        {
+            splitIdx = i;
+            break;
+        }
+    DSegment splitter = segments[splitIdx];
+
+    /* first pass - find size of each partition */
+    u64 numBehind = 0, numInFront = 0, numInside = 0;
+    for (u64 i = 0; i < numSegments; i++)
+    {
+        DSide side = BspSplitSides(splitter, segments[i]);
+        numInside += (side == DSideInside);
+        numBehind += (side == DSideRight || side == DSideBoth);
+        numInFront += (side == DSideLeft || side == DSideBoth);
+    }
+
+    char behindPath[BSP_OOC_PATH_SIZE], inFrontPath[BSP_OOC_PATH_SIZE];
+    if (!scratchPath(build, behindPath) || !scratchPath(build, inFrontPath))
+    {
+        unmapSegments(segments, numSegments);
+        if (owned) remove(path);
+        build->failed = true;
+        return BSP_NULL_IDX;
+    }
+    DSegment *behind = createSegments(behindPath, numBehind);
+    DSegment *inFront = createSegments(inFrontPath, numInFront);
+    if ((numBehind > 0 && !behind) || (numInFront > 0 && !inFront))
+    {
+        TraceLog(LOG_ERROR, "OOC: could not create scratch files in %s", build->scratchDirectory);
+        if (behind) unmapSegments(behind, numBehind);
+        if (inFront) unmapSegments(inFront, numInFront);
+        unmapSegments(segments, numSegments);
+        remove(behindPath);
+        remove(inFrontPath);
+        build->failed = true;
+        return BSP_NULL_IDX;
+    }
+
+    /* node is reserved before its children so the output stays in pre-order */
+    u32 idx = reserveNode(build, (BspFragmentRange){ (u32)build->numFragments, (u32)numInside }, parent);
+    BspFlatNode node = {
+        .line = BspLineFromSegment(splitter),
+        .left = BSP_NULL_IDX,
+        .right = BSP_NULL_IDX,
+    };
+
+    /*
+     * second pass - stream node segments out and fill the child partitions.
+     * vertices of these top level nodes aren't merged, that would take a
+     * table of every vertex seen so far. there are only a few of them compared
+     * to the subtrees built in memory, which do share vertices
+     */
+    u64 behindIdx = 0, inFrontIdx = 0;
+    for (u64 k = 0; k < numSegments; k++)
+    {
+        /* splitter goes first like in BuildBspTree, a nearly collinear segment before it would tilt the line readers take from the first fragment */
+        u64 i = (k == 0) ? splitIdx : ((k <= splitIdx) ? k - 1 : k);
+        switch (BspSplitSides(splitter, segments[i]))
+        {
+        case DSideInside: {
+            BspFragment fragment = { (u32)build->numVertices, (u32)build->numVertices + 1, segments[i].id };
+            DVector2 vertices[2] = { segments[i].left, segments[i].right };
+            build->failed = build->failed || fwrite(&fragment, sizeof(BspFragment), 1, build->fragments) != 1;
+            build->failed = build->failed || fwrite(vertices, sizeof(DVector2), 2, build->vertices) != 2;
+            build->numFragments += 1;
+            build->numVertices += 2;
+        }
+        break;
+        case DSideLeft:
+            inFront[inFrontIdx++] = segments[i];
+            break;
+        case DSideRight:
+            behind[behindIdx++] = segments[i];
+            break;
+        case DSideBoth:
+            BspSplitSegment(splitter, segments[i], &behind[behindIdx++], &inFront[inFrontIdx++]);
+            break;
+        }
+    }
+
+    unmapSegments(segments, numSegments);
+    if (behind) unmapSegments(behind, numBehind);
+    if (inFront) unmapSegments(inFront, numInFront);
+    if (owned) remove(path);
+
+    node.left = buildRange(build, behindPath, numBehind, idx, true);
+    node.right = buildRange(build, inFrontPath, numInFront, idx, true);
+    writeNode(build, idx, node);
+    return idx;
+}
+
+u32
+buildInMemory(OocBuild *build, const DSegment *segments, u64 numSegments, u32 parent)
+{
+    /* BuildBspTree takes ownership of (and frees) the segment list it's handed */
+    DSegment *copy = (DSegment *)malloc(numSegments * sizeof(DSegment));
+    memcpy(copy, segments, numSegments * sizeof(DSegment));
+    BspNode *root = BuildBspTree(copy, numSegments, NULL);
+    BspFlatTree *tree = FlattenBspTree(root);
+    FreeBspTree(root);
+
+    /* subtree indices are relative to the subtree, shift them to where it lands in the output */
+    u32 nodeBase = (u32)build->numNodes, fragmentBase = (u32)build->numFragments, vertexBase = (u32)build->numVertices;
+    for (usize i = 0; i < tree->numNodes; i++)
+    {
+        BspFlatNode node = tree->nodes[i];
+        if (node.left != BSP_NULL_IDX) node.left += nodeBase;
+        if (node.right != BSP_NULL_IDX) node.right += nodeBase;
+        BspFragmentRange range = { tree->ranges[i].first + fragmentBase, tree->ranges[i].count };
+        u32 nodeParent = (tree->parents[i] == BSP_NULL_IDX) ? parent : tree->parents[i] + nodeBase;
+        writeNode(build, reserveNode(build, range, nodeParent), node);
+    }
+    for (usize i = 0; i < tree->numFragments; i++)
+    {
+        BspFragment fragment = { tree->fragments[i].left + vertexBase, tree->fragments[i].right + vertexBase, tree->fragments[i].source };
+        if (fwrite(&fragment, sizeof(BspFragment), 1, build->fragments) != 1) build->failed = true;
+    }
+    if (fwrite(tree->vertices, sizeof(DVector2), tree->numVertices, build->vertices) != tree->numVertices) build->failed = true;
+    build->numFragments += tree->numFragments;
+    build->numVertices += tree->numVertices;
+
+    u32 idx = (tree->numNodes > 0) ? nodeBase : BSP_NULL_IDX;
+    FreeBspFlatTree(tree);
+    return idx;
+}
+
+u32
+reserveNode(OocBuild *build, BspFragmentRange range, u32 parent)
+{
+    /* nodes are reserved in index order, so their cold records can just be appended */
+    OocCold cold = { range, parent };
+    if (fwrite(&cold, sizeof(OocCold), 1, build->cold) != 1) build->failed = true;
+    return (u32)build->numNodes++;
+}
+
+void
+writeNode(OocBuild *build, u32 idx, BspFlatNode node)
+{
+    fseeko(build->out, (off_t)(OOC_HEADER_SIZE + (u64)idx * sizeof(BspFlatNode)), SEEK_SET);
+    if (fwrite(&node, sizeof(BspFlatNode), 1, build->out) != 1) build->failed = true;
+}
+
+bool
+scratchPath(OocBuild *build, char *path)
+{
+    /* a cut off name could be a live scratch file's, so it fails the build rather than being used */
+    i32 length = snprintf(path, BSP_OOC_PATH_SIZE, OOC_SCRATCH_NAME, build->scratchDirectory, (i32)getpid(), build->numScratch++);
+    if (length >= 0 && length < BSP_OOC_PATH_SIZE) return true;
+    TraceLog(LOG_ERROR, "OOC: scratch file name in %s is longer than %d characters", build->scratchDirectory, BSP_OOC_PATH_SIZE - 1);
+    build->failed = true;
+    return false;
+}
+
+bool
+appendScratch(FILE *out, FILE *scratch)
+{
+    char chunk[1 << 16];
+    rewind(scratch);
+    for (usize n; (n = fread(chunk, 1, sizeof(chunk), scratch)) > 0;)
+        if (fwrite(chunk, 1, n, out) != n) return false;
+    return !ferror(scratch);
+}
+
+bool
+appendCold(FILE *out, FILE *cold, bool parents)
+{
+    OocCold chunk[1024];
+    rewind(cold);
+    for (usize n; (n = fread(chunk, sizeof(OocCold), 1024, cold)) > 0;)
+    {
+        for (usize i = 0; i < n; i++)
+        {
+            bool ok = parents ? fwrite(&chunk[i].parent, sizeof(u32), 1, out) == 1 : fwrite(&chunk[i].range, sizeof(BspFragmentRange), 1, out) == 1;
+            if (!ok) return false;
+        }
+    }
+    return !ferror(cold);
+}
+
+bool
+appendColors(FILE *out, u64 numNodes)
+{
+    for (u64 i = 0; i < numNodes; i++)
+        if (fwrite(&colors[i % numColors], sizeof(Color), 1, out) != 1) return false;
+    return true;
+}
+
+bool
+appendZeros(FILE *out, u64 size)
+{
+    char zeros[4096] = { 0 };
+    for (u64 n; size > 0; size -= n)
+    {
+        n = min(size, sizeof(zeros));
+        if (fwrite(zeros, 1, n, out) != n) return false;
+    }
+    return true;
+}
+
+const DSegment *
+mapSegments(const char *path, u64 numSegments)
+{
+    i32 fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    void *segments = mmap(NULL, numSegments * sizeof(DSegment), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (segments == MAP_FAILED) return NULL;
+    posix_madvise(segments, numSegments * sizeof(DSegment), POSIX_MADV_SEQUENTIAL);
+    return (const DSegment *)segments;
+}
+
+DSegment *
+createSegments(const char *path, u64 numSegments)
+{
+    if (numSegments == 0) return NULL;
+    i32 fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return NULL;
+    void *segments = MAP_FAILED;
+    if (ftruncate(fd, (off_t)(numSegments * sizeof(DSegment))) == 0) segments = mmap(NULL, numSegments * sizeof(DSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return (segments == MAP_FAILED) ? NULL : (DSegment *)segments;
+}
+
+void
+unmapSegments(const DSegment *segments, u64 numSegments)
+{
+    munmap((void *)segments, numSegments * sizeof(DSegment));
+}
@@ -0,0 +1,256 @@
+#include "bsp_quant.h"
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "f64_segment.h"
+#include "f64_vector.h"
+#include "raylib.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* ******************** helpers ******************** */
+BspQuantPoint quantizePoint(const BspQuantTree *tree, BspQuantNode node, DVector2 pt);
+DVector2 gridPoint(const BspQuantTree *tree, DVector2 pt);
+DSide gridSide(const BspQuantTree *tree, u32 idx, DVector2 p, DVector2 pt);
+DVector2 nodeCell(BspQuantNode node);
+/* ************************************************* */
+
+BspQuantTree *
+QuantizeBspFlatTree(const BspFlatTree *tree)
+{
+    /* left children are implicit (idx + 1), which only holds in pre-order */
+    for (usize i = 0; i < tree->numNodes; i++)
+    {
+        if (tree->nodes[i].left == BSP_NULL_IDX || tree->nodes[i].left == i + 1) continue;
+        TraceLog(LOG_ERROR, "QUANT: tree is not in pre-order, relayout it with BspLayoutPreOrder first");
+        return NULL;
+    }
+    /* splitters are read from their first fragment */
+    for (usize i = 0; i < tree->numNodes; i++)
+    {
+        if (tree->ranges[i].count > 0) continue;
+        TraceLog(LOG_ERROR, "QUANT: node %u has no fragments (merged tree)", (u32)i);
+        return NULL;
+    }
+
+    BspQuantTree *quant = (BspQuantTree *)malloc(sizeof(BspQuantTree));
+    quant->exact = tree;
+    quant->numNodes = tree->numNodes;
+    quant->numFragments = tree->numFragments;
+    quant->nodes = (BspQuantNode *)malloc(max(tree->numNodes, 1) * sizeof(BspQuantNode));
+    quant->ranges = (BspFragmentRange *)malloc(max(tree->numNodes, 1) * sizeof(BspFragmentRange));
+    quant->fragments = (BspQuantFragment *)malloc(max(tree->numFragments, 1) * sizeof(BspQuantFragment));
+
+    { /* bounds of every vertex in the tree, the tree grid node boxes are stored on */
+        DVector2 lo = { 0.0, 0.0 }, hi = { 0.0, 0.0 };
+        for (usize i = 0; i < tree->numVertices; i++)
+        {
+            DVector2 v = tree->vertices[i];
+            lo = (i == 0) ? v : (DVector2){ min(lo.x, v.x), min(lo.y, v.y) };
+            hi = (i == 0) ? v : (DVector2){ max(hi.x, v.x), max(hi.y, v.y) };
+        }
+        quant->origin = lo;
+        quant->scale.x = (hi.x > lo.x) ? BSP_QUANT_MAX / (hi.x - lo.x) : 1.0;
+        quant->scale.y = (hi.y > lo.y) ? BSP_QUANT_MAX / (hi.y - lo.y) : 1.0;
+    }
+
+    for (usize i = 0; i < tree->numNodes; i++)
+    {
+        BspFlatNode node = tree->nodes[i];
+        BspFragmentRange range = tree->ranges[i];
+        assert(node.right == BSP_NULL_IDX || node.right < BSP_QUANT_NO_RIGHT);
+        BspQuantNode *q = &quant->nodes[i];
+
+        /* box rounded outward on the tree grid, at least one cell wide so the node grid never degenerates */
+        DVector2 lo = { BSP_QUANT_MAX, BSP_QUANT_MAX }, hi = { 0.0, 0.0 };
+        for (usize k = range.first; k < range.first + range.count; k++)
+        {
+            DSegment s = BspFlatFragmentSegment(tree, tree->fragments[k]);
+            DVector2 a = gridPoint(quant, s.left), b = gridPoint(quant, s.right);
+            lo = (DVector2){ min(lo.x, min(a.x, b.x)), min(lo.y, min(a.y, b.y)) };
+            hi = (DVector2){ max(hi.x, max(a.x, b.x)), max(hi.y, max(a.y, b.y)) };
+        }
+        q->min = (BspQuantPoint){ (u16)clamp(floor(lo.x), 0.0, BSP_QUANT_MAX - 1.0), (u16)clamp(floor(lo.y), 0.0, BSP_QUANT_MAX - 1.0) };
+        q->max = (BspQuantPoint){ (u16)clamp(ceil(hi.x), q->min.x + 1.0, BSP_QUANT_MAX), (u16)clamp(ceil(hi.y), q->min.y + 1.0, BSP_QUANT_MAX) };
+
+        q->links = (node.right == BSP_NULL_IDX) ? BSP_QUANT_NO_RIGHT : node.right;
+        if (node.left != BSP_NULL_IDX) q->links |= BSP_QUANT_HAS_LEFT;
+
+        quant->ranges[i] = range;
+        for (usize k = range.first; k < range.first + range.count; k++)
+        {
+            DSegment s = BspFlatFragmentSegment(tree, tree->fragments[k]);
+            quant->fragments[k] = (BspQuantFragment){ quantizePoint(quant, *q, s.left), quantizePoint(quant, *q, s.right), s.id };
+        }
+    }
+    return quant;
+}
+
+void
+FreeBspQuantTree(BspQuantTree *tree)
+{
+    free(tree->nodes);
+    free(tree->ranges);
+    free(tree->fragments);
+    free(tree);
+}
+
+bool
+WriteBspQuantTree(const BspQuantTree *tree, FILE *out)
+{ /*
+   * on-disk format (native byte order and struct layout):
+   *   u32 magic, u32 version, u32 numNodes, u32 numFragments
+   *   f64 origin.x, origin.y, scale.x, scale.y
+   *   BspQuantNode[numNodes]
+   *   BspFragmentRange[numNodes]
+   *   BspQuantFragment[numFragments]
+   */
+    u32 header[4] = { BSP_QUANT_MAGIC, BSP_QUANT_VERSION, (u32)tree->numNodes, (u32)tree->numFragments };
+    f64 bounds[4] = { tree->origin.x, tree->origin.y, tree->scale.x, tree->scale.y };
+    if (fwrite(header, sizeof(u32), 4, out) != 4) return false;
+    if (fwrite(bounds, sizeof(f64), 4, out) != 4) return false;
+    if (fwrite(tree->nodes, sizeof(BspQuantNode), tree->numNodes, out) != tree->numNodes) return false;
+    if (fwrite(tree->ranges, sizeof(BspFragmentRange), tree->numNodes, out) != tree->numNodes) return false;
+    if (fwrite(tree->fragments, sizeof(BspQuantFragment), tree->numFragments, out) != tree->numFragments) return false;
+    return true;
+}
+
+BspQuantTree *
+ReadBspQuantTree(FILE *in, const BspFlatTree *exact)
+{
+    u32 header[4];
+    f64 bounds[4];
+    if (fread(header, sizeof(u32), 4, in) != 4) return NULL;
+    if (header[0] != BSP_QUANT_MAGIC || header[1] != BSP_QUANT_VERSION) return NULL;
+    if (fread(bounds, sizeof(f64), 4, in) != 4) return NULL;
+    if (exact && (exact->numNodes != header[2] || exact->numFragments != header[3])) return NULL;
+
+    BspQuantTree *tree = (BspQuantTree *)malloc(sizeof(BspQuantTree));
+    tree->exact = exact;
+    tree->numNodes = header[2];
+    tree->numFragments = header[3];
+    tree->origin = (DVector2){ bounds[0], bounds[1] };
+    tree->scale = (DVector2){ bounds[2], bounds[3] };
+    tree->nodes = (BspQuantNode *)malloc(max(tree->numNodes, 1) * sizeof(BspQuantNode));
+    tree->ranges = (BspFragmentRange *)malloc(max(tree->numNodes, 1) * sizeof(BspFragmentRange));
+    tree->fragments = (BspQuantFragment *)malloc(max(tree->numFragments, 1) * sizeof(BspQuantFragment));
+    if (fread(tree->nodes, sizeof(BspQuantNode), tree->numNodes, in) != tree->numNodes
+        || fread(tree->ranges, sizeof(BspFragmentRange), tree->numNodes, in) != tree->numNodes
+        || fread(tree->fragments, sizeof(BspQuantFragment), tree->numFragments, in) != tree->numFragments)
+    {
+        FreeBspQuantTree(tree);
+        return NULL;
+    }
+    /* side tests read every node's first fragment */
+    for (usize i = 0; i < tree->numNodes; i++)
+    {
+        BspFragmentRange range = tree->ranges[i];
+        if (range.count > 0 && range.first < tree->numFragments && range.count <= tree->numFragments - range.first) continue;
+        FreeBspQuantTree(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+DSide
+BspQuantNodeSide(const BspQuantTree *tree, u32 idx, DVector2 pt)
+{
+    return gridSide(tree, idx, gridPoint(tree, pt), pt);
+}
+
+u32
+BspQuantLocatePoint(const BspQuantTree *tree, DVector2 pt, DSide *side)
+{
+    /* same descent as BspFlatLocatePoint */
+    if (tree->numNodes == 0) return BSP_NULL_IDX;
+    DVector2 p = gridPoint(tree, pt);
+    u32 idx = 0;
+    while (true)
+    {
+        /* the left child shares idx's cache line or the next one, only the right one is worth a prefetch (with its splitter's range) */
+        u32 links = tree->nodes[idx].links;
+        if ((links & ~BSP_QUANT_HAS_LEFT) != BSP_QUANT_NO_RIGHT)
+        {
+            BSP_PREFETCH(&tree->nodes[links & ~BSP_QUANT_HAS_LEFT]);
+            BSP_PREFETCH(&tree->ranges[links & ~BSP_QUANT_HAS_LEFT]);
+        }
+        *side = gridSide(tree, idx, p, pt);
+        if (*side == DSideInside) return idx;
+        else if (*side == DSideLeft && (links & ~BSP_QUANT_HAS_LEFT) != BSP_QUANT_NO_RIGHT) idx = links & ~BSP_QUANT_HAS_LEFT;
+        else if (*side == DSideRight && (links & BSP_QUANT_HAS_LEFT)) idx = idx + 1;
+        else return idx;
+    }
+}
+
+const BspQuantFragment *
+BspQuantNodeFragments(const BspQuantTree *tree, u32 idx, usize *numFragments)
+{
+    *numFragments = tree->ranges[idx].count;
+    return &tree->fragments[tree->ranges[idx].first];
+}
+
+DSegment
+BspQuantFragmentSegment(const BspQuantTree *tree, u32 idx, BspQuantFragment fragment)
+{ /*
+   * idx is the node holding the fragment, whose grid its endpoints are on
+   */
+    BspQuantNode node = tree->nodes[idx];
+    DVector2 w = nodeCell(node);
+    DVector2 left = { node.min.x + fragment.left.x * w.x, node.min.y + fragment.left.y * w.y };
+    DVector2 right = { node.min.x + fragment.right.x * w.x, node.min.y + fragment.right.y * w.y };
+    return (DSegment){
+        .left = { tree->origin.x + left.x / tree->scale.x, tree->origin.y + left.y / tree->scale.y },
+        .right = { tree->origin.x + right.x / tree->scale.x, tree->origin.y + right.y / tree->scale.y },
+        .id = fragment.source,
+    };
+}
+
+BspQuantPoint
+quantizePoint(const BspQuantTree *tree, BspQuantNode node, DVector2 pt)
+{
+    DVector2 p = gridPoint(tree, pt), w = nodeCell(node);
+    p = (DVector2){ (p.x - node.min.x) / w.x, (p.y - node.min.y) / w.y };
+    return (BspQuantPoint){ (u16)clamp(round(p.x), 0.0, BSP_QUANT_MAX), (u16)clamp(round(p.y), 0.0, BSP_QUANT_MAX) };
+}
+
+DSide
+gridSide(const BspQuantTree *tree, u32 idx, DVector2 p, DVector2 pt)
+{ /*
+   * worked out in tree grid units. the splitter endpoints (the node's
+   * first fragment) are on the node grid, cells w wide, so each is within
+   * w / 2 of the real one on each axis. writing the real line as direction D - e through A - a, with
+   * |a| <= w / 2 and |e| <= w per axis, and expanding det(D - e, Q + a)
+   * bounds the error of the quantized determinant det(D, Q) by
+   *   (|Dx| wy + |Dy| wx) / 2 + |Qx| wy + |Qy| wx + wx wy
+   * outside of that band the sign can't change, inside of it (or within
+   * BSP_EPSILON of the exact line) the exact tree decides pt. p is pt on
+   * the tree grid, worked out once per query
+   */
+    BspQuantNode node = tree->nodes[idx];
+    BspQuantFragment splitter = tree->fragments[tree->ranges[idx].first];
+    DVector2 w = nodeCell(node);
+    f64 dx = ((f64)splitter.right.x - splitter.left.x) * w.x, dy = ((f64)splitter.right.y - splitter.left.y) * w.y;
+    f64 qx = p.x - (node.min.x + splitter.left.x * w.x), qy = p.y - (node.min.y + splitter.left.y * w.y);
+    f64 det = dx * qy - dy * qx;
+    f64 bound = 0.5 * (babs(dx) * w.y + babs(dy) * w.x) + babs(qx) * w.y + babs(qy) * w.x + w.x * w.y;
+
+    if (babs(det) <= bound + BSP_EPSILON * tree->scale.x * tree->scale.y && tree->exact) return BspFlatNodeSide(tree->exact, idx, pt);
+    else if (babs(det) < BSP_EPSILON * tree->scale.x * tree->scale.y) return DSideInside;
+    else if (det >= 0.0) return DSideLeft;
+    else return DSideRight;
+}
+
+DVector2
+gridPoint(const BspQuantTree *tree, DVector2 pt)
+{
+    return (DVector2){ (pt.x - tree->origin.x) * tree->scale.x, (pt.y - tree->origin.y) * tree->scale.y };
+}
+
+DVector2
+nodeCell(BspQuantNode node)
+{ /*
+   * size of a node grid cell in tree grid units
+   */
+    return (DVector2){ ((f64)node.max.x - node.min.x) * (1.0 / BSP_QUANT_MAX), ((f64)node.max.y - node.min.y) * (1.0 / BSP_QUANT_MAX) };
+}
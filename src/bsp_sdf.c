@@ -0,0 +1,131 @@
+#include "bsp_sdf.h"
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "f64_vector.h"
+#include "parallel.h"
+#include "raylib.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* what the threads of BakeBspSdf share */
+typedef struct SdfBatch {
+    const BspFlatTree *tree;
+    BspSdf *sdf;
+} SdfBatch;
+
+/* ******************** helpers ******************** */
+void bakeSdfRows(void *ctx, usize first, usize last);
+/* ************************************************* */
+
+BspSdf *
+BakeBspSdf(const BspFlatTree *tree, DVector2 origin, f64 cellSize, u32 width, u32 height, f64 maxDistance)
+{
+    if (!tree->cells)
+    {
+        TraceLog(LOG_ERROR, "SDF: tree is not labeled, run LabelBspFlatTree on it first");
+        return NULL;
+    }
+    BspSdf *sdf = (BspSdf *)malloc(sizeof(BspSdf));
+    sdf->distances = (f32 *)malloc(max((usize)width * height, 1) * sizeof(f32));
+    sdf->width = width;
+    sdf->height = height;
+    sdf->origin = origin;
+    sdf->cellSize = cellSize;
+    sdf->maxDistance = maxDistance;
+    SdfBatch batch = { tree, sdf };
+    ParallelFor(height, BSP_SDF_ROW_GRAIN, bakeSdfRows, &batch);
+    return sdf;
+}
+
+void
+bakeSdfRows(void *ctx, usize first, usize last)
+{ /*
+   * a distance field is 1-Lipschitz, the closest wall to a sample is at
+   * most a cell farther than the one to its left neighbour. starting the
+   * search with that bound (plus the BSP_SIDE_SLACK fragments can sit past
+   * their lines) prunes most of the tree right away, and keeps every row
+   * independent of the others
+   */
+    const SdfBatch *batch = (const SdfBatch *)ctx;
+    const BspSdf *sdf = batch->sdf;
+    for (usize y = first; y < last; y++)
+    {
+        f64 previous = INFINITY;
+        for (usize x = 0; x < sdf->width; x++)
+        {
+            DVector2 pt = { sdf->origin.x + x * sdf->cellSize, sdf->origin.y + y * sdf->cellSize };
+            f64 bound = min(sdf->maxDistance, previous + sdf->cellSize + BSP_SIDE_SLACK);
+            BspRayHit hit;
+            if (!BspFlatNearestFragment(batch->tree, pt, bound, &hit) && bound < sdf->maxDistance)
+                BspFlatNearestFragment(batch->tree, pt, sdf->maxDistance, &hit);
+            f64 distance = min(hit.distance, sdf->maxDistance);
+            previous = distance;
+            sdf->distances[y * sdf->width + x] = (f32)(BspFlatContainsPoint(batch->tree, pt) ? -distance : distance);
+        }
+    }
+}
+
+void
+FreeBspSdf(BspSdf *sdf)
+{
+    free(sdf->distances);
+    free(sdf);
+}
+
+f32
+BspSdfSample(const BspSdf *sdf, DVector2 pt)
+{
+    if (sdf->width == 0 || sdf->height == 0) return (f32)sdf->maxDistance;
+    f64 fx = clamp((pt.x - sdf->origin.x) / sdf->cellSize, 0.0, (f64)(sdf->width - 1));
+    f64 fy = clamp((pt.y - sdf->origin.y) / sdf->cellSize, 0.0, (f64)(sdf->height - 1));
+    u32 x0 = (u32)fx, y0 = (u32)fy;
+    u32 x1 = min(x0 + 1, sdf->width - 1), y1 = min(y0 + 1, sdf->height - 1);
+    f64 tx = fx - x0, ty = fy - y0;
+    const f32 *d = sdf->distances;
+    f64 top = d[y0 * sdf->width + x0] * (1.0 - tx) + d[y0 * sdf->width + x1] * tx;
+    f64 bottom = d[y1 * sdf->width + x0] * (1.0 - tx) + d[y1 * sdf->width + x1] * tx;
+    return (f32)(top * (1.0 - ty) + bottom * ty);
+}
+
+bool
+WriteBspSdf(const BspSdf *sdf, FILE *out)
+{ /*
+   * on-disk format (native byte order):
+   *   u32 magic, u32 version, u32 width, u32 height
+   *   f64 origin.x, origin.y, cellSize, maxDistance
+   *   f32[width * height] distances, row by row
+   */
+    u32 header[4] = { BSP_SDF_MAGIC, BSP_SDF_VERSION, sdf->width, sdf->height };
+    f64 grid[4] = { sdf->origin.x, sdf->origin.y, sdf->cellSize, sdf->maxDistance };
+    usize numSamples = (usize)sdf->width * sdf->height;
+    if (fwrite(header, sizeof(u32), 4, out) != 4) return false;
+    if (fwrite(grid, sizeof(f64), 4, out) != 4) return false;
+    if (fwrite(sdf->distances, sizeof(f32), numSamples, out) != numSamples) return false;
+    return true;
+}
+
+BspSdf *
+ReadBspSdf(FILE *in)
+{
+    u32 header[4];
+    f64 grid[4];
+    if (fread(header, sizeof(u32), 4, in) != 4) return NULL;
+    if (header[0] != BSP_SDF_MAGIC || header[1] != BSP_SDF_VERSION) return NULL;
+    if (fread(grid, sizeof(f64), 4, in) != 4) return NULL;
+
+    BspSdf *sdf = (BspSdf *)malloc(sizeof(BspSdf));
+    sdf->width = header[2];
+    sdf->height = header[3];
+    sdf->origin = (DVector2){ grid[0], grid[1] };
+    sdf->cellSize = grid[2];
+    sdf->maxDistance = grid[3];
+    usize numSamples = (usize)sdf->width * sdf->height;
+    sdf->distances = (f32 *)malloc(max(numSamples, 1) * sizeof(f32));
+    if (fread(sdf->distances, sizeof(f32), numSamples, in) != numSamples)
+    {
+        FreeBspSdf(sdf);
+        return NULL;
+    }
+    return sdf;
+}
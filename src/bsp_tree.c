@@ -2,6 +2,7 @@
 #include "bsp.h"
 #include "f64_segment.h"
 #include "f64_vector.h"
+#include "predicates.h"
 #include "raylib.h"
 #include "triangulation.h"
 #include <assert.h>
@@ -16,6 +17,7 @@ BuildBspTree(DSegment *segments, usize len, BspNode *parent)
     node->left = NULL;
     node->right = NULL;
     node->parent = parent ? parent : NULL;
+    node->color = BLANK;
 
     if (len <= 1)
     {
@@ -37,7 +39,7 @@ BuildBspTree(DSegment *segments, usize len, BspNode *parent)
         usize numBehind = 0, numInFront = 0, numInside = 0;
         for (usize i = 0; i < len; i++)
         {
-            switch (DSegmentSides(segments[splitIdx], segments[i]))
+            switch (BspSplitSides(segments[splitIdx], segments[i]))
             {
             case DSideInside:
                 numInside += 1;
@@ -67,11 +69,17 @@ BuildBspTree(DSegment *segments, usize len, BspNode *parent)
         /* second pass - add segments to middle node and recurse into left/right children */
         for (usize i = 0; i < len; i++)
         {
-            switch (DSegmentSides(segments[splitIdx], segments[i]))
+            switch (BspSplitSides(segments[splitIdx], segments[i]))
             {
             /* both endpoints inside split segment => add si to current node segment list */
             case DSideInside:
-                node->segments[insideIdx++] = segments[i];
+                /* splitter goes first, the node's line is taken from segments[0] (regions, flat trees) */
+                if (i == splitIdx && insideIdx > 0)
+                {
+                    node->segments[insideIdx++] = node->segments[0];
+                    node->segments[0] = segments[i];
+                }
+                else node->segments[insideIdx++] = segments[i];
                 break;
 
             /* both endpoints in front of split segment => add si to right segment list */
@@ -90,30 +98,9 @@ BuildBspTree(DSegment *segments, usize len, BspNode *parent)
              *  - insert split subsegments into respective left/right segment lists
              *  - update bools for each subsegment for "free split" check in recursive call
              */
-            case DSideBoth: {
-                segmentsBehind[behindIdx] = segments[i];
-                segmentsInFront[inFrontIdx] = segments[i];
-                DVector2 intersection = DSegmentIntersection(segments[splitIdx], segments[i]);
-
-                if (DSegmentSide(segments[splitIdx], segments[i].left) == DSideRight)
-                {
-                    segmentsBehind[behindIdx].splitRight = true;
-                    segmentsInFront[inFrontIdx].splitLeft = true;
-                    segmentsBehind[behindIdx].right = intersection;
-                    segmentsInFront[inFrontIdx].left = intersection;
-                }
-                else
-                {
-                    segmentsBehind[behindIdx].splitLeft = true;
-                    segmentsInFront[inFrontIdx].splitRight = true;
-                    segmentsBehind[behindIdx].left = intersection;
-                    segmentsInFront[inFrontIdx].right = intersection;
-                }
-
-                behindIdx += 1;
-                inFrontIdx += 1;
-            }
-            break;
+            case DSideBoth:
+                BspSplitSegment(segments[splitIdx], segments[i], &segmentsBehind[behindIdx++], &segmentsInFront[inFrontIdx++]);
+                break;
             }
         }
 
@@ -198,14 +185,19 @@ CopyBspTree(const BspTreeMeta *src, BspTreeMeta *dst)
 BspTreeMeta *
 BuildBspTreeMeta(DSegment *segments, usize len, BoundingRegion region)
 {
+    /* create actual bsp tree */
+    DSegment *segmentsCopy = (DSegment *)malloc(len * sizeof(DSegment));
+    memcpy(segmentsCopy, segments, len * sizeof(DSegment));
+    return WrapBspTreeMeta(BuildBspTree(segmentsCopy, len, NULL), region);
+}
+
+BspTreeMeta *
+WrapBspTreeMeta(BspNode *root, BoundingRegion region)
+{
+    /* takes ownership of root */
     BspTreeMeta *tree = (BspTreeMeta *)malloc(sizeof(BspTreeMeta));
     tree->bounds = region;
-
-    { /* create actual bsp tree */
-        DSegment *segmentsCopy = (DSegment *)malloc(len * sizeof(DSegment));
-        memcpy(segmentsCopy, segments, len * sizeof(DSegment));
-        tree->root = BuildBspTree(segmentsCopy, len, NULL);
-    }
+    tree->root = root;
 
     { /* calculate size of tree */
         tree->size = 0;
@@ -488,3 +480,46 @@ idxParent(BspTreeMeta *tree, usize idx)
     else if (!bspNode(tree, idx)->parent) return tree->size;
     else return tree->meta[idx].parent;
 }
+
+DSide
+BspSplitSides(DSegment splitter, DSegment s)
+{
+    DSide side = DSegmentSides(splitter, s);
+    if (side == DSideInside) return side;
+
+    /* distances to the line compared as determinants, both scaled by the splitter's length */
+    f64 scale = max(max(babs(splitter.left.x), babs(splitter.left.y)), max(babs(splitter.right.x), babs(splitter.right.y)));
+    scale = max(scale, max(max(babs(s.left.x), babs(s.left.y)), max(babs(s.right.x), babs(s.right.y))));
+    f64 tolerance = BSP_SPLIT_TOLERANCE * scale * DVector2Length(DVector2Subtract(splitter.right, splitter.left));
+    f64 leftDet = Orient2D(splitter.left, splitter.right, s.left);
+    f64 rightDet = Orient2D(splitter.left, splitter.right, s.right);
+    bool leftOn = babs(leftDet) < tolerance, rightOn = babs(rightDet) < tolerance;
+
+    if (leftOn && rightOn) return DSideInside;
+    else if (side != DSideBoth) return side;
+    else if (leftOn) return (rightDet > 0.0) ? DSideLeft : DSideRight;
+    else if (rightOn) return (leftDet > 0.0) ? DSideLeft : DSideRight;
+    else return DSideBoth;
+}
+
+void
+BspSplitSegment(DSegment splitter, DSegment s, DSegment *behind, DSegment *inFront)
+{
+    *behind = s;
+    *inFront = s;
+    DVector2 intersection = DSegmentIntersection(splitter, s);
+    if (DSegmentSide(splitter, s.left) == DSideRight)
+    {
+        behind->splitRight = true;
+        inFront->splitLeft = true;
+        behind->right = intersection;
+        inFront->left = intersection;
+    }
+    else
+    {
+        behind->splitLeft = true;
+        inFront->splitRight = true;
+        behind->left = intersection;
+        inFront->right = intersection;
+    }
+}
@@ -0,0 +1,322 @@
+#include "bsp_visibility.h"
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "f64_vector.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * angles around the viewpoint are pseudo-angles in [0, 4), the position
+ * along the diamond |x| + |y| = 1 counterclockwise from (1, 0). they order
+ * directions like true angles without any trigonometry, and turn back
+ * into a direction just as cheaply
+ */
+#define FULL_TURN 4.0
+#define HALF_TURN 2.0
+
+/* occluded or visible angles from lo to hi (counterclockwise) */
+typedef struct VisibilityArc {
+    f64 lo;
+    f64 hi;
+} VisibilityArc;
+
+/* visible angles of the line through a and b */
+typedef struct VisiblePiece {
+    VisibilityArc arc;
+    DVector2 a;
+    DVector2 b;
+} VisiblePiece;
+
+/* state of one BuildBspVisibilityPolygon walk */
+typedef struct VisibilityWalk {
+    const BspFlatTree *tree;
+    DVector2 viewpoint;
+    VisibilityArc *occluded; /* disjoint occluded arcs sorted by angle, never wrapping past FULL_TURN */
+    usize numOccluded;
+    usize occludedCapacity;
+    VisiblePiece *pieces; /* where fragments are seen, disjoint */
+    usize numPieces;
+    usize pieceCapacity;
+} VisibilityWalk;
+
+/* ******************** helpers ******************** */
+void visibilityNode(VisibilityWalk *walk, u32 idx);
+void occludeFragment(VisibilityWalk *walk, DSegment s);
+void occludeArc(VisibilityWalk *walk, VisibilityArc arc, DSegment s);
+void pushVisiblePiece(VisibilityWalk *walk, VisibilityArc arc, DSegment s);
+bool arcOccluded(const VisibilityWalk *walk, VisibilityArc arc);
+bool boxOccluded(const VisibilityWalk *walk, BspBox box);
+bool fullyOccluded(const VisibilityWalk *walk);
+f64 pseudoAngle(DVector2 dir);
+DVector2 pseudoAngleDir(f64 angle);
+DVector2 pieceVertex(const VisibilityWalk *walk, const VisiblePiece *piece, f64 angle);
+int pieceCmp(const void *a, const void *b);
+bool sameVisibilityVertex(DVector2 a, DVector2 b);
+void pushVisibilityVertex(DVector2 **vertices, usize *numVertices, usize *capacity, DVector2 v);
+void pushVisibilityArc(const VisibilityWalk *walk, VisibilityArc arc, f64 radius, DVector2 **vertices, usize *numVertices, usize *capacity);
+/* ************************************************* */
+
+DVector2 *
+BuildBspVisibilityPolygon(const BspFlatTree *tree, DVector2 viewpoint, f64 maxDistance, usize *numVertices)
+{
+    VisibilityWalk walk = { tree, viewpoint, NULL, 0, 0, NULL, 0, 0 };
+    if (tree->numNodes > 0) visibilityNode(&walk, 0);
+    if (walk.numPieces > 1) qsort(walk.pieces, walk.numPieces, sizeof(VisiblePiece), pieceCmp);
+
+    /* the pieces in angle order, each gap between them is an arc at maxDistance */
+    DVector2 *vertices = NULL;
+    usize capacity = 0;
+    *numVertices = 0;
+    f64 angle = 0.0;
+    for (usize i = 0; i < walk.numPieces; i++)
+    {
+        const VisiblePiece *piece = &walk.pieces[i];
+        if (piece->arc.lo > angle) pushVisibilityArc(&walk, (VisibilityArc){ angle, piece->arc.lo }, maxDistance, &vertices, numVertices, &capacity);
+        pushVisibilityVertex(&vertices, numVertices, &capacity, pieceVertex(&walk, piece, piece->arc.lo));
+        pushVisibilityVertex(&vertices, numVertices, &capacity, pieceVertex(&walk, piece, piece->arc.hi));
+        angle = piece->arc.hi;
+    }
+    if (angle < FULL_TURN) pushVisibilityArc(&walk, (VisibilityArc){ angle, FULL_TURN }, maxDistance, &vertices, numVertices, &capacity);
+    /* the walk around ends where it started, at angle 0 */
+    while (*numVertices > 1 && sameVisibilityVertex(vertices[*numVertices - 1], vertices[0]))
+        (*numVertices)--;
+
+    free(walk.pieces);
+    free(walk.occluded);
+    return vertices;
+}
+
+void
+visibilityNode(VisibilityWalk *walk, u32 idx)
+{ /*
+   * the child on the viewpoint's side can hide the node's fragments and
+   * the far child, never the other way around. the far child lies in the
+   * half-plane past the line, which the viewpoint sees through the half
+   * turn of directions heading towards the line
+   */
+    const BspFlatTree *tree = walk->tree;
+    while (idx != BSP_NULL_IDX && !fullyOccluded(walk))
+    {
+        if (tree->bounds && boxOccluded(walk, tree->bounds[idx])) return;
+        const BspFlatNode *node = &tree->nodes[idx];
+        f64 det = BspLineEval(node->line, walk->viewpoint);
+        u32 near = (det > 0.0) ? node->right : node->left;
+        u32 far = (det > 0.0) ? node->left : node->right;
+        visibilityNode(walk, near);
+
+        usize numFragments = 0;
+        const BspFragment *fragments = BspFlatNodeFragments(tree, idx, &numFragments);
+        for (usize i = 0; i < numFragments; i++)
+            occludeFragment(walk, BspFlatFragmentSegment(tree, fragments[i]));
+
+        if (far == BSP_NULL_IDX || babs(det) < BSP_EPSILON) idx = far;
+        else
+        {
+            /* the half turn starts along the line, the way a quarter turn clockwise from heading straight at it */
+            DVector2 along = (det > 0.0) ? (DVector2){ -node->line.b, node->line.a } : (DVector2){ node->line.b, -node->line.a };
+            f64 lo = pseudoAngle(along);
+            idx = arcOccluded(walk, (VisibilityArc){ lo, lo + HALF_TURN }) ? BSP_NULL_IDX : far;
+        }
+    }
+}
+
+void
+occludeFragment(VisibilityWalk *walk, DSegment s)
+{
+    DVector2 p = DVector2Subtract(s.left, walk->viewpoint);
+    DVector2 q = DVector2Subtract(s.right, walk->viewpoint);
+    f64 cross = DVector2Determinant(p, q);
+    /* seen edge on, or too close to it for the angles to be worth anything */
+    if (cross * cross <= BSP_EPSILON * BSP_EPSILON * DVector2DotProduct(p, p) * DVector2DotProduct(q, q)) return;
+    if (cross < 0.0)
+    {
+        DVector2 tmp = p;
+        p = q;
+        q = tmp;
+    }
+    f64 lo = pseudoAngle(p), hi = pseudoAngle(q);
+    if (lo <= hi) occludeArc(walk, (VisibilityArc){ lo, hi }, s);
+    else
+    {
+        occludeArc(walk, (VisibilityArc){ lo, FULL_TURN }, s);
+        occludeArc(walk, (VisibilityArc){ 0.0, hi }, s);
+    }
+}
+
+void
+occludeArc(VisibilityWalk *walk, VisibilityArc arc, DSegment s)
+{ /*
+   * every angle of arc not occluded yet sees the fragment, and the arc
+   * then joins the list, merged with the occluded arcs it overlaps. arcs
+   * meeting at a shared vertex get the same angle for it, so they merge
+   * exactly
+   */
+    usize first = 0, last = walk->numOccluded;
+    while (first < last)
+    {
+        usize mid = (first + last) / 2;
+        if (walk->occluded[mid].hi < arc.lo) first = mid + 1;
+        else last = mid;
+    }
+    f64 angle = arc.lo;
+    usize end = first;
+    for (; end < walk->numOccluded && walk->occluded[end].lo <= arc.hi; end++)
+    {
+        if (walk->occluded[end].lo > angle) pushVisiblePiece(walk, (VisibilityArc){ angle, walk->occluded[end].lo }, s);
+        angle = max(angle, walk->occluded[end].hi);
+    }
+    if (angle < arc.hi) pushVisiblePiece(walk, (VisibilityArc){ angle, arc.hi }, s);
+
+    /* occluded[first, end) overlap arc and become one arc with it, with none it's inserted at first */
+    if (end > first)
+    {
+        arc.lo = min(arc.lo, walk->occluded[first].lo);
+        arc.hi = max(arc.hi, walk->occluded[end - 1].hi);
+    }
+    else if (walk->numOccluded == walk->occludedCapacity)
+    {
+        walk->occludedCapacity = max(2 * walk->occludedCapacity, 8);
+        walk->occluded = (VisibilityArc *)realloc(walk->occluded, walk->occludedCapacity * sizeof(VisibilityArc));
+    }
+    memmove(&walk->occluded[first + 1], &walk->occluded[end], (walk->numOccluded - end) * sizeof(VisibilityArc));
+    walk->numOccluded = walk->numOccluded + 1 - (end - first);
+    walk->occluded[first] = arc;
+}
+
+void
+pushVisiblePiece(VisibilityWalk *walk, VisibilityArc arc, DSegment s)
+{
+    if (walk->numPieces == walk->pieceCapacity)
+    {
+        walk->pieceCapacity = max(2 * walk->pieceCapacity, 8);
+        walk->pieces = (VisiblePiece *)realloc(walk->pieces, walk->pieceCapacity * sizeof(VisiblePiece));
+    }
+    walk->pieces[walk->numPieces++] = (VisiblePiece){ arc, s.left, s.right };
+}
+
+bool
+arcOccluded(const VisibilityWalk *walk, VisibilityArc arc)
+{
+    /* an arc past FULL_TURN wraps around to 0 */
+    if (arc.hi > FULL_TURN && arc.lo >= FULL_TURN) return arcOccluded(walk, (VisibilityArc){ arc.lo - FULL_TURN, arc.hi - FULL_TURN });
+    if (arc.hi > FULL_TURN) return arcOccluded(walk, (VisibilityArc){ arc.lo, FULL_TURN }) && arcOccluded(walk, (VisibilityArc){ 0.0, arc.hi - FULL_TURN });
+    usize first = 0, last = walk->numOccluded;
+    while (first < last)
+    {
+        usize mid = (first + last) / 2;
+        if (walk->occluded[mid].hi < arc.hi) first = mid + 1;
+        else last = mid;
+    }
+    return first < walk->numOccluded && walk->occluded[first].lo <= arc.lo;
+}
+
+bool
+boxOccluded(const VisibilityWalk *walk, BspBox box)
+{ /*
+   * seen from outside, a box spans less than a half turn between two of
+   * its corners. every corner's angle is taken relative to the first
+   * one's to find them without caring where the angles wrap. a box with
+   * the viewpoint in it (or nearly) can't be occluded, and an empty one
+   * (no fragments below) has nothing to see
+   */
+    if (box.min.x > box.max.x) return true;
+    DVector2 v = walk->viewpoint;
+    f64 margin = sqrt(BSP_EPSILON);
+    if (v.x >= box.min.x - margin && v.x <= box.max.x + margin && v.y >= box.min.y - margin && v.y <= box.max.y + margin) return false;
+
+    DVector2 corners[4] = { box.min, { box.max.x, box.min.y }, box.max, { box.min.x, box.max.y } };
+    f64 base = pseudoAngle(DVector2Subtract(corners[0], v));
+    f64 lo = 0.0, hi = 0.0;
+    for (usize i = 1; i < 4; i++)
+    {
+        f64 relative = pseudoAngle(DVector2Subtract(corners[i], v)) - base;
+        if (relative > HALF_TURN) relative -= FULL_TURN;
+        else if (relative < -HALF_TURN) relative += FULL_TURN;
+        lo = min(lo, relative);
+        hi = max(hi, relative);
+    }
+    lo += base;
+    if (lo < 0.0) return arcOccluded(walk, (VisibilityArc){ lo + FULL_TURN, hi + base + FULL_TURN });
+    return arcOccluded(walk, (VisibilityArc){ lo, hi + base });
+}
+
+bool
+fullyOccluded(const VisibilityWalk *walk)
+{
+    return walk->numOccluded == 1 && walk->occluded[0].lo <= 0.0 && walk->occluded[0].hi >= FULL_TURN;
+}
+
+f64
+pseudoAngle(DVector2 dir)
+{
+    f64 p = dir.y / (babs(dir.x) + babs(dir.y));
+    if (dir.x < 0.0) return HALF_TURN - p;
+    if (dir.y < 0.0) return FULL_TURN + p;
+    return p;
+}
+
+DVector2
+pseudoAngleDir(f64 angle)
+{
+    if (angle < 1.0) return (DVector2){ 1.0 - angle, angle };
+    if (angle < 2.0) return (DVector2){ 1.0 - angle, 2.0 - angle };
+    if (angle < 3.0) return (DVector2){ angle - 3.0, 2.0 - angle };
+    return (DVector2){ angle - 3.0, angle - 4.0 };
+}
+
+DVector2
+pieceVertex(const VisibilityWalk *walk, const VisiblePiece *piece, f64 angle)
+{
+    /* where the ray from the viewpoint at angle meets the piece's line */
+    DVector2 dir = pseudoAngleDir(angle);
+    DVector2 e = DVector2Subtract(piece->b, piece->a);
+    f64 t = DVector2Determinant(DVector2Subtract(piece->a, walk->viewpoint), e) / DVector2Determinant(dir, e);
+    return (DVector2){ walk->viewpoint.x + t * dir.x, walk->viewpoint.y + t * dir.y };
+}
+
+int
+pieceCmp(const void *a, const void *b)
+{
+    f64 la = ((const VisiblePiece *)a)->arc.lo;
+    f64 lb = ((const VisiblePiece *)b)->arc.lo;
+    return (la > lb) - (la < lb);
+}
+
+bool
+sameVisibilityVertex(DVector2 a, DVector2 b)
+{
+    /* DVector2DIsEqual's tolerance would drop the ends of short pieces and bend the edges next to them */
+    DVector2 d = DVector2Subtract(a, b);
+    return DVector2DotProduct(d, d) <= BSP_EPSILON * BSP_EPSILON;
+}
+
+void
+pushVisibilityVertex(DVector2 **vertices, usize *numVertices, usize *capacity, DVector2 v)
+{
+    /* pieces meeting at a shared wall vertex give it twice */
+    if (*numVertices > 0 && sameVisibilityVertex((*vertices)[*numVertices - 1], v)) return;
+    if (*numVertices == *capacity)
+    {
+        *capacity = max(2 * *capacity, 16);
+        *vertices = (DVector2 *)realloc(*vertices, *capacity * sizeof(DVector2));
+    }
+    (*vertices)[(*numVertices)++] = v;
+}
+
+void
+pushVisibilityArc(const VisibilityWalk *walk, VisibilityArc arc, f64 radius, DVector2 **vertices, usize *numVertices, usize *capacity)
+{
+    /* true angles from here on, to space the arc's vertices evenly */
+    DVector2 from = pseudoAngleDir(arc.lo), to = pseudoAngleDir(arc.hi);
+    f64 start = atan2(from.y, from.x), end = atan2(to.y, to.x);
+    if (start < 0.0) start += 2.0 * PI;
+    if (end < 0.0 || arc.hi >= FULL_TURN) end += 2.0 * PI;
+    f64 sweep = max(end - start, 0.0);
+    usize numSteps = max((usize)ceil(sweep / BSP_VISIBILITY_ARC_STEP), 1);
+    for (usize i = 0; i <= numSteps; i++)
+    {
+        f64 angle = start + sweep * i / numSteps;
+        pushVisibilityVertex(vertices, numVertices, capacity, (DVector2){ walk->viewpoint.x + radius * cos(angle), walk->viewpoint.y + radius * sin(angle) });
+    }
+}
@@ -5,42 +5,30 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* ************************ helpers ************************ */
+DCEL *allocDCEL(usize numVertices, usize numFaces, usize numHalfEdges, usize numComponents);
+void initFace(FaceEntry *face);
+bool segmentRingContainsPoint(const DSegment *ring, usize size, DVector2 pt);
+f64 segmentRingArea(const DSegment *ring, usize size);
+/* ********************************************************* */
+
 DCEL *
 NewDCEL(usize numVertices, usize numFaces, usize numHalfEdges)
 {
-    assert(numVertices >= 3);
-    assert(numFaces >= 2);
-    assert(numHalfEdges >= 6);
-    assert(numFaces - (numHalfEdges / 2) + numVertices == 2);
-    DCEL *dcel = (DCEL *)malloc(sizeof(DCEL));
-    dcel->vertices = (VertexEntry **)malloc(numVertices * sizeof(VertexEntry *));
-    for (usize i = 0; i < numVertices; i++)
-        dcel->vertices[i] = (VertexEntry *)malloc(sizeof(VertexEntry));
-    dcel->faces = (FaceEntry **)malloc(numFaces * sizeof(FaceEntry *));
-    for (usize i = 0; i < numFaces; i++)
-        dcel->faces[i] = (FaceEntry *)malloc(sizeof(FaceEntry));
-    dcel->halfEdges = (HalfEdgeEntry **)malloc(numHalfEdges * 2 * sizeof(HalfEdgeEntry *));
-    for (usize i = 0; i < numHalfEdges; i++)
-        dcel->halfEdges[i] = (HalfEdgeEntry *)malloc(sizeof(HalfEdgeEntry));
-    dcel->numVertices = numVertices;
-    dcel->numFaces = numFaces;
-    dcel->numHalfEdges = numHalfEdges;
-    dcel->openVertex = 0;
-    dcel->openFace = 0;
-    dcel->openHalfEdge = 0;
-    return dcel;
+    return allocDCEL(numVertices, numFaces, numHalfEdges, 1);
 }
 
 void
-ResizeDCEL(DCEL *dcel, usize numVertices, usize numFaces, usize numHalfEdges)
+ResizeDCEL(DCEL *dcel, usize numVertices, usize numFaces, usize numHalfEdges, usize numComponents)
 {
+    /* sizes (and component count) the dcel will have once everything planned is added */
     assert(numVertices >= dcel->numVertices);
     assert(numFaces >= dcel->numFaces);
     assert(numHalfEdges >= dcel->numHalfEdges);
     assert(numVertices >= 3);
     assert(numFaces >= 2);
     assert(numHalfEdges >= 6);
-    assert(numFaces - (numHalfEdges / 2) + numVertices == 2);
+    assert(numFaces - (numHalfEdges / 2) + numVertices == 1 + numComponents);
     VertexEntry **vertices = (VertexEntry **)malloc(numVertices * sizeof(VertexEntry *));
     FaceEntry **faces = (FaceEntry **)malloc(numFaces * sizeof(FaceEntry *));
     HalfEdgeEntry **halfEdges = (HalfEdgeEntry **)malloc(numHalfEdges * sizeof(HalfEdgeEntry *));
@@ -52,7 +40,11 @@ ResizeDCEL(DCEL *dcel, usize numVertices, usize numFaces, usize numHalfEdges)
     for (usize i = 0; i < numFaces; i++)
     {
         if (i < dcel->numFaces) faces[i] = dcel->faces[i];
-        else faces[i] = (FaceEntry *)malloc(sizeof(FaceEntry));
+        else
+        {
+            faces[i] = (FaceEntry *)malloc(sizeof(FaceEntry));
+            initFace(faces[i]);
+        }
     }
     for (usize i = 0; i < numHalfEdges; i++)
     {
@@ -76,43 +68,98 @@ ResizeDCEL(DCEL *dcel, usize numVertices, usize numFaces, usize numHalfEdges)
 DCEL *
 BuildSimpleDCEL(DSegment *segments, usize numSegments)
 {
-    assert(numSegments >= 1);
-    DCEL *dcel = NewDCEL(numSegments, 2, numSegments * 2);
+    RingKind kind = RingOuter;
+    return BuildDCEL(segments, &numSegments, &kind, 1);
+}
+
+DCEL *
+BuildDCEL(DSegment *segments, const usize *ringSizes, const RingKind *ringKinds, usize numRings)
+{ /*
+   * segment i becomes half-edge 2i (along it) and its twin 2i + 1, ring r
+   * the face r + 1 and face 0 is the unbounded one. the segments of a ring
+   * follow each other (right end of one is left end of the next).
+   *
+   * along half-edges bound the inside of an outer ring, for a hole they run
+   * around the outside (BuildPolygonSegments winds holes the other way), so
+   * they're an inner component of the face around it and the twins bound
+   * the hole's own face
+   */
+    usize numSegments = 0;
+    for (usize r = 0; r < numRings; r++)
+        numSegments += ringSizes[r];
+    assert(numRings >= 1);
+    DCEL *dcel = allocDCEL(numSegments, numRings + 1, numSegments * 2, numRings);
+
+    /* ring every ring sits in directly (smallest one containing it, numRings => none) */
+    usize *starts = (usize *)malloc(numRings * sizeof(usize));
+    usize *parents = (usize *)malloc(numRings * sizeof(usize));
+    f64 *areas = (f64 *)malloc(numRings * sizeof(f64));
+    for (usize r = 0, start = 0; r < numRings; start += ringSizes[r++])
     {
-        for (usize i = 0; i < numSegments; i++)
+        starts[r] = start;
+        areas[r] = babs(segmentRingArea(&segments[start], ringSizes[r]));
+    }
+    for (usize r = 0; r < numRings; r++)
+    {
+        parents[r] = numRings;
+        for (usize k = 0; k < numRings; k++)
         {
-            dcel->vertices[i]->coordinates = segments[i].left;
-            dcel->vertices[i]->incidentEdge = dcel->halfEdges[2 * i];
+            if (k == r || (parents[r] < numRings && areas[k] >= areas[parents[r]])) continue;
+            if (segmentRingContainsPoint(&segments[starts[k]], ringSizes[k], segments[starts[r]].left)) parents[r] = k;
         }
+    }
+
+    { /* faces, each ring's boundary on the other side is an inner component of the face around it */
+        for (usize r = 0; r < numRings; r++)
         {
-            /* outer face (even edges move counter-clockwise) */
-            dcel->faces[0]->innerComponents = (HalfEdgeEntry **)malloc(1 * sizeof(HalfEdgeEntry *));
-            dcel->faces[0]->numInnerComponents = 1;
-            dcel->faces[0]->innerComponents[0] = dcel->halfEdges[1];
-            dcel->faces[0]->outerComponent = NULL;
-            /* inner face (odd edges move clockwise) */
-            dcel->faces[1]->numInnerComponents = 0;
-            dcel->faces[1]->innerComponents = NULL;
-            dcel->faces[1]->outerComponent = dcel->halfEdges[0];
+            FaceEntry *around = dcel->faces[(parents[r] < numRings) ? parents[r] + 1 : 0];
+            around->numInnerComponents += 1;
+            dcel->faces[r + 1]->hole = (ringKinds[r] == RingHole);
         }
-        for (usize j = 0; j < numSegments; j++)
+        for (usize f = 0; f < dcel->numFaces; f++)
         {
-            usize i = mod(j - 1, numSegments);
-            usize k = mod(j + 1, numSegments);
-            /* inside half-edge (counter-clockwise) */
-            dcel->halfEdges[2 * j]->origin = dcel->vertices[j];
-            dcel->halfEdges[2 * j]->twin = dcel->halfEdges[2 * j + 1];
-            dcel->halfEdges[2 * j]->incidentFace = dcel->faces[1];
-            dcel->halfEdges[2 * j]->next = dcel->halfEdges[2 * k];
-            dcel->halfEdges[2 * j]->prev = dcel->halfEdges[2 * i];
-            /* outside half-edge (clockwise) */
-            dcel->halfEdges[2 * j + 1]->origin = dcel->vertices[k];
-            dcel->halfEdges[2 * j + 1]->twin = dcel->halfEdges[2 * j];
-            dcel->halfEdges[2 * j + 1]->incidentFace = dcel->faces[0];
-            dcel->halfEdges[2 * j + 1]->next = dcel->halfEdges[2 * i + 1];
-            dcel->halfEdges[2 * j + 1]->prev = dcel->halfEdges[2 * k + 1];
+            FaceEntry *face = dcel->faces[f];
+            if (face->numInnerComponents > 0) face->innerComponents = (HalfEdgeEntry **)malloc(face->numInnerComponents * sizeof(HalfEdgeEntry *));
+            face->numInnerComponents = 0;
         }
     }
+
+    for (usize r = 0; r < numRings; r++)
+    {
+        usize start = starts[r], size = ringSizes[r];
+        FaceEntry *inside = dcel->faces[r + 1];
+        FaceEntry *around = dcel->faces[(parents[r] < numRings) ? parents[r] + 1 : 0];
+        FaceEntry *alongFace = (ringKinds[r] == RingOuter) ? inside : around;
+        FaceEntry *twinFace = (ringKinds[r] == RingOuter) ? around : inside;
+        for (usize j = 0; j < size; j++)
+        {
+            usize v = start + j;
+            usize u = start + mod(j - 1, size);
+            usize w = start + mod(j + 1, size);
+            dcel->vertices[v]->coordinates = segments[v].left;
+            dcel->vertices[v]->incidentEdge = dcel->halfEdges[2 * v];
+            /* half-edge along the segment */
+            dcel->halfEdges[2 * v]->origin = dcel->vertices[v];
+            dcel->halfEdges[2 * v]->twin = dcel->halfEdges[2 * v + 1];
+            dcel->halfEdges[2 * v]->incidentFace = alongFace;
+            dcel->halfEdges[2 * v]->next = dcel->halfEdges[2 * w];
+            dcel->halfEdges[2 * v]->prev = dcel->halfEdges[2 * u];
+            /* half-edge against the segment */
+            dcel->halfEdges[2 * v + 1]->origin = dcel->vertices[w];
+            dcel->halfEdges[2 * v + 1]->twin = dcel->halfEdges[2 * v];
+            dcel->halfEdges[2 * v + 1]->incidentFace = twinFace;
+            dcel->halfEdges[2 * v + 1]->next = dcel->halfEdges[2 * u + 1];
+            dcel->halfEdges[2 * v + 1]->prev = dcel->halfEdges[2 * w + 1];
+        }
+        HalfEdgeEntry *insideEdge = dcel->halfEdges[2 * start + ((ringKinds[r] == RingOuter) ? 0 : 1)];
+        HalfEdgeEntry *outsideEdge = dcel->halfEdges[2 * start + ((ringKinds[r] == RingOuter) ? 1 : 0)];
+        inside->outerComponent = insideEdge;
+        around->innerComponents[around->numInnerComponents++] = outsideEdge;
+    }
+    free(starts);
+    free(parents);
+    free(areas);
+
     dcel->openVertex = dcel->numVertices;
     dcel->openFace = dcel->numFaces;
     dcel->openHalfEdge = dcel->numHalfEdges;
@@ -126,7 +173,7 @@ FreeDCEL(DCEL *dcel)
         free(dcel->vertices[i]);
     for (usize i = 0; i < dcel->numFaces; i++)
     {
-        if (dcel->faces[i]->numInnerComponents > 0) free(dcel->faces[i]->innerComponents);
+        free(dcel->faces[i]->innerComponents);
         free(dcel->faces[i]);
     }
     for (usize i = 0; i < dcel->numHalfEdges; i++)
@@ -140,13 +187,7 @@ FreeDCEL(DCEL *dcel)
 void
 AddDiagonalDCEL(DCEL *dcel, VertexEntry *v1, VertexEntry *v2)
 {
-    assert(dcel->openHalfEdge + 2 <= dcel->numHalfEdges);
-    assert(dcel->openFace + 1 <= dcel->numFaces);
-
-    FaceEntry *f1 = v1->incidentEdge->incidentFace;              /* old face getting split by diagonal */
-    FaceEntry *f2 = dcel->faces[dcel->openFace];                 /* new face introducted by split */
-    HalfEdgeEntry *e1 = dcel->halfEdges[dcel->openHalfEdge];     /* v1 -> v2 half-edge (incident to old face) */
-    HalfEdgeEntry *e2 = dcel->halfEdges[dcel->openHalfEdge + 1]; /* v2 -> v1 half-edge (incident to new face) */
+    FaceEntry *f1 = v1->incidentEdge->incidentFace;
 
     { /*
        * before adding diagonal between v1 and v2, they must first agree on the
@@ -172,25 +213,45 @@ AddDiagonalDCEL(DCEL *dcel, VertexEntry *v1, VertexEntry *v2)
         assert(v1->incidentEdge->incidentFace == v2->incidentEdge->incidentFace);
     }
 
+    SplitFaceDCEL(dcel, v1->incidentEdge, v2->incidentEdge);
+}
+
+void
+SplitFaceDCEL(DCEL *dcel, HalfEdgeEntry *from, HalfEdgeEntry *to)
+{ /*
+   * from and to leave v1 and v2 on the same face, the diagonal v1 -> v2
+   * keeps the old face (with to and the edges after it) and the new face
+   * gets v2 -> v1 with from and the edges after it
+   */
+    assert(dcel->openHalfEdge + 2 <= dcel->numHalfEdges);
+    assert(dcel->openFace + 1 <= dcel->numFaces);
+    assert(from->incidentFace == to->incidentFace);
+
+    FaceEntry *f1 = from->incidentFace;                          /* old face getting split by diagonal */
+    FaceEntry *f2 = dcel->faces[dcel->openFace];                 /* new face introducted by split */
+    HalfEdgeEntry *e1 = dcel->halfEdges[dcel->openHalfEdge];     /* v1 -> v2 half-edge (incident to old face) */
+    HalfEdgeEntry *e2 = dcel->halfEdges[dcel->openHalfEdge + 1]; /* v2 -> v1 half-edge (incident to new face) */
+
     f1->outerComponent = e1;
     f2->numInnerComponents = 0;
     f2->innerComponents = NULL;
     f2->outerComponent = e2;
+    f2->hole = f1->hole;
 
-    e1->origin = v1;
-    e2->origin = v2;
+    e1->origin = from->origin;
+    e2->origin = to->origin;
     e1->twin = e2;
     e2->twin = e1;
 
-    e1->next = v2->incidentEdge;
-    e1->prev = v1->incidentEdge->prev;
-    e2->next = v1->incidentEdge;
-    e2->prev = v2->incidentEdge->prev;
+    e1->next = to;
+    e1->prev = from->prev;
+    e2->next = from;
+    e2->prev = to->prev;
 
-    v1->incidentEdge->prev->next = e1;
-    v2->incidentEdge->prev->next = e2;
-    v1->incidentEdge->prev = e2;
-    v2->incidentEdge->prev = e1;
+    from->prev->next = e1;
+    to->prev->next = e2;
+    from->prev = e2;
+    to->prev = e1;
 
     e1->incidentFace = f1;
     e2->incidentFace = f2;
@@ -202,6 +263,54 @@ AddDiagonalDCEL(DCEL *dcel, VertexEntry *v1, VertexEntry *v2)
     dcel->openFace += 1;
 }
 
+void
+AddBridgeDCEL(DCEL *dcel, HalfEdgeEntry *outer, HalfEdgeEntry *inner)
+{ /*
+   * outer leaves v1 on the outer boundary of a face and inner leaves v2 on
+   * one of its inner components. the edge v1 <-> v2 joins the inner
+   * component into the outer boundary without splitting the face, walking
+   * the boundary now goes v1 -> v2, around the hole and back v2 -> v1
+   */
+    assert(dcel->openHalfEdge + 2 <= dcel->numHalfEdges);
+    assert(outer->incidentFace == inner->incidentFace);
+    FaceEntry *face = outer->incidentFace;
+
+    { /* the inner component stops being one */
+        usize k = 0;
+        for (; k < face->numInnerComponents; k++)
+        {
+            HalfEdgeEntry *e = face->innerComponents[k];
+            while (e != inner && e->next != face->innerComponents[k])
+                e = e->next;
+            if (e == inner) break;
+        }
+        assert(k < face->numInnerComponents);
+        face->innerComponents[k] = face->innerComponents[--face->numInnerComponents];
+    }
+
+    HalfEdgeEntry *e1 = dcel->halfEdges[dcel->openHalfEdge];     /* v1 -> v2 half-edge */
+    HalfEdgeEntry *e2 = dcel->halfEdges[dcel->openHalfEdge + 1]; /* v2 -> v1 half-edge */
+    e1->origin = outer->origin;
+    e2->origin = inner->origin;
+    e1->twin = e2;
+    e2->twin = e1;
+    e1->incidentFace = face;
+    e2->incidentFace = face;
+
+    e1->next = inner;
+    e1->prev = outer->prev;
+    e2->next = outer;
+    e2->prev = inner->prev;
+
+    outer->prev->next = e1;
+    inner->prev->next = e2;
+    outer->prev = e2;
+    inner->prev = e1;
+
+    dcel->openHalfEdge += 2;
+    dcel->numComponents -= 1;
+}
+
 void
 PrintDCEL(DCEL *dcel)
 {
@@ -227,3 +336,65 @@ PrintDCEL(DCEL *dcel)
         printf("\n");
     }
 }
+
+DCEL *
+allocDCEL(usize numVertices, usize numFaces, usize numHalfEdges, usize numComponents)
+{
+    assert(numVertices >= 3);
+    assert(numFaces >= 2);
+    assert(numHalfEdges >= 6);
+    assert(numFaces - (numHalfEdges / 2) + numVertices == 1 + numComponents);
+    DCEL *dcel = (DCEL *)malloc(sizeof(DCEL));
+    dcel->vertices = (VertexEntry **)malloc(numVertices * sizeof(VertexEntry *));
+    for (usize i = 0; i < numVertices; i++)
+        dcel->vertices[i] = (VertexEntry *)malloc(sizeof(VertexEntry));
+    dcel->faces = (FaceEntry **)malloc(numFaces * sizeof(FaceEntry *));
+    for (usize i = 0; i < numFaces; i++)
+    {
+        dcel->faces[i] = (FaceEntry *)malloc(sizeof(FaceEntry));
+        initFace(dcel->faces[i]);
+    }
+    dcel->halfEdges = (HalfEdgeEntry **)malloc(numHalfEdges * sizeof(HalfEdgeEntry *));
+    for (usize i = 0; i < numHalfEdges; i++)
+        dcel->halfEdges[i] = (HalfEdgeEntry *)malloc(sizeof(HalfEdgeEntry));
+    dcel->numVertices = numVertices;
+    dcel->numFaces = numFaces;
+    dcel->numHalfEdges = numHalfEdges;
+    dcel->numComponents = numComponents;
+    dcel->openVertex = 0;
+    dcel->openFace = 0;
+    dcel->openHalfEdge = 0;
+    return dcel;
+}
+
+void
+initFace(FaceEntry *face)
+{
+    face->outerComponent = NULL;
+    face->innerComponents = NULL;
+    face->numInnerComponents = 0;
+    face->hole = false;
+}
+
+bool
+segmentRingContainsPoint(const DSegment *ring, usize size, DVector2 pt)
+{
+    /* even-odd rule, crossings of a ray from pt towards +x */
+    bool inside = false;
+    for (usize i = 0; i < size; i++)
+    {
+        DVector2 a = ring[i].left, b = ring[i].right;
+        if ((a.y > pt.y) == (b.y > pt.y)) continue;
+        if (pt.x < a.x + (pt.y - a.y) * (b.x - a.x) / (b.y - a.y)) inside = !inside;
+    }
+    return inside;
+}
+
+f64
+segmentRingArea(const DSegment *ring, usize size)
+{
+    f64 area = 0.0;
+    for (usize i = 0; i < size; i++)
+        area += (ring[i].left.x * ring[i].right.y) - (ring[i].right.x * ring[i].left.y);
+    return area / 2.0;
+}
@@ -2,82 +2,119 @@
 #include "bsp.h"
 #include "f64_vector.h"
 #include "i32_vector.h"
+#include "polygon.h"
+#include "predicates.h"
 #include "raylib.h"
 #include "raymath.h"
 #include "stdlib.h"
 #include <assert.h>
-#include <limits.h>
+#include <float.h>
 #include <stdlib.h>
 
 DSegment *
 BuildSegments(IVector2 *polygon, usize numVertices, BoundingRegion region, usize *size)
 {
-    u32 width = region.right - region.left;
-    u32 height = region.bottom - region.top;
+    Polygon *rings = PolygonFromGrid(polygon, numVertices);
+    DSegment *segments = BuildPolygonSegments(rings, region, size);
+    FreePolygon(rings);
+    return segments;
+}
 
-    usize numSegments = numVertices;
+DSegment *
+BuildPolygonSegments(const Polygon *polygon, BoundingRegion region, usize *size)
+{
+    usize numSegments = polygon->numVertices;
     DSegment *segments = (DSegment *)malloc(numSegments * sizeof(DSegment));
 
     /* we want to resize the polygon from stage one to fit our stage 2 split screen */
-    u32 xMin = UINT_MAX, yMin = UINT_MAX, xMax = 0, yMax = 0;
-    for (usize i = 0; i < numVertices; i++)
-    {
-        if (polygon[i].x < xMin) xMin = polygon[i].x;
-        if (polygon[i].x > xMax) xMax = polygon[i].x;
-        if (polygon[i].y < yMin) yMin = polygon[i].y;
-        if (polygon[i].y > yMax) yMax = polygon[i].y;
-    }
+    PolygonFit fit = FitPolygon(polygon, region);
+    f64 scale = fit.scale;
+    f64 xPadding = fit.padding.x;
+    f64 yPadding = fit.padding.y;
 
-    /*
-     * signedArea > 0 => segments ordered counter-clockwise
-     * signedArea < 0 => segments ordered clockwise
-     */
-    f32 signedArea = 0.0f;
-    for (usize i = 0; i < numSegments; i++)
+    usize ringStart = 0;
+    for (usize r = 0; r < polygon->numRings; r++)
     {
-        usize j = (i + 1) % numSegments;
-        signedArea += (polygon[i].x * polygon[j].y) - (polygon[j].x * polygon[i].y);
-    }
-    signedArea /= 2.0f;
+        usize ringSize = polygon->ringSizes[r];
+        const DVector2 *ring = &polygon->vertices[ringStart];
 
-    f64 scale = min((f64)width / (xMax - xMin), (f64)height / (yMax - yMin)) * 0.9;
-    f64 xPadding = (width - (xMax + xMin) * scale) / 2.0f + region.left;
-    f64 yPadding = (height - (yMax + yMin) * scale) / 2.0f + region.top;
-
-    for (usize i = 0; i < numSegments; i++)
-    {
-        usize j = (i + 1) % numSegments;
-        usize leftIdx, rightIdx, segmentIdx;
-        if (signedArea >= 0.0f)
+        /*
+         * signedArea > 0 => segments ordered counter-clockwise
+         * signedArea < 0 => segments ordered clockwise
+         *
+         * outer rings are kept counter-clockwise and holes clockwise, so the
+         * inside of the polygon is on the same side of every segment
+         */
+        f64 signedArea = 0.0;
+        for (usize i = 0; i < ringSize; i++)
         {
-            leftIdx = i;
-            rightIdx = j;
-            segmentIdx = i;
+            usize j = (i + 1) % ringSize;
+            signedArea += (ring[i].x * ring[j].y) - (ring[j].x * ring[i].y);
         }
-        else
+        signedArea /= 2.0;
+        bool forward = (signedArea >= 0.0) == (polygon->ringKinds[r] == RingOuter);
+
+        for (usize i = 0; i < ringSize; i++)
         {
-            leftIdx = j;
-            rightIdx = i;
-            segmentIdx = numSegments - 1 - i;
+            usize j = (i + 1) % ringSize;
+            usize leftIdx, rightIdx, segmentIdx;
+            if (forward)
+            {
+                leftIdx = i;
+                rightIdx = j;
+                segmentIdx = i;
+            }
+            else
+            {
+                leftIdx = j;
+                rightIdx = i;
+                segmentIdx = ringSize - 1 - i;
+            }
+            segments[ringStart + segmentIdx] = (DSegment){
+                .left = (DVector2) {
+                    .x = scale * ring[leftIdx].x + xPadding,
+                    .y = scale * ring[leftIdx].y + yPadding,
+                },
+                .right = (DVector2){
+                    .x = scale * ring[rightIdx].x + xPadding,
+                    .y = scale * ring[rightIdx].y + yPadding,
+                },
+                .splitLeft = false,
+                .splitRight = false,
+                .id = (u32)(ringStart + segmentIdx),
+            };
         }
-        segments[segmentIdx] = (DSegment){
-            .left = (DVector2) {
-                .x = (f64)scale * polygon[leftIdx].x + xPadding,
-                .y = (f64)scale * polygon[leftIdx].y + yPadding,
-            },
-            .right = (DVector2){
-                .x = (f64)scale * polygon[rightIdx].x + xPadding,
-                .y = (f64)scale * polygon[rightIdx].y + yPadding,
-            },
-            .splitLeft = false,
-            .splitRight = false,
-        };
+        ringStart += ringSize;
     }
 
     *size = numSegments;
     return segments;
 }
 
+PolygonFit
+FitPolygon(const Polygon *polygon, BoundingRegion region)
+{
+    u32 width = region.right - region.left;
+    u32 height = region.bottom - region.top;
+    f64 xMin = DBL_MAX, yMin = DBL_MAX, xMax = -DBL_MAX, yMax = -DBL_MAX;
+    for (usize i = 0; i < polygon->numVertices; i++)
+    {
+        if (polygon->vertices[i].x < xMin) xMin = polygon->vertices[i].x;
+        if (polygon->vertices[i].x > xMax) xMax = polygon->vertices[i].x;
+        if (polygon->vertices[i].y < yMin) yMin = polygon->vertices[i].y;
+        if (polygon->vertices[i].y > yMax) yMax = polygon->vertices[i].y;
+    }
+
+    f64 scale = min((f64)width / (xMax - xMin), (f64)height / (yMax - yMin)) * 0.9;
+    return (PolygonFit){
+        .scale = scale,
+        .padding = (DVector2){
+            .x = (width - (xMax + xMin) * scale) / 2.0f + region.left,
+            .y = (height - (yMax + yMin) * scale) / 2.0f + region.top,
+        },
+    };
+}
+
 void
 FreeSegments(DSegment *segments)
 {
@@ -125,26 +162,28 @@ DSegmentPointDeterminant(DSegment s, DVector2 pt)
 DSide
 DSegmentSide(DSegment s, DVector2 pt)
 {
-    DVector2 pq = DVector2Subtract(s.right, s.left);
-    DVector2 pr = DVector2Subtract(pt, s.left);
-    f64 det = DVector2Determinant(pq, pr);
-    if (babs(det) < BSP_EPSILON) return DSideInside;
-    else if (det >= 0.0) return DSideLeft;
+    /* exact sign of the determinant, so only points exactly on the line are inside */
+    f64 det = Orient2D(s.left, s.right, pt);
+    if (det == 0.0) return DSideInside;
+    else if (det > 0.0) return DSideLeft;
     else return DSideRight;
 }
 
 DSide
 DSegmentSides(DSegment u, DSegment v)
-{
-    DVector2 pq = DVector2Subtract(u.right, u.left);
-    DVector2 pr = DVector2Subtract(v.left, u.left);
-    DVector2 ps = DVector2Subtract(v.right, u.left);
-    f64 leftSide = DVector2Determinant(pq, pr);
-    f64 rightSide = DVector2Determinant(pq, ps);
-    if (babs(leftSide) < BSP_EPSILON && babs(rightSide) < BSP_EPSILON) return DSideInside;
-    else if (leftSide + BSP_EPSILON > 0 && rightSide + BSP_EPSILON > 0) return DSideLeft;
-    else if (leftSide - BSP_EPSILON < 0 && rightSide - BSP_EPSILON < 0) return DSideRight;
-    else return DSideBoth;
+{ /*
+   * an endpoint on the line goes with the other one, since both signs are
+   * exact every pair of segments gets one consistent answer whichever order
+   * they're tested in
+   */
+    static const DSide sides[3][3] = {
+        { DSideRight, DSideRight, DSideBoth },
+        { DSideRight, DSideInside, DSideLeft },
+        { DSideBoth, DSideLeft, DSideLeft },
+    };
+    f64 leftSide = Orient2D(u.left, u.right, v.left);
+    f64 rightSide = Orient2D(u.left, u.right, v.right);
+    return sides[sign(leftSide) + 1][sign(rightSide) + 1];
 }
 
 DVector2
@@ -190,9 +229,7 @@ DSegmentContainsPoint(DSegment s, DVector2 pt)
 bool
 DSegmentsParallel(DSegment s1, DSegment s2)
 {
-    DVector2 pq = DVector2Subtract(s1.right, s1.left);
-    DVector2 rs = DVector2Subtract(s2.right, s2.left);
-    return babs(DVector2Determinant(pq, rs)) < BSP_EPSILON;
+    return CrossDiff(s1.left, s1.right, s2.left, s2.right) == 0.0;
 }
 
 bool
@@ -200,3 +237,48 @@ DSegmentsIntersect(DSegment s1, DSegment s2)
 {
     return (DSegmentSide(s1, s2.left) != DSegmentSide(s1, s2.right)) && (DSegmentSide(s2, s1.left) != DSegmentSide(s2, s1.right));
 }
+
+bool
+DSegmentRayHit(DSegment s, DVector2 origin, DVector2 dir, f64 *t)
+{ /*
+   * origin + t * dir == left + u * (right - left) with t >= 0 and u in
+   * [0, 1]. a ray along the segment's own line never counts as a hit, its
+   * ends are found on the segments meeting it there
+   */
+    DVector2 e = DVector2Subtract(s.right, s.left);
+    DVector2 w = DVector2Subtract(s.left, origin);
+    f64 denom = DVector2Determinant(dir, e);
+    if (denom == 0.0) return false;
+    f64 u = DVector2Determinant(w, dir) / denom;
+    *t = DVector2Determinant(w, e) / denom;
+    return *t >= 0.0 && u >= 0.0 && u <= 1.0;
+}
+
+DVector2
+DSegmentClosestPoint(DSegment s, DVector2 pt)
+{
+    DVector2 e = DVector2Subtract(s.right, s.left);
+    f64 len2 = DVector2DotProduct(e, e);
+    f64 t = (len2 > 0.0) ? clamp(DVector2DotProduct(DVector2Subtract(pt, s.left), e) / len2, 0.0, 1.0) : 0.0;
+    return (DVector2){ s.left.x + t * e.x, s.left.y + t * e.y };
+}
+
+bool
+DSegmentIntersectsBox(DSegment s, DVector2 lo, DVector2 hi)
+{
+    /* liang-barsky, same as clipping against a tile */
+    DVector2 d = DVector2Subtract(s.right, s.left);
+    f64 p[4] = { -d.x, d.x, -d.y, d.y };
+    f64 q[4] = { s.left.x - lo.x, hi.x - s.left.x, s.left.y - lo.y, hi.y - s.left.y };
+    f64 t0 = 0.0, t1 = 1.0;
+    for (usize i = 0; i < 4; i++)
+    {
+        if (p[i] == 0.0)
+        {
+            if (q[i] < 0.0) return false;
+        }
+        else if (p[i] < 0.0) t0 = max(t0, q[i] / p[i]);
+        else t1 = min(t1, q[i] / p[i]);
+    }
+    return t0 <= t1;
+}
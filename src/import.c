@@ -0,0 +1,427 @@
+#include "import.h"
+#include "bsp.h"
+#include "f64_vector.h"
+#include "polygon.h"
+#include "raylib.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ************************ helpers ************************ */
+i32 streamPeek(ImportStream *stream);
+i32 streamNext(ImportStream *stream);
+void streamSkipSpace(ImportStream *stream);
+bool streamReadNumber(ImportStream *stream, f64 *value);
+void streamReadString(ImportStream *stream, char *token);
+bool isNumberStart(i32 c);
+bool extensionIs(const char *ext, const char *name);
+void parseSVGPath(ImportStream *stream, Polygon *polygon, i32 terminator);
+usize svgArgCount(i32 command);
+DVector2 svgEndPoint(i32 command, const f64 *args, DVector2 pos);
+/* ********************************************************* */
+
+Polygon *
+ImportPolygon(const char *path)
+{
+    const char *ext = strrchr(path, '.');
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        TraceLog(LOG_ERROR, "IMPORT: could not open %s", path);
+        return NULL;
+    }
+
+    Polygon *polygon = NewPolygon();
+    bool ok = false;
+    if (!ext) TraceLog(LOG_ERROR, "IMPORT: no file extension on %s", path);
+    else if (extensionIs(ext, ".wkt")) ok = ImportWKT(file, polygon);
+    else if (extensionIs(ext, ".geojson") || extensionIs(ext, ".json")) ok = ImportGeoJSON(file, polygon);
+    else if (extensionIs(ext, ".svg")) ok = ImportSVG(file, polygon);
+    else if (extensionIs(ext, ".path")) ok = ImportSVGPath(file, polygon);
+    else TraceLog(LOG_ERROR, "IMPORT: unknown format for %s (expected .wkt, .geojson, .svg or .path)", path);
+    fclose(file);
+
+    if (ok && polygon->numRings == 0)
+    {
+        TraceLog(LOG_ERROR, "IMPORT: no closed rings found in %s", path);
+        ok = false;
+    }
+    if (!ok)
+    {
+        FreePolygon(polygon);
+        return NULL;
+    }
+    /* none of the formats mark holes reliably, nesting decides */
+    usize numHoles = PolygonClassifyRings(polygon);
+    TraceLog(LOG_INFO, "IMPORT: %s => %u rings (%u holes), %u vertices", path, (u32)polygon->numRings, (u32)numHoles, (u32)polygon->numVertices);
+    return polygon;
+}
+
+bool
+ImportWKT(FILE *file, Polygon *polygon)
+{ /*
+   * rings are the innermost parenthesized lists of "x y" pairs, which covers
+   * POLYGON, MULTIPOLYGON and one geometry per line files the same way.
+   * extra Z/M ordinates are ignored, y is flipped since WKT is y-up
+   */
+    ImportStream stream = { .file = file, .length = 0, .pos = 0 };
+    f64 coords[2];
+    usize numCoords = 0;
+    bool ringOpen = false;
+
+    for (i32 c = streamPeek(&stream); c != EOF; c = streamPeek(&stream))
+    {
+        if (isNumberStart(c))
+        {
+            f64 value;
+            if (!streamReadNumber(&stream, &value)) continue;
+            if (numCoords < 2) coords[numCoords] = value;
+            numCoords += 1;
+            ringOpen = true;
+            continue;
+        }
+
+        streamNext(&stream);
+        if (c == ',' || c == ')')
+        {
+            if (numCoords >= 2) PolygonAddVertex(polygon, (DVector2){ coords[0], -coords[1] });
+            numCoords = 0;
+        }
+        if (c == ')' && ringOpen)
+        {
+            PolygonCloseRing(polygon);
+            ringOpen = false;
+        }
+    }
+    if (ringOpen)
+    {
+        if (numCoords >= 2) PolygonAddVertex(polygon, (DVector2){ coords[0], -coords[1] });
+        PolygonCloseRing(polygon);
+    }
+
+    return !ferror(file);
+}
+
+bool
+ImportGeoJSON(FILE *file, Polygon *polygon)
+{ /*
+   * only the values of "coordinates" keys are read, inside them any array of
+   * numbers is a position and any array of positions is a ring (so Polygon and
+   * MultiPolygon geometries, LineStrings would be closed into rings as well).
+   * y is flipped since GeoJSON is y-up
+   */
+    ImportStream stream = { .file = file, .length = 0, .pos = 0 };
+    char token[IMPORT_TOKEN_SIZE];
+    bool expectCoordinates = false; /* last key read was "coordinates" */
+    usize depth = 0;                /* array depth inside coordinates value (0 => outside) */
+    usize pointDepth = 0;           /* depth of arrays holding numbers */
+    f64 coords[2];
+    usize numCoords = 0;
+    bool ringOpen = false;
+
+    for (i32 c = streamPeek(&stream); c != EOF; c = streamPeek(&stream))
+    {
+        if (c == '"')
+        {
+            streamReadString(&stream, token);
+            streamSkipSpace(&stream);
+            if (streamPeek(&stream) == ':')
+            {
+                streamNext(&stream);
+                expectCoordinates = (depth == 0 && strcmp(token, "coordinates") == 0);
+            }
+        }
+        else if (c == '[')
+        {
+            streamNext(&stream);
+            if (depth > 0 || expectCoordinates) depth += 1;
+            expectCoordinates = false;
+            numCoords = 0;
+        }
+        else if (c == ']')
+        {
+            streamNext(&stream);
+            if (depth == 0) continue;
+            if (depth == pointDepth && numCoords >= 2)
+            {
+                PolygonAddVertex(polygon, (DVector2){ coords[0], -coords[1] });
+                ringOpen = true;
+            }
+            else if (depth + 1 == pointDepth && ringOpen)
+            {
+                PolygonCloseRing(polygon);
+                ringOpen = false;
+            }
+            depth -= 1;
+            numCoords = 0;
+            if (depth == 0)
+            {
+                /* a bare Point leaves a single vertex behind, closing drops it */
+                if (ringOpen) PolygonCloseRing(polygon);
+                ringOpen = false;
+                pointDepth = 0;
+            }
+        }
+        else if (depth > 0 && isNumberStart(c))
+        {
+            f64 value;
+            if (!streamReadNumber(&stream, &value)) continue;
+            if (numCoords < 2) coords[numCoords] = value;
+            numCoords += 1;
+            pointDepth = depth;
+        }
+        else
+        {
+            streamNext(&stream);
+            if (!isspace(c)) expectCoordinates = false;
+        }
+    }
+    if (ringOpen) PolygonCloseRing(polygon);
+
+    return !ferror(file);
+}
+
+bool
+ImportSVG(FILE *file, Polygon *polygon)
+{ /*
+   * scans markup for d="..." attributes and parses each one as path data
+   */
+    ImportStream stream = { .file = file, .length = 0, .pos = 0 };
+    i32 prev = ' ';
+    for (i32 c = streamNext(&stream); c != EOF; c = streamNext(&stream))
+    {
+        if (c == 'd' && isspace(prev))
+        {
+            streamSkipSpace(&stream);
+            if (streamPeek(&stream) != '=')
+            {
+                prev = c;
+                continue;
+            }
+            streamNext(&stream);
+            streamSkipSpace(&stream);
+            i32 quote = streamNext(&stream);
+            if (quote == '"' || quote == '\'') parseSVGPath(&stream, polygon, quote);
+        }
+        prev = c;
+    }
+    return !ferror(file);
+}
+
+bool
+ImportSVGPath(FILE *file, Polygon *polygon)
+{
+    ImportStream stream = { .file = file, .length = 0, .pos = 0 };
+    parseSVGPath(&stream, polygon, EOF);
+    return !ferror(file);
+}
+
+i32
+streamPeek(ImportStream *stream)
+{
+    if (stream->pos == stream->length)
+    {
+        stream->length = fread(stream->buffer, 1, IMPORT_BUFFER_SIZE, stream->file);
+        stream->pos = 0;
+        if (stream->length == 0) return EOF;
+    }
+    return (unsigned char)stream->buffer[stream->pos];
+}
+
+i32
+streamNext(ImportStream *stream)
+{
+    i32 c = streamPeek(stream);
+    if (c != EOF) stream->pos += 1;
+    return c;
+}
+
+void
+streamSkipSpace(ImportStream *stream)
+{
+    while (isspace(streamPeek(stream)))
+        streamNext(stream);
+}
+
+bool
+streamReadNumber(ImportStream *stream, f64 *value)
+{ /*
+   * reads [sign] digits [. digits] [e [sign] digits], stopping at the first
+   * character that can't continue the number (so "1.5.5" and "10-5" read as
+   * two numbers like SVG expects). always consumes at least one character
+   */
+    char token[IMPORT_TOKEN_SIZE];
+    usize length = 0;
+    bool seenDigit = false, seenDot = false, seenExponent = false;
+
+    i32 c = streamPeek(stream);
+    if (c == '-' || c == '+')
+    {
+        token[length++] = c;
+        streamNext(stream);
+    }
+    while ((c = streamPeek(stream)) != EOF && length < IMPORT_TOKEN_SIZE - 2)
+    {
+        if (isdigit(c)) seenDigit = true;
+        else if (c == '.' && !seenDot && !seenExponent) seenDot = true;
+        else if ((c == 'e' || c == 'E') && seenDigit && !seenExponent)
+        {
+            seenExponent = true;
+            token[length++] = c;
+            streamNext(stream);
+            c = streamPeek(stream);
+            if (c != '-' && c != '+') continue;
+        }
+        else break;
+        token[length++] = c;
+        streamNext(stream);
+    }
+    token[length] = '\0';
+
+    if (!seenDigit) return false;
+    *value = strtod(token, NULL);
+    return true;
+}
+
+void
+streamReadString(ImportStream *stream, char *token)
+{
+    /* keeps the first IMPORT_TOKEN_SIZE - 1 characters, the rest is skipped */
+    usize length = 0;
+    streamNext(stream);
+    for (i32 c = streamNext(stream); c != EOF && c != '"'; c = streamNext(stream))
+    {
+        if (c == '\\') c = streamNext(stream);
+        if (length < IMPORT_TOKEN_SIZE - 1) token[length++] = c;
+    }
+    token[length] = '\0';
+}
+
+bool
+isNumberStart(i32 c)
+{
+    return isdigit(c) || c == '-' || c == '+' || c == '.';
+}
+
+bool
+extensionIs(const char *ext, const char *name)
+{
+    for (; *ext && *name; ext++, name++)
+        if (tolower((unsigned char)*ext) != *name) return false;
+    return *ext == *name;
+}
+
+void
+parseSVGPath(ImportStream *stream, Polygon *polygon, i32 terminator)
+{ /*
+   * every subpath becomes a ring. curves are replaced by the chord to their
+   * end point, footprints are made of straight walls anyway
+   */
+    DVector2 pos = { 0, 0 }, start = { 0, 0 };
+    i32 command = 0;
+    f64 args[7];
+    usize numArgs = 0;
+    bool ringOpen = false;
+
+    for (;;)
+    {
+        i32 c = streamPeek(stream);
+        if (c == EOF) break;
+        else if (c == terminator)
+        {
+            streamNext(stream);
+            break;
+        }
+        else if (isNumberStart(c))
+        {
+            f64 value;
+            if (!streamReadNumber(stream, &value)) continue;
+            usize argCount = svgArgCount(command);
+            if (argCount == 0) continue;
+            args[numArgs++] = value;
+            if (numArgs < argCount) continue;
+
+            pos = svgEndPoint(command, args, pos);
+            numArgs = 0;
+            if (command == 'M' || command == 'm')
+            {
+                if (ringOpen) PolygonCloseRing(polygon);
+                start = pos;
+                /* extra coordinate pairs after a moveto are implicit linetos */
+                command = (command == 'M') ? 'L' : 'l';
+            }
+            else if (!ringOpen) PolygonAddVertex(polygon, start);
+            PolygonAddVertex(polygon, pos);
+            ringOpen = true;
+        }
+        else if (isalpha(c))
+        {
+            streamNext(stream);
+            command = c;
+            numArgs = 0;
+            if (c == 'Z' || c == 'z')
+            {
+                if (ringOpen) PolygonCloseRing(polygon);
+                ringOpen = false;
+                pos = start;
+            }
+        }
+        else streamNext(stream);
+    }
+    if (ringOpen) PolygonCloseRing(polygon);
+}
+
+usize
+svgArgCount(i32 command)
+{
+    switch (toupper(command))
+    {
+    case 'M':
+    case 'L':
+    case 'T':
+        return 2;
+    case 'H':
+    case 'V':
+        return 1;
+    case 'S':
+    case 'Q':
+        return 4;
+    case 'C':
+        return 6;
+    case 'A':
+        return 7;
+    default:
+        return 0;
+    }
+}
+
+DVector2
+svgEndPoint(i32 command, const f64 *args, DVector2 pos)
+{
+    bool relative = islower(command);
+    DVector2 end = pos;
+    switch (toupper(command))
+    {
+    case 'H':
+        end.x = relative ? pos.x + args[0] : args[0];
+        return end;
+    case 'V':
+        end.y = relative ? pos.y + args[0] : args[0];
+        return end;
+    case 'S':
+    case 'Q':
+        end = (DVector2){ args[2], args[3] };
+        break;
+    case 'C':
+        end = (DVector2){ args[4], args[5] };
+        break;
+    case 'A':
+        end = (DVector2){ args[5], args[6] };
+        break;
+    default:
+        end = (DVector2){ args[0], args[1] };
+        break;
+    }
+    return relative ? DVector2Add(pos, end) : end;
+}
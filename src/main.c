@@ -1,8 +1,45 @@
+#define _POSIX_C_SOURCE 200809L
 #include "bsp.h"
+#include "bsp_flat.h"
+#include "bsp_grid.h"
+#include "bsp_ooc.h"
+#include "bsp_quant.h"
+#include "bsp_sdf.h"
+#include "bsp_visibility.h"
+#include "import.h"
+#include "parallel.h"
+#include "polygon.h"
 #include "raylib.h"
 #include "s1.h"
 #include "s2.h"
 #include "s3.h"
+#include "spatial_index.h"
+#include "tile.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* ************* helpers ************* */
+isize BuildTilesCommand(isize argc, char *argv[]);
+isize RetryTileCommand(isize argc, char *argv[]);
+isize BuildLargeCommand(isize argc, char *argv[]);
+isize QuantizeCommand(isize argc, char *argv[]);
+isize RelayoutCommand(isize argc, char *argv[]);
+isize SdfCommand(isize argc, char *argv[]);
+isize BenchCommand(isize argc, char *argv[]);
+isize BenchIndexCommand(isize argc, char *argv[]);
+BspFlatTree *LoadFlatTree(const char *path);
+f64 BenchLocate(const BspFlatTree *tree, const BspQuantTree *quant, const DVector2 *points, usize numPoints, u64 *checksum);
+f64 BenchLocateBatch(const BspFlatTree *tree, const DVector2 *points, usize numPoints, u64 *checksum);
+f64 BenchLocateGrid(const BspGrid *grid, const DVector2 *points, usize numPoints, u64 *checksum);
+f64 BenchRayCast(const BspFlatTree *tree, const DVector2 *origins, usize numOrigins, usize numRays, usize packetSize, f64 *checksum);
+f64 BenchLineOfSight(const BspFlatTree *tree, const DVector2 *points, usize numPairs, usize mode, usize *numVisible);
+f64 BenchVisibility(const BspFlatTree *tree, const DVector2 *points, usize numViews, usize *numVertices);
+f64 BenchSpatialQuery(const SpatialIndex *index, usize query, const DVector2 *points, const DVector2 *dirs, usize numPoints, f64 boxSize, f64 *checksum);
+DSegment *LoadWorldSegments(const char *path, usize *numSegments);
+/* *********************************** */
 
 isize
 main(isize argc, char *argv[])
@@ -12,6 +49,40 @@ main(isize argc, char *argv[])
     S2 s2 = { 0 };
     S3 s3 = { 0 };
 
+    /* headless tile building, see BuildTilesCommand/RetryTileCommand for usage */
+    if (argc > 1 && strcmp(argv[1], "--build-tiles") == 0) return BuildTilesCommand(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--retry-tile") == 0) return RetryTileCommand(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--build-large") == 0) return BuildLargeCommand(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--quantize") == 0) return QuantizeCommand(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--relayout") == 0) return RelayoutCommand(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--sdf") == 0) return SdfCommand(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) return BenchCommand(argc, argv);
+    if (argc > 1 && strcmp(argv[1], "--bench-index") == 0) return BenchIndexCommand(argc, argv);
+
+    /* tiled worlds built with --build-tiles are streamed straight into stage 3 (./bsp --tiles <directory> [cap in MB]) */
+    TileIndex *tileIndex = NULL;
+    usize tileMemoryCap = 64;
+    if (argc > 2 && strcmp(argv[1], "--tiles") == 0)
+    {
+        tileIndex = ReadTileIndex(argv[2]);
+        if (!tileIndex) return 1;
+        if (argc > 3) tileMemoryCap = atoi(argv[3]);
+        stage = S3_INITIALIZING;
+    }
+
+    /* polygon either comes from a file passed on the command line or gets drawn in stage 1 */
+    Polygon *polygon = NULL;
+    bool imported = false;
+    if (argc > 1 && !tileIndex)
+    {
+        polygon = ImportPolygon(argv[1]);
+        if (!polygon) return 1;
+        /* ./bsp <input> [tolerance] drops vertices within tolerance (in input units) of the simplified outline */
+        if (argc > 2) SimplifyPolygon(polygon, atof(argv[2]));
+        imported = true;
+        stage = S2_INITIALIZING;
+    }
+
     /* SetConfigFlags(FLAG_WINDOW_RESIZABLE | FLAG_VSYNC_HINT); */
     InitWindow(WIDTH, HEIGHT, "csci 8442 bsp demo");
     SetTargetFPS(60);
@@ -45,11 +116,12 @@ main(isize argc, char *argv[])
             break;
 
         case S1_COMPLETED:
+            polygon = PolygonFromGrid(s1.polygon, s1.numVertices);
             stage = S2_INITIALIZING;
             break;
 
         case S2_INITIALIZING:
-            stage = S2_Init(s1.polygon, s1.numVertices, &s2);
+            stage = S2_Init(polygon, &s2);
             break;
 
         case S2_PENDING:
@@ -61,7 +133,8 @@ main(isize argc, char *argv[])
             break;
 
         case S3_INITIALIZING:
-            stage = S3_Init(s1.polygon, s1.numVertices, &s3);
+            if (tileIndex) stage = S3_InitTiles(tileIndex, tileMemoryCap << 20, &s3);
+            else stage = S3_Init(polygon, &s3);
             break;
 
         case S3_PENDING:
@@ -80,7 +153,14 @@ main(isize argc, char *argv[])
             if (s1.initialized) S1_Free(&s1);
             if (s2.initialized) S2_Free(&s2);
             if (s3.initialized) S3_Free(&s3);
-            stage = S1_INITIALIZING;
+            if (tileIndex) stage = S3_INITIALIZING;
+            else if (imported) stage = S2_INITIALIZING;
+            else
+            {
+                if (polygon) FreePolygon(polygon);
+                polygon = NULL;
+                stage = S1_INITIALIZING;
+            }
             break;
 
         default:
@@ -93,6 +173,624 @@ cleanup:
     if (s1.initialized) S1_Free(&s1);
     if (s2.initialized) S2_Free(&s2);
     if (s3.initialized) S3_Free(&s3);
+    if (polygon) FreePolygon(polygon);
+    if (tileIndex) FreeTileIndex(tileIndex);
+
+    return 0;
+}
+
+isize
+BuildTilesCommand(isize argc, char *argv[])
+{ /*
+   * ./bsp --build-tiles <input> <directory> <cols> <rows> [workers]
+   */
+    if (argc < 6)
+    {
+        TraceLog(LOG_ERROR, "usage: %s --build-tiles <input> <directory> <cols> <rows> [workers]", argv[0]);
+        return 1;
+    }
+    u32 cols = atoi(argv[4]), rows = atoi(argv[5]);
+    usize workers = (argc > 6) ? atoi(argv[6]) : 4;
+    if (cols == 0 || rows == 0)
+    {
+        TraceLog(LOG_ERROR, "TILES: grid must have at least one column and row");
+        return 1;
+    }
+
+    usize numSegments = 0;
+    DSegment *segments = LoadWorldSegments(argv[2], &numSegments);
+    if (!segments) return 1;
+    BoundingRegion fullScreen = { 0, WIDTH, 0, HEIGHT };
+    usize failed = BuildTileWorld(segments, numSegments, BuildTileGrid(fullScreen, cols, rows), argv[3], workers);
+    FreeSegments(segments);
+
+    if (failed > 0) TraceLog(LOG_ERROR, "TILES: %u tile(s) failed, rebuild them with --retry-tile", (u32)failed);
+    else TraceLog(LOG_INFO, "TILES: built %ux%u tiles in %s", cols, rows, argv[3]);
+    return failed > 0;
+}
+
+isize
+RetryTileCommand(isize argc, char *argv[])
+{ /*
+   * ./bsp --retry-tile <input> <directory> <col> <row>
+   */
+    if (argc < 6)
+    {
+        TraceLog(LOG_ERROR, "usage: %s --retry-tile <input> <directory> <col> <row>", argv[0]);
+        return 1;
+    }
+    usize numSegments = 0;
+    DSegment *segments = LoadWorldSegments(argv[2], &numSegments);
+    if (!segments) return 1;
+    bool ok = RetryTile(argv[3], segments, numSegments, atoi(argv[4]), atoi(argv[5]));
+    FreeSegments(segments);
+
+    if (!ok) TraceLog(LOG_ERROR, "TILES: tile (%s, %s) failed again", argv[4], argv[5]);
+    return !ok;
+}
+
+isize
+BuildLargeCommand(isize argc, char *argv[])
+{ /*
+   * ./bsp --build-large <input> <output> [budget in MB] [scratch directory]
+   *
+   * <input> is either a raw segment file (.seg) that is never loaded as a
+   * whole or anything ImportPolygon reads
+   */
+    if (argc < 4)
+    {
+        TraceLog(LOG_ERROR, "usage: %s --build-large <input> <output> [budget in MB] [scratch directory]", argv[0]);
+        return 1;
+    }
+    u64 budget = (argc > 4) ? (u64)atoi(argv[4]) << 20 : BSP_OOC_DEFAULT_BUDGET;
+    const char *scratch = (argc > 5) ? argv[5] : ".";
+    const char *extension = strrchr(argv[2], '.');
+    if (extension && strcmp(extension, ".seg") == 0) return !BuildBspTreeOutOfCore(argv[2], argv[3], scratch, budget);
+
+    char path[BSP_OOC_PATH_SIZE];
+    if (snprintf(path, BSP_OOC_PATH_SIZE, "%s/input.seg", scratch) >= BSP_OOC_PATH_SIZE)
+    {
+        TraceLog(LOG_ERROR, "OOC: scratch directory %s is too long for scratch file names", scratch);
+        return 1;
+    }
+    usize numSegments = 0;
+    DSegment *segments = LoadWorldSegments(argv[2], &numSegments);
+    if (!segments) return 1;
+    bool ok = WriteSegmentFile(path, segments, numSegments);
+    FreeSegments(segments);
+    ok = ok && BuildBspTreeOutOfCore(path, argv[3], scratch, budget);
+    remove(path);
+    return !ok;
+}
+
+isize
+QuantizeCommand(isize argc, char *argv[])
+{ /*
+   * ./bsp --quantize <tree file> <output>
+   */
+    if (argc < 4)
+    {
+        TraceLog(LOG_ERROR, "usage: %s --quantize <tree file> <output>", argv[0]);
+        return 1;
+    }
+    BspFlatTree *tree = LoadFlatTree(argv[2]);
+    if (!tree) return 1;
+
+    BspQuantTree *quant = QuantizeBspFlatTree(tree);
+    if (!quant)
+    {
+        FreeBspFlatTree(tree);
+        return 1;
+    }
+    FILE *out = fopen(argv[3], "wb");
+    bool ok = out && WriteBspQuantTree(quant, out);
+    if (out) ok = (fclose(out) == 0) && ok;
+    if (!ok) TraceLog(LOG_ERROR, "QUANT: could not write %s", argv[3]);
+    else TraceLog(LOG_INFO, "QUANT: %u node(s) in %u bytes => %s", (u32)quant->numNodes, (u32)(quant->numNodes * (sizeof(BspQuantNode) + sizeof(BspFragmentRange)) + quant->numFragments * sizeof(BspQuantFragment)), argv[3]);
+    FreeBspQuantTree(quant);
+    FreeBspFlatTree(tree);
+    return !ok;
+}
+
+isize
+RelayoutCommand(isize argc, char *argv[])
+{ /*
+   * ./bsp --relayout <tree file> <output> <preorder|bfs|veb>
+   */
+    BspLayout layout;
+    if (argc < 5 || !ParseBspLayout(argv[4], &layout))
+    {
+        TraceLog(LOG_ERROR, "usage: %s --relayout <tree file> <output> <preorder|bfs|veb>", argv[0]);
+        return 1;
+    }
+    BspFlatTree *tree = LoadFlatTree(argv[2]);
+    if (!tree) return 1;
+
+    BspFlatTree *relaid = RelayoutBspFlatTree(tree, layout);
+    FILE *out = fopen(argv[3], "wb");
+    bool ok = out && WriteBspFlatTree(relaid, out);
+    if (out) ok = (fclose(out) == 0) && ok;
+    if (!ok) TraceLog(LOG_ERROR, "LAYOUT: could not write %s", argv[3]);
+    else TraceLog(LOG_INFO, "LAYOUT: %u node(s) in %s order => %s", (u32)relaid->numNodes, BspLayoutName(layout), argv[3]);
+    FreeBspFlatTree(relaid);
+    FreeBspFlatTree(tree);
+    return !ok;
+}
+
+isize
+SdfCommand(isize argc, char *argv[])
+{ /*
+   * ./bsp --sdf <tree file> <output> <cell size> [max distance]
+   *
+   * the grid covers the tree's vertices with a margin of two cells
+   */
+    if (argc < 5 || atof(argv[4]) <= 0.0)
+    {
+        TraceLog(LOG_ERROR, "usage: %s --sdf <tree file> <output> <cell size> [max distance]", argv[0]);
+        return 1;
+    }
+    f64 cellSize = atof(argv[4]);
+    f64 maxDistance = (argc > 5) ? atof(argv[5]) : INFINITY;
+    BspFlatTree *tree = LoadFlatTree(argv[2]);
+    if (!tree) return 1;
+    if (!LabelBspFlatTree(tree))
+    {
+        TraceLog(LOG_ERROR, "SDF: %s doesn't bound a polygon consistently, inside and outside can't be told apart", argv[2]);
+        FreeBspFlatTree(tree);
+        return 1;
+    }
+
+    DVector2 lo = { 0.0, 0.0 }, hi = { 0.0, 0.0 };
+    for (usize i = 0; i < tree->numVertices; i++)
+    {
+        DVector2 v = tree->vertices[i];
+        lo = (i == 0) ? v : (DVector2){ min(lo.x, v.x), min(lo.y, v.y) };
+        hi = (i == 0) ? v : (DVector2){ max(hi.x, v.x), max(hi.y, v.y) };
+    }
+    DVector2 origin = { lo.x - 2.0 * cellSize, lo.y - 2.0 * cellSize };
+    u32 width = (u32)ceil((hi.x - lo.x) / cellSize) + 5;
+    u32 height = (u32)ceil((hi.y - lo.y) / cellSize) + 5;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    BspSdf *sdf = BakeBspSdf(tree, origin, cellSize, width, height, maxDistance);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    f64 seconds = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+    FILE *out = fopen(argv[3], "wb");
+    bool ok = out && WriteBspSdf(sdf, out);
+    if (out) ok = (fclose(out) == 0) && ok;
+    if (!ok) TraceLog(LOG_ERROR, "SDF: could not write %s", argv[3]);
+    else TraceLog(LOG_INFO, "SDF: %ux%u samples in %.1f ms (%u threads) => %s", width, height, 1e3 * seconds, (u32)ParallelWorkerCount(), argv[3]);
+    FreeBspSdf(sdf);
+    FreeBspFlatTree(tree);
+    return !ok;
+}
+
+isize
+BenchCommand(isize argc, char *argv[])
+{ /*
+   * ./bsp --bench <tree file> [queries]
+   * times point location over the same random points with the tree in
+   * every layout, one point at a time and batched, plus the quantized tree
+   * and point in polygon on the labeled tree. trees have to be well beyond
+   * the cache size (e.g. built with --build-large) for layout to matter.
+   * the grid rows trade memory for the share of points answered by a cell
+   * lookup alone (hits), the rest walk down from the cell's subtree.
+   * then first-hit ray casting, as many rays as queries in fans around
+   * some of the points, one ray at a time and in packets, line of sight
+   * between pairs of points against ray casts over the same segments, and
+   * visibility polygons of some of the points against a fan of rays
+   * around each, before and after bounding the tree
+   */
+    if (argc < 3)
+    {
+        TraceLog(LOG_ERROR, "usage: %s --bench <tree file> [queries]", argv[0]);
+        return 1;
+    }
+    BspFlatTree *tree = LoadFlatTree(argv[2]);
+    if (!tree) return 1;
+    usize numPoints = (argc > 3) ? (usize)atoi(argv[3]) : 1000000;
+
+    /* query points are spread uniformly over the bounds of the tree's vertices */
+    DVector2 lo = { 0.0, 0.0 }, hi = { 0.0, 0.0 };
+    for (usize i = 0; i < tree->numVertices; i++)
+    {
+        DVector2 v = tree->vertices[i];
+        lo = (i == 0) ? v : (DVector2){ min(lo.x, v.x), min(lo.y, v.y) };
+        hi = (i == 0) ? v : (DVector2){ max(hi.x, v.x), max(hi.y, v.y) };
+    }
+    DVector2 *points = (DVector2 *)malloc(max(numPoints, 1) * sizeof(DVector2));
+    srand(1);
+    for (usize i = 0; i < numPoints; i++)
+        points[i] = (DVector2){ lo.x + (hi.x - lo.x) * rand() / RAND_MAX, lo.y + (hi.y - lo.y) * rand() / RAND_MAX };
+
+    TraceLog(LOG_INFO, "BENCH: %u node(s), %u KB of nodes, %u queries", (u32)tree->numNodes, (u32)(tree->numNodes * sizeof(BspFlatNode) >> 10), (u32)numPoints);
+    u64 expected = 0;
+    for (BspLayout layout = BspLayoutPreOrder; layout <= BspLayoutVanEmdeBoas; layout++)
+    {
+        BspFlatTree *relaid = RelayoutBspFlatTree(tree, layout);
+        u64 checksum = 0;
+        f64 seconds = BenchLocate(relaid, NULL, points, numPoints, &checksum);
+        if (layout == BspLayoutPreOrder) expected = checksum;
+        TraceLog(LOG_INFO, "BENCH: %-8s %8.1f ns/query%s", BspLayoutName(layout), 1e9 * seconds / max(numPoints, 1), (checksum == expected) ? "" : " (MISMATCH)");
+
+        if (layout == BspLayoutPreOrder)
+        {
+            BspQuantTree *quant = QuantizeBspFlatTree(relaid);
+            seconds = BenchLocate(relaid, quant, points, numPoints, &checksum);
+            TraceLog(LOG_INFO, "BENCH: %-8s %8.1f ns/query%s", "quant", 1e9 * seconds / max(numPoints, 1), (checksum == expected) ? "" : " (MISMATCH)");
+            FreeBspQuantTree(quant);
+        }
+        seconds = BenchLocateBatch(relaid, points, numPoints, &checksum);
+        TraceLog(LOG_INFO, "BENCH: %-8s %8.1f ns/query%s (batched, %u threads)", "", 1e9 * seconds / max(numPoints, 1), (checksum == expected) ? "" : " (MISMATCH)", (u32)ParallelWorkerCount());
+        FreeBspFlatTree(relaid);
+    }
+
+    const u32 resolutions[] = { 64, 256, 1024 };
+    for (usize k = 0; k < sizeof(resolutions) / sizeof(resolutions[0]); k++)
+    {
+        BspGrid *grid = BuildBspGrid(tree, resolutions[k]);
+        if (!grid) break;
+        u64 checksum = 0;
+        f64 seconds = BenchLocateGrid(grid, points, numPoints, &checksum);
+        char label[16];
+        snprintf(label, sizeof(label), "grid%u", resolutions[k]);
+        f64 hitRate = (f64)grid->numLeafCells / max((usize)grid->width * grid->height, 1);
+        TraceLog(LOG_INFO, "BENCH: %-8s %8.1f ns/query%s (%u KB, %.1f%% hits)", label, 1e9 * seconds / max(numPoints, 1), (checksum == expected) ? "" : " (MISMATCH)", (u32)(BspGridBytes(grid) >> 10), 100.0 * hitRate);
+        FreeBspGrid(grid);
+    }
+
+    /* containment through solid-leaf labels, skipped if the tree's segments don't bound a polygon consistently */
+    if (LabelBspFlatTree(tree))
+    {
+        bool *inside = (bool *)malloc(max(numPoints, 1) * sizeof(bool));
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        BspFlatClassifyPoints(tree, points, numPoints, inside);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        usize numInside = 0;
+        for (usize i = 0; i < numPoints; i++)
+            numInside += inside[i];
+        f64 seconds = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        TraceLog(LOG_INFO, "BENCH: %-8s %8.1f ns/query (%u inside)", "contains", 1e9 * seconds / max(numPoints, 1), (u32)numInside);
+        free(inside);
+    }
 
+    usize numOrigins = min(numPoints, 64);
+    usize numRays = numPoints / max(numOrigins, 1);
+    f64 expectedDistance = 0.0;
+    const usize packetSizes[] = { 1, 4, 8, 16 };
+    for (usize k = 0; k < sizeof(packetSizes) / sizeof(packetSizes[0]) && numRays > 0; k++)
+    {
+        usize packetSize = packetSizes[k];
+        f64 distance = 0.0;
+        f64 seconds = BenchRayCast(tree, points, numOrigins, numRays, packetSize, &distance);
+        if (packetSize == 1) expectedDistance = distance;
+        char label[16];
+        snprintf(label, sizeof(label), (packetSize == 1) ? "ray" : "packet%u", (u32)packetSize);
+        TraceLog(LOG_INFO, "BENCH: %-8s %8.2f Mrays/s%s (%u threads)", label, 1e-6 * numOrigins * numRays / seconds, (distance == expectedDistance) ? "" : " (MISMATCH)", (u32)((packetSize == 1) ? 1 : ParallelWorkerCount()));
+    }
+
+    usize numPairs = numPoints / 2, numVisible = 0, numUnhit = 0, numBatched = 0;
+    f64 seconds = BenchLineOfSight(tree, points, numPairs, 0, &numVisible);
+    f64 raySeconds = BenchLineOfSight(tree, points, numPairs, 1, &numUnhit);
+    TraceLog(LOG_INFO, "BENCH: %-8s %8.1f ns/query (%u visible, %.1f ns/query as ray casts)", "sight", 1e9 * seconds / max(numPairs, 1), (u32)numVisible, 1e9 * raySeconds / max(numPairs, 1));
+    seconds = BenchLineOfSight(tree, points, numPairs, 2, &numBatched);
+    TraceLog(LOG_INFO, "BENCH: %-8s %8.1f ns/query%s (batched, %u threads)", "", 1e9 * seconds / max(numPairs, 1), (numBatched == numVisible) ? "" : " (MISMATCH)", (u32)ParallelWorkerCount());
+
+    usize numViews = min(numPoints, 1000), numVertices = 0;
+    const usize fanSize = 720;
+    f64 fanDistance = 0.0;
+    f64 fanSeconds = BenchRayCast(tree, points, numViews, fanSize, 1, &fanDistance);
+    seconds = BenchVisibility(tree, points, numViews, &numVertices);
+    TraceLog(LOG_INFO, "BENCH: %-8s %8.1f us/view (%.1f vertices, %.1f us/view as a fan of %u rays)", "visible", 1e6 * seconds / max(numViews, 1), (f64)numVertices / max(numViews, 1), 1e6 * fanSeconds / max(numViews, 1), (u32)fanSize);
+    BoundBspFlatTree(tree);
+    seconds = BenchVisibility(tree, points, numViews, &numVertices);
+    TraceLog(LOG_INFO, "BENCH: %-8s %8.1f us/view (bounded)", "", 1e6 * seconds / max(numViews, 1));
+
+    free(points);
+    FreeBspFlatTree(tree);
     return 0;
 }
+
+f64
+BenchLocate(const BspFlatTree *tree, const BspQuantTree *quant, const DVector2 *points, usize numPoints, u64 *checksum)
+{
+    /* best of a few rounds, the located node's first fragment is the same whatever the layout */
+    f64 best = 0.0;
+    for (usize round = 0; round < 3; round++)
+    {
+        struct timespec start, end;
+        u64 sum = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (usize i = 0; i < numPoints; i++)
+        {
+            DSide side;
+            u32 idx = quant ? BspQuantLocatePoint(quant, points[i], &side) : BspFlatLocatePoint(tree, points[i], &side);
+            sum += (idx == BSP_NULL_IDX) ? 0 : tree->ranges[idx].first * 3 + side;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        f64 seconds = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        best = (round == 0) ? seconds : min(best, seconds);
+        *checksum = sum;
+    }
+    return best;
+}
+
+isize
+BenchIndexCommand(isize argc, char *argv[])
+{ /*
+   * ./bsp --bench-index <polygon file> [queries]
+   * builds every spatial index backend over the polygon's segments and times
+   * the same random queries on each. results are checked against the first
+   * backend answering them, queries a backend doesn't support show as n/a
+   */
+    if (argc < 3)
+    {
+        TraceLog(LOG_ERROR, "usage: %s --bench-index <polygon file> [queries]", argv[0]);
+        return 1;
+    }
+    usize numSegments;
+    DSegment *segments = LoadWorldSegments(argv[2], &numSegments);
+    if (!segments) return 1;
+    usize numPoints = (argc > 3) ? (usize)atoi(argv[3]) : 100000;
+
+    /* points over the bounds of the segments, rays in random directions, boxes of 1% of the bounds */
+    DVector2 lo = { 0.0, 0.0 }, hi = { 0.0, 0.0 };
+    for (usize i = 0; i < numSegments; i++)
+    {
+        DVector2 v = segments[i].left;
+        lo = (i == 0) ? v : (DVector2){ min(lo.x, v.x), min(lo.y, v.y) };
+        hi = (i == 0) ? v : (DVector2){ max(hi.x, v.x), max(hi.y, v.y) };
+    }
+    DVector2 *points = (DVector2 *)malloc(max(numPoints, 1) * sizeof(DVector2));
+    DVector2 *dirs = (DVector2 *)malloc(max(numPoints, 1) * sizeof(DVector2));
+    srand(1);
+    for (usize i = 0; i < numPoints; i++)
+    {
+        points[i] = (DVector2){ lo.x + (hi.x - lo.x) * rand() / RAND_MAX, lo.y + (hi.y - lo.y) * rand() / RAND_MAX };
+        f64 angle = 2.0 * PI * rand() / RAND_MAX;
+        dirs[i] = (DVector2){ cos(angle), sin(angle) };
+    }
+    f64 boxSize = 0.01 * max(hi.x - lo.x, hi.y - lo.y);
+
+    const char *queryNames[] = { "contains", "ray", "box", "nearest" };
+    f64 expected[4];
+    bool haveExpected[4] = { false, false, false, false };
+    TraceLog(LOG_INFO, "BENCH: %u segment(s), %u queries", (u32)numSegments, (u32)numPoints);
+    for (SpatialBackend backend = SpatialBackendBsp; backend <= SpatialBackendGrid; backend++)
+    {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        SpatialIndex *index = BuildSpatialIndex(backend, segments, numSegments);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        f64 buildSeconds = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        TraceLog(LOG_INFO, "BENCH: %-8s build %8.2f ms, %u KB", SpatialBackendName(backend), 1e3 * buildSeconds, (u32)(SpatialMemoryUsage(index) >> 10));
+
+        bool supported[4] = { index->ops->containsPoint != NULL, index->ops->rayCast != NULL, index->ops->queryBox != NULL, index->ops->nearest != NULL };
+        for (usize query = 0; query < 4; query++)
+        {
+            if (!supported[query])
+            {
+                TraceLog(LOG_INFO, "BENCH: %-8s %-8s      n/a", "", queryNames[query]);
+                continue;
+            }
+            f64 checksum;
+            f64 seconds = BenchSpatialQuery(index, query, points, dirs, numPoints, boxSize, &checksum);
+            if (!haveExpected[query]) expected[query] = checksum;
+            haveExpected[query] = true;
+            bool match = babs(checksum - expected[query]) <= 1e-9 * max(babs(expected[query]), 1.0);
+            TraceLog(LOG_INFO, "BENCH: %-8s %-8s %8.1f ns/query%s", "", queryNames[query], 1e9 * seconds / max(numPoints, 1), match ? "" : " (MISMATCH)");
+        }
+        FreeSpatialIndex(index);
+    }
+
+    free(dirs);
+    free(points);
+    FreeSegments(segments);
+    return 0;
+}
+
+f64
+BenchSpatialQuery(const SpatialIndex *index, usize query, const DVector2 *points, const DVector2 *dirs, usize numPoints, f64 boxSize, f64 *checksum)
+{
+    /* best of a few rounds, the checksum adds up what each query found (points inside, distances, segments) */
+    u32 *found = (u32 *)malloc(max(index->numSegments, 1) * sizeof(u32));
+    f64 best = 0.0;
+    for (usize round = 0; round < 3; round++)
+    {
+        struct timespec start, end;
+        f64 sum = 0.0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (usize i = 0; i < numPoints; i++)
+        {
+            SpatialHit hit;
+            switch (query)
+            {
+            case 0: sum += SpatialContainsPoint(index, points[i]); break;
+            case 1: sum += SpatialRayCast(index, points[i], dirs[i], INFINITY, &hit) ? hit.distance : 0.0; break;
+            case 2:
+            {
+                SpatialBox box = { points[i], { points[i].x + boxSize, points[i].y + boxSize } };
+                sum += SpatialQueryBox(index, box, found, index->numSegments);
+                break;
+            }
+            default: sum += SpatialNearest(index, points[i], &hit) ? hit.distance : 0.0; break;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        f64 seconds = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        best = (round == 0) ? seconds : min(best, seconds);
+        *checksum = sum;
+    }
+    free(found);
+    return best;
+}
+
+f64
+BenchLocateBatch(const BspFlatTree *tree, const DVector2 *points, usize numPoints, u64 *checksum)
+{
+    /* same as BenchLocate through BspFlatLocatePoints */
+    u32 *leaves = (u32 *)malloc(max(numPoints, 1) * sizeof(u32));
+    DSide *sides = (DSide *)malloc(max(numPoints, 1) * sizeof(DSide));
+    f64 best = 0.0;
+    for (usize round = 0; round < 3; round++)
+    {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        BspFlatLocatePoints(tree, points, numPoints, leaves, sides);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        f64 seconds = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        best = (round == 0) ? seconds : min(best, seconds);
+    }
+    u64 sum = 0;
+    for (usize i = 0; i < numPoints; i++)
+        sum += (leaves[i] == BSP_NULL_IDX) ? 0 : tree->ranges[leaves[i]].first * 3 + sides[i];
+    *checksum = sum;
+    free(sides);
+    free(leaves);
+    return best;
+}
+
+f64
+BenchLocateGrid(const BspGrid *grid, const DVector2 *points, usize numPoints, u64 *checksum)
+{
+    /* same as BenchLocate through BspGridLocatePoint */
+    const BspFlatTree *tree = grid->tree;
+    f64 best = 0.0;
+    for (usize round = 0; round < 3; round++)
+    {
+        struct timespec start, end;
+        u64 sum = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (usize i = 0; i < numPoints; i++)
+        {
+            DSide side;
+            u32 idx = BspGridLocatePoint(grid, points[i], &side);
+            sum += (idx == BSP_NULL_IDX) ? 0 : tree->ranges[idx].first * 3 + side;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        f64 seconds = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        best = (round == 0) ? seconds : min(best, seconds);
+        *checksum = sum;
+    }
+    return best;
+}
+
+f64
+BenchRayCast(const BspFlatTree *tree, const DVector2 *origins, usize numOrigins, usize numRays, usize packetSize, f64 *checksum)
+{
+    /* a fan of numRays rays sweeping the circle from each origin, cast one by one with BspFlatRayCast for a packetSize of 1 */
+    DVector2 *dirs = (DVector2 *)malloc(numRays * sizeof(DVector2));
+    for (usize i = 0; i < numRays; i++)
+        dirs[i] = (DVector2){ cos(2.0 * PI * i / numRays), sin(2.0 * PI * i / numRays) };
+    BspRayHit *hits = (BspRayHit *)malloc(numRays * sizeof(BspRayHit));
+    f64 best = 0.0, sum = 0.0;
+    for (usize round = 0; round < 3; round++)
+    {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        sum = 0.0;
+        for (usize o = 0; o < numOrigins; o++)
+        {
+            if (packetSize > 1) BspFlatRayCastPackets(tree, origins[o], dirs, numRays, packetSize, INFINITY, hits);
+            else for (usize i = 0; i < numRays; i++)
+                BspFlatRayCast(tree, origins[o], dirs[i], INFINITY, &hits[i]);
+            for (usize i = 0; i < numRays; i++)
+                if (hits[i].distance < INFINITY) sum += hits[i].distance;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        f64 seconds = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        best = (round == 0) ? seconds : min(best, seconds);
+    }
+    *checksum = sum;
+    free(hits);
+    free(dirs);
+    return best;
+}
+
+f64
+BenchVisibility(const BspFlatTree *tree, const DVector2 *points, usize numViews, usize *numVertices)
+{
+    /* visibility polygons of the first numViews points, closed well outside the tree */
+    f64 best = 0.0;
+    for (usize round = 0; round < 3; round++)
+    {
+        struct timespec start, end;
+        usize sum = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (usize i = 0; i < numViews; i++)
+        {
+            usize n = 0;
+            DVector2 *polygon = BuildBspVisibilityPolygon(tree, points[i], 1e9, &n);
+            sum += n;
+            free(polygon);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        f64 seconds = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        best = (round == 0) ? seconds : min(best, seconds);
+        *numVertices = sum;
+    }
+    return best;
+}
+
+f64
+BenchLineOfSight(const BspFlatTree *tree, const DVector2 *points, usize numPairs, usize mode, usize *numVisible)
+{
+    /* whether points[2 * i] sees points[2 * i + 1], by BspFlatLineOfSight (mode 0), a BspFlatRayCast up to the second point (1) or BspFlatLinesOfSight (2) */
+    DVector2 *from = (DVector2 *)malloc(max(numPairs, 1) * sizeof(DVector2));
+    DVector2 *to = (DVector2 *)malloc(max(numPairs, 1) * sizeof(DVector2));
+    bool *visible = (bool *)malloc(max(numPairs, 1) * sizeof(bool));
+    for (usize i = 0; i < numPairs; i++)
+    {
+        from[i] = points[2 * i];
+        to[i] = points[2 * i + 1];
+    }
+    f64 best = 0.0;
+    for (usize round = 0; round < 3; round++)
+    {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (mode == 2) BspFlatLinesOfSight(tree, from, to, numPairs, visible);
+        else for (usize i = 0; i < numPairs; i++)
+        {
+            DVector2 d = DVector2Subtract(to[i], from[i]);
+            f64 length = DVector2Length(d);
+            BspRayHit hit;
+            if (mode == 0) visible[i] = BspFlatLineOfSight(tree, from[i], to[i]);
+            else visible[i] = length == 0.0 || !BspFlatRayCast(tree, from[i], (DVector2){ d.x / length, d.y / length }, length, &hit);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        f64 seconds = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
+        best = (round == 0) ? seconds : min(best, seconds);
+    }
+    *numVisible = 0;
+    for (usize i = 0; i < numPairs; i++)
+        *numVisible += visible[i];
+    free(visible);
+    free(to);
+    free(from);
+    return best;
+}
+
+BspFlatTree *
+LoadFlatTree(const char *path)
+{
+    FILE *in = fopen(path, "rb");
+    BspFlatTree *tree = in ? ReadBspFlatTree(in) : NULL;
+    if (in) fclose(in);
+    if (!tree) TraceLog(LOG_ERROR, "BSP: could not read tree from %s", path);
+    return tree;
+}
+
+DSegment *
+LoadWorldSegments(const char *path, usize *numSegments)
+{
+    /* tiled worlds live in the same full screen space stage 3 renders in */
+    Polygon *polygon = ImportPolygon(path);
+    if (!polygon) return NULL;
+    BoundingRegion fullScreen = { 0, WIDTH, 0, HEIGHT };
+    DSegment *segments = BuildPolygonSegments(polygon, fullScreen, numSegments);
+    FreePolygon(polygon);
+    return segments;
+}
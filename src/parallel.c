@@ -0,0 +1,157 @@
+#define _POSIX_C_SOURCE 200809L
+#include "parallel.h"
+#include "bsp.h"
+#include <stdlib.h>
+#ifndef __EMSCRIPTEN__
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#ifndef __EMSCRIPTEN__
+typedef struct ParallelJob {
+    ParallelTask task;
+    void *ctx;
+    usize count;
+    usize grain;
+    usize next; /* first item not claimed yet */
+    pthread_mutex_t lock;
+} ParallelJob;
+
+/* workers started on the first ParallelFor and kept for the rest of the process */
+typedef struct ParallelPool {
+    pthread_mutex_t busy;  /* held by the ParallelFor using the workers */
+    pthread_mutex_t lock;  /* guards the fields below */
+    pthread_cond_t posted; /* signalled when a job is posted */
+    pthread_cond_t left;   /* signalled when the last worker leaves the job */
+    ParallelJob *job;      /* job being worked on, NULL between jobs */
+    u64 generation;        /* number of jobs posted, workers sleep until it changes */
+    usize numActive;       /* workers inside job */
+    usize numThreads;      /* workers started */
+} ParallelPool;
+
+ParallelPool parallelPool = {
+    .busy = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .posted = PTHREAD_COND_INITIALIZER,
+    .left = PTHREAD_COND_INITIALIZER,
+};
+pthread_once_t parallelPoolOnce = PTHREAD_ONCE_INIT;
+#endif
+
+/* ******************** helpers ******************** */
+void *parallelWorker(void *arg);
+void *poolThread(void *arg);
+void startPool(void);
+/* ************************************************* */
+
+void
+ParallelFor(usize count, usize grain, ParallelTask task, void *ctx)
+{
+    grain = max(grain, 1);
+    usize numChunks = (count + grain - 1) / grain;
+    usize numWorkers = min(ParallelWorkerCount(), numChunks);
+    if (numWorkers <= 1)
+    {
+        if (count > 0) task(ctx, 0, count);
+        return;
+    }
+
+#ifndef __EMSCRIPTEN__
+    /* a loop run from a task, or while another thread has the workers, runs on its caller */
+    pthread_once(&parallelPoolOnce, startPool);
+    if (parallelPool.numThreads == 0 || pthread_mutex_trylock(&parallelPool.busy) != 0)
+    {
+        task(ctx, 0, count);
+        return;
+    }
+
+    ParallelJob job = { task, ctx, count, grain, 0 };
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_mutex_lock(&parallelPool.lock);
+    parallelPool.job = &job;
+    parallelPool.generation += 1;
+    pthread_cond_broadcast(&parallelPool.posted);
+    pthread_mutex_unlock(&parallelPool.lock);
+
+    /* the caller works too, then waits for the workers still on a chunk. ones that wake up later find no job */
+    parallelWorker(&job);
+    pthread_mutex_lock(&parallelPool.lock);
+    parallelPool.job = NULL;
+    while (parallelPool.numActive > 0)
+        pthread_cond_wait(&parallelPool.left, &parallelPool.lock);
+    pthread_mutex_unlock(&parallelPool.lock);
+    pthread_mutex_destroy(&job.lock);
+    pthread_mutex_unlock(&parallelPool.busy);
+#endif
+}
+
+usize
+ParallelWorkerCount(void)
+{
+#ifdef __EMSCRIPTEN__
+    return 1;
+#else
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cores > 0) ? (usize)cores : 1;
+#endif
+}
+
+void *
+parallelWorker(void *arg)
+{
+#ifndef __EMSCRIPTEN__
+    ParallelJob *job = (ParallelJob *)arg;
+    while (true)
+    {
+        pthread_mutex_lock(&job->lock);
+        usize first = job->next;
+        job->next = min(first + job->grain, job->count);
+        pthread_mutex_unlock(&job->lock);
+        if (first >= job->count) break;
+        job->task(job->ctx, first, min(first + job->grain, job->count));
+    }
+#endif
+    return NULL;
+}
+
+void *
+poolThread(void *arg)
+{
+#ifndef __EMSCRIPTEN__
+    (void)arg;
+    u64 seen = 0;
+    pthread_mutex_lock(&parallelPool.lock);
+    while (true)
+    {
+        while (parallelPool.generation == seen)
+            pthread_cond_wait(&parallelPool.posted, &parallelPool.lock);
+        seen = parallelPool.generation;
+        ParallelJob *job = parallelPool.job;
+        if (!job) continue;
+
+        parallelPool.numActive += 1;
+        pthread_mutex_unlock(&parallelPool.lock);
+        parallelWorker(job);
+        pthread_mutex_lock(&parallelPool.lock);
+        parallelPool.numActive -= 1;
+        if (parallelPool.numActive == 0) pthread_cond_signal(&parallelPool.left);
+    }
+#endif
+    return NULL;
+}
+
+void
+startPool(void)
+{
+#ifndef __EMSCRIPTEN__
+    /* one thread per core besides the callers, fewer if some can't be started */
+    usize numThreads = ParallelWorkerCount() - 1;
+    for (usize i = 0; i < numThreads; i++)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, poolThread, NULL) != 0) break;
+        pthread_detach(thread);
+        parallelPool.numThreads += 1;
+    }
+#endif
+}
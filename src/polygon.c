@@ -0,0 +1,484 @@
+#include "polygon.h"
+#include "bsp.h"
+#include "f64_vector.h"
+#include "i32_vector.h"
+#include "raylib.h"
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+typedef struct KeptEdge {
+    usize start; /* index of first vertex of edge's ring */
+    usize size;  /* number of vertices in edge's ring */
+    usize from;  /* index (in ring) of edge's first vertex */
+    usize to;    /* index (in ring) of edge's last vertex (size if it wraps around to 0) */
+} KeptEdge;
+
+/* kept edges overlapping one cell of an EdgeGrid */
+typedef struct EdgeCell {
+    u32 *edges;   /* indices of edges whose bounding box overlaps the cell */
+    u32 count;    /* number of edges in cell */
+    u32 capacity; /* allocated size of edge array */
+} EdgeCell;
+
+/* uniform grid over the polygon's bounds, so an edge is only tested against edges near it */
+typedef struct EdgeGrid {
+    DVector2 origin; /* lower corner of the grid */
+    f64 cellSize;    /* world size of a (square) cell */
+    usize cols;      /* cells per row */
+    usize rows;      /* number of rows */
+    EdgeCell *cells; /* cols * rows cells, row by row */
+} EdgeGrid;
+
+/* ***************************** helpers ***************************** */
+void simplifyRange(const DVector2 *ring, usize size, bool *keep, usize from, usize to, f64 tolerance);
+usize farthestVertex(const DVector2 *ring, usize size, usize from, usize to, f64 *distance);
+f64 pointSegmentDistance(DVector2 pt, DVector2 a, DVector2 b);
+usize keptEdges(const Polygon *polygon, const bool *keep, KeptEdge *edges);
+void putBackVertices(const Polygon *polygon, bool *keep);
+void edgeGridRange(const Polygon *polygon, const EdgeGrid *grid, KeptEdge e, usize *cols, usize *rows);
+void edgeGridInsert(const Polygon *polygon, EdgeGrid *grid, KeptEdge e, u32 idx);
+bool edgeCrossesEdge(const Polygon *polygon, KeptEdge e, KeptEdge f);
+bool segmentsTouch(DVector2 p1, DVector2 p2, DVector2 q1, DVector2 q2);
+bool onSegment(DVector2 a, DVector2 b, DVector2 pt);
+bool ringContainsPoint(const DVector2 *ring, usize size, DVector2 pt);
+/* ******************************************************************* */
+
+Polygon *
+NewPolygon(void)
+{
+    Polygon *polygon = (Polygon *)malloc(sizeof(Polygon));
+    polygon->vertexCapacity = 64;
+    polygon->ringCapacity = 4;
+    polygon->vertices = (DVector2 *)malloc(polygon->vertexCapacity * sizeof(DVector2));
+    polygon->ringSizes = (usize *)malloc(polygon->ringCapacity * sizeof(usize));
+    polygon->ringKinds = (RingKind *)malloc(polygon->ringCapacity * sizeof(RingKind));
+    polygon->numVertices = 0;
+    polygon->numRings = 0;
+    polygon->ringStart = 0;
+    return polygon;
+}
+
+Polygon *
+PolygonFromGrid(const IVector2 *polygon, usize numVertices)
+{
+    Polygon *result = NewPolygon();
+    for (usize i = 0; i < numVertices; i++)
+        PolygonAddVertex(result, (DVector2){ polygon[i].x, polygon[i].y });
+    PolygonCloseRing(result);
+    return result;
+}
+
+void
+FreePolygon(Polygon *polygon)
+{
+    free(polygon->vertices);
+    free(polygon->ringSizes);
+    free(polygon->ringKinds);
+    free(polygon);
+}
+
+void
+PolygonAddVertex(Polygon *polygon, DVector2 vertex)
+{
+    /* repeated vertices would turn into zero length segments */
+    if (polygon->numVertices > polygon->ringStart)
+    {
+        DVector2 last = polygon->vertices[polygon->numVertices - 1];
+        if (last.x == vertex.x && last.y == vertex.y) return;
+    }
+    if (polygon->numVertices == polygon->vertexCapacity)
+    {
+        polygon->vertexCapacity *= 2;
+        polygon->vertices = (DVector2 *)realloc(polygon->vertices, polygon->vertexCapacity * sizeof(DVector2));
+    }
+    polygon->vertices[polygon->numVertices++] = vertex;
+}
+
+bool
+PolygonCloseRing(Polygon *polygon)
+{
+    return PolygonCloseRingKind(polygon, RingOuter);
+}
+
+bool
+PolygonCloseRingKind(Polygon *polygon, RingKind kind)
+{
+    usize size = polygon->numVertices - polygon->ringStart;
+
+    /* most formats repeat the first vertex to close a ring, we store it once */
+    if (size >= 2)
+    {
+        DVector2 first = polygon->vertices[polygon->ringStart];
+        DVector2 last = polygon->vertices[polygon->numVertices - 1];
+        if (first.x == last.x && first.y == last.y) size -= 1;
+    }
+
+    /* rings with less than 3 vertices don't enclose anything => drop them */
+    if (size < 3)
+    {
+        polygon->numVertices = polygon->ringStart;
+        return false;
+    }
+
+    if (polygon->numRings == polygon->ringCapacity)
+    {
+        polygon->ringCapacity *= 2;
+        polygon->ringSizes = (usize *)realloc(polygon->ringSizes, polygon->ringCapacity * sizeof(usize));
+        polygon->ringKinds = (RingKind *)realloc(polygon->ringKinds, polygon->ringCapacity * sizeof(RingKind));
+    }
+    polygon->ringKinds[polygon->numRings] = kind;
+    polygon->ringSizes[polygon->numRings++] = size;
+    polygon->numVertices = polygon->ringStart + size;
+    polygon->ringStart = polygon->numVertices;
+    return true;
+}
+
+usize
+PolygonClassifyRings(Polygon *polygon)
+{ /*
+   * for input formats that don't say which rings are holes (or say it with a
+   * winding nobody sticks to): a ring inside an odd number of other rings is
+   * a hole, so rooms, pillars in them and islands in the pillars all come
+   * out right. returns the number of holes
+   */
+    assert(polygon->ringStart == polygon->numVertices);
+    usize numHoles = 0, start = 0;
+    for (usize r = 0; r < polygon->numRings; r++)
+    {
+        usize depth = 0, otherStart = 0;
+        for (usize k = 0; k < polygon->numRings; k++)
+        {
+            if (k != r && ringContainsPoint(&polygon->vertices[otherStart], polygon->ringSizes[k], polygon->vertices[start])) depth += 1;
+            otherStart += polygon->ringSizes[k];
+        }
+        polygon->ringKinds[r] = (depth % 2 == 1) ? RingHole : RingOuter;
+        numHoles += (depth % 2 == 1);
+        start += polygon->ringSizes[r];
+    }
+    return numHoles;
+}
+
+usize
+SimplifyPolygon(Polygon *polygon, f64 tolerance)
+{ /*
+   * douglas-peucker on every closed ring. each dropped vertex is within
+   * tolerance of the simplified edge replacing it, so the hausdorff distance
+   * between the input and output boundaries is at most tolerance (in input
+   * units). simplified edges that touch any other edge get their farthest
+   * dropped vertex put back until nothing touches anymore, so a simple
+   * polygon stays simple
+   */
+    assert(polygon->ringStart == polygon->numVertices);
+    bool *keep = (bool *)calloc(max(polygon->numVertices, 1), sizeof(bool));
+
+    usize start = 0;
+    for (usize r = 0; r < polygon->numRings; r++)
+    {
+        const DVector2 *ring = &polygon->vertices[start];
+        usize size = polygon->ringSizes[r];
+
+        /* first vertex and the vertex farthest from it split the ring in two chains */
+        usize anchor = 1;
+        for (usize i = 2; i < size; i++)
+            if (DVector2Length(DVector2Subtract(ring[i], ring[0])) > DVector2Length(DVector2Subtract(ring[anchor], ring[0]))) anchor = i;
+        keep[start] = keep[start + anchor] = true;
+        simplifyRange(ring, size, &keep[start], 0, anchor, tolerance);
+        simplifyRange(ring, size, &keep[start], anchor, size, tolerance);
+
+        /* a ring needs at least 3 vertices to enclose anything */
+        usize numKept = 0;
+        for (usize i = 0; i < size; i++)
+            numKept += keep[start + i];
+        if (numKept < 3)
+        {
+            f64 d0, d1;
+            usize i0 = farthestVertex(ring, size, 0, anchor, &d0), i1 = farthestVertex(ring, size, anchor, size, &d1);
+            keep[start + ((d0 >= d1) ? i0 : i1)] = true;
+        }
+        start += size;
+    }
+
+    putBackVertices(polygon, keep);
+
+    /* compact kept vertices in place */
+    usize removed = 0, numVertices = 0;
+    start = 0;
+    for (usize r = 0; r < polygon->numRings; r++)
+    {
+        usize size = polygon->ringSizes[r], newSize = 0;
+        for (usize i = 0; i < size; i++)
+            if (keep[start + i]) polygon->vertices[numVertices + newSize++] = polygon->vertices[start + i];
+        removed += size - newSize;
+        polygon->ringSizes[r] = newSize;
+        numVertices += newSize;
+        start += size;
+    }
+    polygon->numVertices = numVertices;
+    polygon->ringStart = numVertices;
+    free(keep);
+
+    TraceLog(LOG_INFO, "SIMPLIFY: removed %u of %u segments (tolerance %g)", (u32)removed, (u32)(numVertices + removed), tolerance);
+    return removed;
+}
+
+void
+simplifyRange(const DVector2 *ring, usize size, bool *keep, usize from, usize to, f64 tolerance)
+{
+    /* explicit stack instead of recursion, long nearly straight chains would recurse once per vertex */
+    usize capacity = 64, top = 0;
+    usize *stack = (usize *)malloc(2 * capacity * sizeof(usize));
+    stack[top++] = from;
+    stack[top++] = to;
+    while (top > 0)
+    {
+        usize j = stack[--top], i = stack[--top];
+        f64 distance;
+        usize k = farthestVertex(ring, size, i, j, &distance);
+        if (k == i || distance <= tolerance) continue;
+        keep[k % size] = true;
+        if (top + 4 > 2 * capacity)
+        {
+            capacity *= 2;
+            stack = (usize *)realloc(stack, 2 * capacity * sizeof(usize));
+        }
+        stack[top++] = i;
+        stack[top++] = k;
+        stack[top++] = k;
+        stack[top++] = j;
+    }
+    free(stack);
+}
+
+usize
+farthestVertex(const DVector2 *ring, usize size, usize from, usize to, f64 *distance)
+{
+    /* ring indices past the end wrap around, returns from if there's nothing in between */
+    usize farthest = from;
+    *distance = 0.0;
+    for (usize k = from + 1; k < to; k++)
+    {
+        f64 d = pointSegmentDistance(ring[k % size], ring[from % size], ring[to % size]);
+        if (farthest == from || d > *distance)
+        {
+            farthest = k;
+            *distance = d;
+        }
+    }
+    return farthest;
+}
+
+f64
+pointSegmentDistance(DVector2 pt, DVector2 a, DVector2 b)
+{
+    DVector2 ab = DVector2Subtract(b, a);
+    DVector2 ap = DVector2Subtract(pt, a);
+    f64 length = DVector2DotProduct(ab, ab);
+    f64 t = (length > 0.0) ? clamp(DVector2DotProduct(ap, ab) / length, 0.0, 1.0) : 0.0;
+    return DVector2Length(DVector2Subtract(ap, (DVector2){ t * ab.x, t * ab.y }));
+}
+
+usize
+keptEdges(const Polygon *polygon, const bool *keep, KeptEdge *edges)
+{
+    usize numEdges = 0, start = 0;
+    for (usize r = 0; r < polygon->numRings; r++)
+    {
+        usize size = polygon->ringSizes[r], first = size, prev = size;
+        for (usize i = 0; i < size; i++)
+        {
+            if (!keep[start + i]) continue;
+            if (prev < size) edges[numEdges++] = (KeptEdge){ start, size, prev, i };
+            else first = i;
+            prev = i;
+        }
+        if (first < size) edges[numEdges++] = (KeptEdge){ start, size, prev, first + size };
+        start += size;
+    }
+    return numEdges;
+}
+
+void
+putBackVertices(const Polygon *polygon, bool *keep)
+{ /*
+   * put dropped vertices back until no simplified edge touches another
+   * edge. edges are bucketed in a uniform grid of about one cell per edge,
+   * so each one is only tested against the edges sharing a cell with it.
+   * a put back vertex replaces its edge with two, which can only touch
+   * edges near them: the simplified edges there are checked again, the
+   * rest stay checked
+   */
+    usize numVertices = polygon->numVertices;
+    if (numVertices == 0) return;
+    /* every put back vertex turns one edge into two */
+    KeptEdge *edges = (KeptEdge *)malloc((3 * numVertices + 1) * sizeof(KeptEdge));
+    bool *alive = (bool *)malloc((3 * numVertices + 1) * sizeof(bool));
+    u32 *seen = (u32 *)calloc(3 * numVertices + 1, sizeof(u32));
+    u32 *pending = (u32 *)malloc((3 * numVertices + 1) * sizeof(u32));
+    bool *isPending = (bool *)calloc(3 * numVertices + 1, sizeof(bool));
+    usize numEdges = keptEdges(polygon, keep, edges), numPending = 0;
+    u32 stamp = 0;
+
+    EdgeGrid grid;
+    DVector2 lo = polygon->vertices[0], hi = polygon->vertices[0];
+    for (usize i = 1; i < numVertices; i++)
+    {
+        lo = (DVector2){ min(lo.x, polygon->vertices[i].x), min(lo.y, polygon->vertices[i].y) };
+        hi = (DVector2){ max(hi.x, polygon->vertices[i].x), max(hi.y, polygon->vertices[i].y) };
+    }
+    f64 extent = max(hi.x - lo.x, hi.y - lo.y);
+    usize cellsPerSide = max((usize)ceil(sqrt((f64)numEdges)), 1);
+    grid.origin = lo;
+    grid.cellSize = (extent > 0.0) ? extent / cellsPerSide : 1.0;
+    grid.cols = min((usize)((hi.x - lo.x) / grid.cellSize), cellsPerSide - 1) + 1;
+    grid.rows = min((usize)((hi.y - lo.y) / grid.cellSize), cellsPerSide - 1) + 1;
+    grid.cells = (EdgeCell *)calloc(grid.cols * grid.rows, sizeof(EdgeCell));
+    for (usize i = 0; i < numEdges; i++)
+    {
+        alive[i] = true;
+        edgeGridInsert(polygon, &grid, edges[i], (u32)i);
+        if (edges[i].to - edges[i].from < 2) continue; /* edge of the input, nothing to put back */
+        pending[numPending++] = (u32)i;
+        isPending[i] = true;
+    }
+
+    while (numPending > 0)
+    {
+        u32 i = pending[--numPending];
+        isPending[i] = false;
+        if (!alive[i]) continue;
+        KeptEdge e = edges[i];
+        usize cols[2], rows[2];
+        edgeGridRange(polygon, &grid, e, cols, rows);
+        bool crossed = false;
+        stamp += 1;
+        for (usize y = rows[0]; y <= rows[1] && !crossed; y++)
+            for (usize x = cols[0]; x <= cols[1] && !crossed; x++)
+            {
+                const EdgeCell *cell = &grid.cells[y * grid.cols + x];
+                for (u32 c = 0; c < cell->count && !crossed; c++)
+                {
+                    u32 j = cell->edges[c];
+                    if (j == i || !alive[j] || seen[j] == stamp) continue;
+                    seen[j] = stamp;
+                    crossed = edgeCrossesEdge(polygon, e, edges[j]);
+                }
+            }
+        if (!crossed) continue;
+
+        /* ring indices of the second half start over below size, like every other edge's first vertex */
+        f64 distance;
+        usize k = farthestVertex(&polygon->vertices[e.start], e.size, e.from, e.to, &distance);
+        keep[e.start + k % e.size] = true;
+        alive[i] = false;
+        KeptEdge halves[2] = { { e.start, e.size, e.from, k }, { e.start, e.size, k % e.size, e.to - (k - k % e.size) } };
+        for (usize h = 0; h < 2; h++)
+        {
+            u32 idx = (u32)numEdges++;
+            edges[idx] = halves[h];
+            alive[idx] = true;
+            edgeGridInsert(polygon, &grid, halves[h], idx);
+        }
+        /* the halves and the simplified edges around them are (re)checked */
+        for (usize h = 0; h < 2; h++)
+        {
+            edgeGridRange(polygon, &grid, halves[h], cols, rows);
+            for (usize y = rows[0]; y <= rows[1]; y++)
+                for (usize x = cols[0]; x <= cols[1]; x++)
+                {
+                    const EdgeCell *cell = &grid.cells[y * grid.cols + x];
+                    for (u32 c = 0; c < cell->count; c++)
+                    {
+                        u32 j = cell->edges[c];
+                        if (!alive[j] || isPending[j] || edges[j].to - edges[j].from < 2) continue;
+                        pending[numPending++] = j;
+                        isPending[j] = true;
+                    }
+                }
+        }
+    }
+
+    for (usize c = 0; c < grid.cols * grid.rows; c++)
+        free(grid.cells[c].edges);
+    free(grid.cells);
+    free(isPending);
+    free(pending);
+    free(seen);
+    free(alive);
+    free(edges);
+}
+
+void
+edgeGridRange(const Polygon *polygon, const EdgeGrid *grid, KeptEdge e, usize *cols, usize *rows)
+{
+    /* first and last column and row of the cells the edge's bounding box overlaps */
+    DVector2 p = polygon->vertices[e.start + e.from % e.size], q = polygon->vertices[e.start + e.to % e.size];
+    cols[0] = (usize)clamp((min(p.x, q.x) - grid->origin.x) / grid->cellSize, 0.0, grid->cols - 1.0);
+    cols[1] = (usize)clamp((max(p.x, q.x) - grid->origin.x) / grid->cellSize, 0.0, grid->cols - 1.0);
+    rows[0] = (usize)clamp((min(p.y, q.y) - grid->origin.y) / grid->cellSize, 0.0, grid->rows - 1.0);
+    rows[1] = (usize)clamp((max(p.y, q.y) - grid->origin.y) / grid->cellSize, 0.0, grid->rows - 1.0);
+}
+
+void
+edgeGridInsert(const Polygon *polygon, EdgeGrid *grid, KeptEdge e, u32 idx)
+{
+    /* replaced edges stay in their cells, readers skip the ones that aren't alive anymore */
+    usize cols[2], rows[2];
+    edgeGridRange(polygon, grid, e, cols, rows);
+    for (usize y = rows[0]; y <= rows[1]; y++)
+        for (usize x = cols[0]; x <= cols[1]; x++)
+        {
+            EdgeCell *cell = &grid->cells[y * grid->cols + x];
+            if (cell->count == cell->capacity)
+            {
+                cell->capacity = max(2 * cell->capacity, 4);
+                cell->edges = (u32 *)realloc(cell->edges, cell->capacity * sizeof(u32));
+            }
+            cell->edges[cell->count++] = idx;
+        }
+}
+
+bool
+edgeCrossesEdge(const Polygon *polygon, KeptEdge e, KeptEdge f)
+{
+    const DVector2 *v = polygon->vertices;
+    DVector2 p1 = v[e.start + e.from % e.size], p2 = v[e.start + e.to % e.size];
+    DVector2 q1 = v[f.start + f.from % f.size], q2 = v[f.start + f.to % f.size];
+
+    /* neighboring edges share a vertex, they only clash if they fold back onto each other */
+    if (e.start == f.start && (e.to % e.size) == f.from) return onSegment(p1, p2, q2) || onSegment(q1, q2, p1);
+    if (e.start == f.start && (f.to % f.size) == e.from) return onSegment(p1, p2, q1) || onSegment(q1, q2, p2);
+    return segmentsTouch(p1, p2, q1, q2);
+}
+
+bool
+segmentsTouch(DVector2 p1, DVector2 p2, DVector2 q1, DVector2 q2)
+{
+    f64 d1 = DVector2Determinant(DVector2Subtract(q2, q1), DVector2Subtract(p1, q1));
+    f64 d2 = DVector2Determinant(DVector2Subtract(q2, q1), DVector2Subtract(p2, q1));
+    f64 d3 = DVector2Determinant(DVector2Subtract(p2, p1), DVector2Subtract(q1, p1));
+    f64 d4 = DVector2Determinant(DVector2Subtract(p2, p1), DVector2Subtract(q2, p1));
+    if (((d1 > 0.0 && d2 < 0.0) || (d1 < 0.0 && d2 > 0.0)) && ((d3 > 0.0 && d4 < 0.0) || (d3 < 0.0 && d4 > 0.0))) return true;
+    return onSegment(q1, q2, p1) || onSegment(q1, q2, p2) || onSegment(p1, p2, q1) || onSegment(p1, p2, q2);
+}
+
+bool
+onSegment(DVector2 a, DVector2 b, DVector2 pt)
+{
+    if (DVector2Determinant(DVector2Subtract(b, a), DVector2Subtract(pt, a)) != 0.0) return false;
+    return min(a.x, b.x) <= pt.x && pt.x <= max(a.x, b.x) && min(a.y, b.y) <= pt.y && pt.y <= max(a.y, b.y);
+}
+
+bool
+ringContainsPoint(const DVector2 *ring, usize size, DVector2 pt)
+{
+    /* even-odd rule, crossings of a ray from pt towards +x */
+    bool inside = false;
+    for (usize i = 0, j = size - 1; i < size; j = i++)
+    {
+        DVector2 a = ring[j], b = ring[i];
+        if ((a.y > pt.y) == (b.y > pt.y)) continue;
+        if (pt.x < a.x + (pt.y - a.y) * (b.x - a.x) / (b.y - a.y)) inside = !inside;
+    }
+    return inside;
+}
@@ -0,0 +1,124 @@
+#include "predicates.h"
+#include "bsp.h"
+#include "f64_vector.h"
+#include <float.h>
+#include <math.h>
+
+/*
+ * relative error bound of the f64 determinant, (3 + 16 eps) * eps with
+ * eps = 2^-53 (half an ulp of 1.0). see Shewchuk, "Adaptive Precision
+ * Floating-Point Arithmetic and Fast Robust Geometric Predicates"
+ */
+#define PREDICATE_EPS (DBL_EPSILON / 2.0)
+#define CCW_ERRBOUND_A ((3.0 + 16.0 * PREDICATE_EPS) * PREDICATE_EPS)
+#define MAX_EXPANSION 16
+
+/* ************************ helpers ************************ */
+f64 crossDiffExact(DVector2 a, DVector2 b, DVector2 c, DVector2 d);
+void twoSum(f64 a, f64 b, f64 *x, f64 *y);
+void twoDiff(f64 a, f64 b, f64 *x, f64 *y);
+void twoProduct(f64 a, f64 b, f64 *x, f64 *y);
+usize growExpansion(f64 *e, usize n, f64 b);
+/* ********************************************************* */
+
+f64
+Orient2D(DVector2 a, DVector2 b, DVector2 c)
+{
+    /* > 0 => c left of a -> b, same sign as DSegmentSide's determinant */
+    return CrossDiff(a, b, a, c);
+}
+
+f64
+CrossDiff(DVector2 a, DVector2 b, DVector2 c, DVector2 d)
+{ /*
+   * (b - a) x (d - c), Orient2D is the special case c = a. the f64 value is
+   * returned whenever it's far enough from zero for its sign to be right,
+   * which is all but the (nearly) degenerate inputs
+   */
+    f64 left = (b.x - a.x) * (d.y - c.y);
+    f64 right = (b.y - a.y) * (d.x - c.x);
+    f64 det = left - right;
+    f64 bound = CCW_ERRBOUND_A * (babs(left) + babs(right));
+    if (det > bound || -det > bound) return det;
+    return crossDiffExact(a, b, c, d);
+}
+
+f64
+crossDiffExact(DVector2 a, DVector2 b, DVector2 c, DVector2 d)
+{ /*
+   * every difference is split into an exact (hi, lo) pair, the products of
+   * the pairs into exact two-term products, and all 16 terms are summed into
+   * a nonoverlapping expansion. its largest (last) component has the sign of
+   * the exact determinant
+   */
+    f64 u[2][2], v[2][2]; /* u = b - a and v = d - c as (hi, lo) per axis */
+    twoDiff(b.x, a.x, &u[0][0], &u[0][1]);
+    twoDiff(b.y, a.y, &u[1][0], &u[1][1]);
+    twoDiff(d.x, c.x, &v[0][0], &v[0][1]);
+    twoDiff(d.y, c.y, &v[1][0], &v[1][1]);
+
+    f64 e[MAX_EXPANSION];
+    usize n = 0;
+    for (usize i = 0; i < 2; i++)
+    {
+        for (usize j = 0; j < 2; j++)
+        {
+            f64 hi, lo;
+            twoProduct(u[0][i], v[1][j], &hi, &lo);
+            n = growExpansion(e, n, lo);
+            n = growExpansion(e, n, hi);
+            twoProduct(u[1][i], v[0][j], &hi, &lo);
+            n = growExpansion(e, n, -lo);
+            n = growExpansion(e, n, -hi);
+        }
+    }
+    return (n > 0) ? e[n - 1] : 0.0;
+}
+
+void
+twoSum(f64 a, f64 b, f64 *x, f64 *y)
+{
+    /* x + y == a + b exactly */
+    *x = a + b;
+    f64 bVirtual = *x - a;
+    f64 aVirtual = *x - bVirtual;
+    *y = (a - aVirtual) + (b - bVirtual);
+}
+
+void
+twoDiff(f64 a, f64 b, f64 *x, f64 *y)
+{
+    /* x + y == a - b exactly */
+    *x = a - b;
+    f64 bVirtual = a - *x;
+    f64 aVirtual = *x + bVirtual;
+    *y = (a - aVirtual) + (bVirtual - b);
+}
+
+void
+twoProduct(f64 a, f64 b, f64 *x, f64 *y)
+{
+    /* x + y == a * b exactly, fma rounds only once so it recovers the low half */
+    *x = a * b;
+    *y = fma(a, b, -*x);
+}
+
+usize
+growExpansion(f64 *e, usize n, f64 b)
+{
+    /*
+     * adds b to the nonoverlapping expansion e[0..n) (increasing magnitude)
+     * and drops zero components, returns the new length
+     */
+    usize m = 0;
+    f64 q = b;
+    for (usize i = 0; i < n; i++)
+    {
+        f64 sum, err;
+        twoSum(q, e[i], &sum, &err);
+        q = sum;
+        if (err != 0.0) e[m++] = err;
+    }
+    if (q != 0.0 || m == 0) e[m++] = q;
+    return (m == 1 && e[0] == 0.0) ? 0 : m;
+}
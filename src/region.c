@@ -10,6 +10,7 @@
 
 /* ********** helpers ********** */
 void flipSplit(Region *region);
+usize findCrossings(const DSegment *boundary, usize boundarySize, DSegment line, DVector2 *points, usize *indexes);
 /* ***************************** */
 
 Region *
@@ -46,18 +47,7 @@ BuildRegion(usize width, usize height, DSegment initialLine)
        */
         DVector2 intersections[2];
         usize indexes[2];
-        usize numIntersections = 0;
-        for (usize i = 0; i < region->boundarySize; i++)
-        {
-            if (DSegmentsParallel(initialLine, region->boundary[i])) continue;
-            DVector2 intersection = DSegmentIntersection(initialLine, region->boundary[i]);
-            if (DSegmentContainsPoint(region->boundary[i], intersection))
-            {
-                intersections[numIntersections] = intersection;
-                indexes[numIntersections] = i;
-                numIntersections += 1;
-            }
-        }
+        usize numIntersections = findCrossings(region->boundary, region->boundarySize, initialLine, intersections, indexes);
         assert(numIntersections == 2);
         region->line.left = intersections[0];
         region->leftIdx = indexes[0];
@@ -136,30 +126,17 @@ NewRegion(Region *oldRegion, DSegment *segments, usize numSegments, SplitDirecti
     { /*
        * create new active segment from newLine (if it exists)
        *
-       * there's a chance that the intersection is in a corner between two
-       * boundary segments, in which case we just choose one
+       * an intersection in a corner between two boundary segments is only
+       * counted for one of them (see findCrossings)
        */
-        bool intersectedOnce = false;
-        for (usize i = 0; i < newRegion->boundarySize; i++)
-        {
-            if (DSegmentsParallel(segments[0], newRegion->boundary[i])) continue;
-            DVector2 intersection = DSegmentIntersection(segments[0], newRegion->boundary[i]);
-            if (DSegmentContainsPoint(newRegion->boundary[i], intersection))
-            {
-                if (!intersectedOnce)
-                {
-                    newRegion->line.left = intersection;
-                    newRegion->leftIdx = i;
-                    intersectedOnce = true;
-                }
-                else if (!DVector2DIsEqual(newRegion->line.left, intersection))
-                {
-                    newRegion->line.right = intersection;
-                    newRegion->rightIdx = i;
-                    break;
-                }
-            }
-        }
+        DVector2 intersections[2];
+        usize indexes[2];
+        usize numIntersections = findCrossings(newRegion->boundary, newRegion->boundarySize, segments[0], intersections, indexes);
+        assert(numIntersections == 2);
+        newRegion->line.left = intersections[0];
+        newRegion->leftIdx = indexes[0];
+        newRegion->line.right = intersections[1];
+        newRegion->rightIdx = indexes[1];
         /* split line and node segment(s) go in opposing directions => flip split line */
         if (DSegmentsDotProduct(segments[0], newRegion->line) < 0) flipSplit(newRegion);
     }
@@ -206,3 +183,28 @@ flipSplit(Region *region)
     region->line.right = tmp;
     region->rightIdx = tmpIdx;
 }
+
+usize
+findCrossings(const DSegment *boundary, usize boundarySize, DSegment line, DVector2 *points, usize *indexes)
+{ /*
+   * boundary segments whose endpoints the line separates, decided with
+   * exact side tests rather than by checking whether a rounded
+   * intersection lands on the segment. a corner on the line counts as
+   * being on the right, so a line through a corner crosses exactly one of
+   * the two segments meeting there and a convex boundary is crossed
+   * exactly twice by any line through its interior
+   */
+    usize numCrossings = 0;
+    for (usize i = 0; i < boundarySize && numCrossings < 2; i++)
+    {
+        DSide left = DSegmentSide(line, boundary[i].left);
+        DSide right = DSegmentSide(line, boundary[i].right);
+        if ((left == DSideLeft) == (right == DSideLeft)) continue;
+        if (left == DSideInside) points[numCrossings] = boundary[i].left;
+        else if (right == DSideInside) points[numCrossings] = boundary[i].right;
+        else points[numCrossings] = DSegmentIntersection(line, boundary[i]);
+        indexes[numCrossings] = i;
+        numCrossings += 1;
+    }
+    return numCrossings;
+}
@@ -1,11 +1,14 @@
 #include "s2.h"
 #include "bsp.h"
+#include "bsp_exact.h"
 #include "bsp_tree.h"
 #include "f64_segment.h"
+#include "polygon.h"
 #include "raylib.h"
 #include "region.h"
 #include "triangulation.h"
 #include <stdbool.h>
+#include <stdlib.h>
 
 /* ********** helpers ********** */
 /* ***************************** */
@@ -18,7 +21,7 @@ void BspTreeRewind(S2 *scene);
 /* ***************************** */
 
 BspStage
-S2_Init(IVector2 *polygon, usize numVertices, S2 *scene)
+S2_Init(const Polygon *polygon, S2 *scene)
 {
     BoundingRegion segmentsRegion = {
         .left = 0,
@@ -32,8 +35,10 @@ S2_Init(IVector2 *polygon, usize numVertices, S2 *scene)
         .top = 0,
         .bottom = HEIGHT,
     };
-    scene->segments = BuildSegments(polygon, numVertices, segmentsRegion, &scene->numSegments);
-    scene->tree = BuildBspTreeMeta(scene->segments, scene->numSegments, treeRegion);
+    scene->segments = BuildPolygonSegments(polygon, segmentsRegion, &scene->numSegments);
+    scene->floor = TriangulatePolygon(scene->segments, polygon->ringSizes, polygon->ringKinds, polygon->numRings, &scene->floorSize);
+    /* the tree is built in the polygon's own (grid) space when it can be and scaled to match segmentsRegion */
+    scene->tree = WrapBspTreeMeta(BuildPolygonBspTree(polygon, segmentsRegion), treeRegion);
     scene->building = false;
     scene->buildTreeDt = 0.0f;
     scene->treeBuilt = false;
@@ -110,6 +115,8 @@ S2_Render(S2 *scene)
     BeginDrawing();
 
     ClearBackground(WHITE);
+    for (usize i = 0; i < scene->floorSize; i++)
+        DrawTriangle(scene->floor[i].v1, scene->floor[i].v2, scene->floor[i].v3, Fade(LIGHTGRAY, 0.5f));
     DrawSegments(scene->segments, scene->numSegments);
     DrawBspTreeMeta(scene->tree);
     if (scene->drawAllRegions) DrawAllBspRegions(scene);
@@ -136,6 +143,7 @@ void
 S2_Free(S2 *scene)
 {
     FreeSegments(scene->segments);
+    free(scene->floor);
     FreeBspTreeMeta(scene->tree);
     scene->initialized = false;
     *scene = (S2){ 0 };
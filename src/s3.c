@@ -1,10 +1,15 @@
 #include "s3.h"
 #include "bsp.h"
+#include "bsp_bake.h"
+#include "bsp_exact.h"
+#include "bsp_flat.h"
 #include "bsp_tree.h"
 #include "f32_segment.h"
 #include "f64_segment.h"
+#include "polygon.h"
 #include "raylib.h"
 #include "raymath.h"
+#include "tile_cache.h"
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
@@ -12,26 +17,28 @@
 /* ************************** helpers ************************** */
 /* ************************************************************* */
 void DrawWall(Player p, FSegment s, f32 height, Color color);
-void DrawNode(BspNode *node, Player p);
-void DrawScene(BspNode *node, Player p);
-void DrawSceneReverse(BspNode *node, Player p);
+void DrawViewWall(Player p, ViewVertex a, ViewVertex b, f32 height, Color color);
+ViewVertex ViewTransform(Player p, Vector2 pt);
+void DrawFlatNode(const BspFlatTree *tree, const ViewVertex *view, u32 idx, Player p);
+void DrawFlatScene(const BspFlatTree *tree, const ViewVertex *view, u32 idx, Player p, bool reverse);
+void DrawFlatTree(S3 *scene, const BspFlatTree *tree);
+void DrawTiles(S3 *scene);
+void DrawTileMinimap(S3 *scene);
 Vector2 TranslatePoint(Vector2 pt, BoundingRegion region);
 FSegment TranslateSegment(FSegment segment, BoundingRegion region);
 /* ************************************************************* */
 /* ************************************************************* */
 
 BspStage
-S3_Init(IVector2 *polygon, usize numVertices, S3 *scene)
+S3_Init(const Polygon *polygon, S3 *scene)
 {
     BoundingRegion fullScreen = { 0, WIDTH, 0, HEIGHT };
     usize numSegments = 0;
-    DSegment *segments = BuildSegments(polygon, numVertices, fullScreen, &numSegments);
-    DSegment *segmentsCopy = (DSegment *)malloc(numSegments * sizeof(DSegment));
-    memcpy(segmentsCopy, segments, numSegments * sizeof(DSegment));
+    DSegment *segments = BuildPolygonSegments(polygon, fullScreen, &numSegments);
 
     scene->minimapRegion = (BoundingRegion){ 2 * WIDTH / 3, WIDTH, 0, HEIGHT / 3 };
-    scene->minimap = BuildFSegments(segmentsCopy, numSegments, scene->minimapRegion, &scene->numSegments);
-    scene->tree = BuildBspTree(segmentsCopy, numSegments, NULL);
+    scene->minimap = BuildFSegments(segments, numSegments, scene->minimapRegion, &scene->numSegments);
+    scene->tree = BuildPolygonBspTree(polygon, fullScreen);
     scene->player = PlayerInit((Vector2){ WIDTH / 2.0f, HEIGHT / 2.0f }, (Vector2){ 0.0f, -1.0f }, PI / 6.0f);
     scene->colors = (Color *)malloc(numSegments * sizeof(Color));
     for (usize i = 0; i < numSegments; i++)
@@ -44,7 +51,7 @@ S3_Init(IVector2 *polygon, usize numVertices, S3 *scene)
         {
             for (usize i = 0; i < numSegments; i++)
             {
-                if (DSegmentSides(segments[i], node->segments[0]) == DSideInside)
+                if (BspSplitSides(segments[i], node->segments[0]) == DSideInside)
                 {
                     if (scene->colors[i].a == 0) scene->colors[i] = colors[idx % numColors];
                     node->color = scene->colors[i];
@@ -54,7 +61,14 @@ S3_Init(IVector2 *polygon, usize numVertices, S3 *scene)
             }
         }
     }
-
+    /* rendering walks the flat copy, colors travel along in its cold array */
+    scene->flat = FlattenBspTree(scene->tree);
+
+    scene->tiles = NULL;
+    scene->resident = NULL;
+    scene->numResident = 0;
+    scene->view = NULL;
+    scene->viewCapacity = 0;
     scene->helpButton = (Vector2){ WIDTH - 40, HEIGHT - 40 };
     scene->helpMenu = true;
     scene->useBspTree = true;
@@ -64,6 +78,33 @@ S3_Init(IVector2 *polygon, usize numVertices, S3 *scene)
     return S3_PENDING;
 }
 
+BspStage
+S3_InitTiles(const TileIndex *index, usize memoryCap, S3 *scene)
+{ /*
+   * tiled worlds have no single tree, tiles around the player are streamed in
+   * by the tile cache and rendered one tile tree at a time
+   */
+    scene->minimapRegion = (BoundingRegion){ 2 * WIDTH / 3, WIDTH, 0, HEIGHT / 3 };
+    scene->minimap = NULL;
+    scene->numSegments = 0;
+    scene->colors = NULL;
+    scene->tree = NULL;
+    scene->flat = NULL;
+    scene->tiles = NewTileCache(index, memoryCap);
+    scene->resident = (u32 *)malloc((usize)index->grid.cols * index->grid.rows * sizeof(u32));
+    scene->numResident = 0;
+    scene->view = NULL;
+    scene->viewCapacity = 0;
+    scene->player = PlayerInit((Vector2){ WIDTH / 2.0f, HEIGHT / 2.0f }, (Vector2){ 0.0f, -1.0f }, PI / 6.0f);
+    scene->lastPos = scene->player.pos;
+    scene->helpButton = (Vector2){ WIDTH - 40, HEIGHT - 40 };
+    scene->helpMenu = true;
+    scene->useBspTree = true;
+    scene->initialized = true;
+
+    return S3_PENDING;
+}
+
 BspStage
 S3_Render(S3 *scene)
 {
@@ -84,16 +125,26 @@ S3_Render(S3 *scene)
     if (IsKeyDown(KEY_UP)) PlayerUpdateFov(&scene->player, 0.0001f * fovMultiplier);
     if (IsKeyDown(KEY_DOWN)) PlayerUpdateFov(&scene->player, -0.0001f * fovMultiplier);
     if (IsKeyPressed(KEY_SPACE)) scene->useBspTree = !scene->useBspTree;
+    if (IsKeyPressed(KEY_E) && scene->tree) BakeBspTree(scene->tree, "bakedTree", "baked_tree.c");
+
+    if (scene->tiles)
+    {
+        const TileGrid *grid = &scene->tiles->index->grid;
+        f32 dt = GetFrameTime();
+        Vector2 velocity = (dt > 0.0f) ? Vector2Scale(Vector2Subtract(scene->player.pos, scene->lastPos), 1.0f / dt) : Vector2Zero();
+        scene->lastPos = scene->player.pos;
+        scene->numResident = TileCacheUpdate(scene->tiles, scene->player.pos, velocity, scene->resident, (usize)grid->cols * grid->rows);
+    }
 
     BeginDrawing();
 
     ClearBackground(RAYWHITE);
     DrawRectangle(0, HEIGHT / 2, WIDTH, HEIGHT / 2, LIGHTGRAY);
-    if (scene->useBspTree) DrawScene(scene->tree, scene->player);
-    else DrawSceneReverse(scene->tree, scene->player);
+    if (scene->tiles) DrawTiles(scene);
+    else DrawFlatTree(scene, scene->flat);
     DrawMinimap(scene);
 
-    if (scene->helpMenu) DrawHelpMenu(S3_HELP_MENU, 7);
+    if (scene->helpMenu) DrawHelpMenu(S3_HELP_MENU, 8);
     DrawHelpMenuButton(scene->helpButton);
 
     EndDrawing();
@@ -112,7 +163,11 @@ S3_Free(S3 *scene)
 {
     free(scene->minimap);
     free(scene->colors);
-    FreeBspTree(scene->tree);
+    free(scene->resident);
+    free(scene->view);
+    if (scene->tree) FreeBspTree(scene->tree);
+    if (scene->flat) FreeBspFlatTree(scene->flat);
+    if (scene->tiles) FreeTileCache(scene->tiles);
     scene->initialized = false;
     *scene = (S3){ 0 };
 }
@@ -183,63 +238,87 @@ PlayerUpdateFov(Player *p, f32 dt)
 }
 
 void
-DrawNode(BspNode *node, Player p)
+DrawFlatNode(const BspFlatTree *tree, const ViewVertex *view, u32 idx, Player p)
 {
-    for (usize i = 0; i < node->numSegments; i++)
-    {
-        FSegment segment = {
-            .origin = (Vector2){ node->segments[i].left.x, node->segments[i].left.y },
-            .dest = (Vector2){ node->segments[i].right.x, node->segments[i].right.y },
-        };
-        DrawWall(p, segment, 100.0f * p.vfov, node->color);
-    }
+    usize numFragments = 0;
+    const BspFragment *fragments = BspFlatNodeFragments(tree, idx, &numFragments);
+    for (usize i = 0; i < numFragments; i++)
+        DrawViewWall(p, view[fragments[i].left], view[fragments[i].right], 100.0f * p.vfov, tree->colors[idx]);
 }
 
 void
-DrawScene(BspNode *node, Player p)
-{
-    if (node == NULL) return;
-    else if (IsLeaf(node)) DrawNode(node, p);
-    else if (DSegmentSide(node->segments[0], (DVector2){ p.pos.x, p.pos.y }) == DSideRight)
+DrawFlatScene(const BspFlatTree *tree, const ViewVertex *view, u32 idx, Player p, bool reverse)
+{ /*
+   * painter's order draws the subtree on the player's far side first, reverse
+   * (BSP rendering toggled off) flips it to show why the order matters
+   */
+    if (idx == BSP_NULL_IDX) return;
+    DSide side = BspFlatNodeSide(tree, idx, (DVector2){ p.pos.x, p.pos.y });
+    u32 first = tree->nodes[idx].left, second = tree->nodes[idx].right;
+    if (side == DSideRight)
     {
-        DrawScene(node->right, p);
-        DrawNode(node, p);
-        DrawScene(node->left, p);
+        first = tree->nodes[idx].right;
+        second = tree->nodes[idx].left;
     }
-    else if (DSegmentSide(node->segments[0], (DVector2){ p.pos.x, p.pos.y }) == DSideLeft)
+    if (reverse)
     {
-        DrawScene(node->left, p);
-        DrawNode(node, p);
-        DrawScene(node->right, p);
+        u32 tmp = first;
+        first = second;
+        second = tmp;
     }
-    else
+
+    DrawFlatScene(tree, view, first, p, reverse);
+    if (side != DSideInside || BspFlatIsLeaf(tree, idx)) DrawFlatNode(tree, view, idx, p);
+    DrawFlatScene(tree, view, second, p, reverse);
+}
+
+void
+DrawTiles(S3 *scene)
+{ /*
+   * resident tiles come sorted front-to-back, painter's order walks them
+   * backwards so nearer tiles are drawn over farther ones
+   */
+    for (usize k = 0; k < scene->numResident; k++)
     {
-        DrawScene(node->left, p);
-        DrawScene(node->right, p);
+        u32 tile = scene->useBspTree ? scene->resident[scene->numResident - 1 - k] : scene->resident[k];
+        DrawFlatTree(scene, TileCacheTree(scene->tiles, tile));
     }
 }
 
 void
-DrawSceneReverse(BspNode *node, Player p)
+DrawFlatTree(S3 *scene, const BspFlatTree *tree)
 {
-    if (node == NULL) return;
-    else if (IsLeaf(node)) DrawNode(node, p);
-    else if (DSegmentSide(node->segments[0], (DVector2){ p.pos.x, p.pos.y }) == DSideRight)
-    {
-        DrawSceneReverse(node->left, p);
-        DrawNode(node, p);
-        DrawSceneReverse(node->right, p);
-    }
-    else if (DSegmentSide(node->segments[0], (DVector2){ p.pos.x, p.pos.y }) == DSideLeft)
+    if (tree->numNodes == 0) return;
+
+    /* every pooled vertex is taken to view space once, walls sharing it reuse the result */
+    if (tree->numVertices > scene->viewCapacity)
     {
-        DrawSceneReverse(node->right, p);
-        DrawNode(node, p);
-        DrawSceneReverse(node->left, p);
+        scene->viewCapacity = tree->numVertices;
+        scene->view = (ViewVertex *)realloc(scene->view, scene->viewCapacity * sizeof(ViewVertex));
     }
-    else
+    for (usize i = 0; i < tree->numVertices; i++)
+        scene->view[i] = ViewTransform(scene->player, (Vector2){ tree->vertices[i].x, tree->vertices[i].y });
+    DrawFlatScene(tree, scene->view, 0, scene->player, !scene->useBspTree);
+}
+
+void
+DrawTileMinimap(S3 *scene)
+{
+    for (usize k = 0; k < scene->numResident; k++)
     {
-        DrawSceneReverse(node->right, p);
-        DrawSceneReverse(node->left, p);
+        const BspFlatTree *tree = TileCacheTree(scene->tiles, scene->resident[k]);
+        for (u32 idx = 0; idx < tree->numNodes; idx++)
+        {
+            usize numFragments = 0;
+            const BspFragment *fragments = BspFlatNodeFragments(tree, idx, &numFragments);
+            for (usize i = 0; i < numFragments; i++)
+            {
+                DSegment s = BspFlatFragmentSegment(tree, fragments[i]);
+                Vector2 origin = TranslatePoint((Vector2){ s.left.x, s.left.y }, scene->minimapRegion);
+                Vector2 dest = TranslatePoint((Vector2){ s.right.x, s.right.y }, scene->minimapRegion);
+                DrawLineEx(origin, dest, 3.0f, tree->colors[idx]);
+            }
+        }
     }
 }
 
@@ -255,6 +334,7 @@ DrawMinimap(S3 *scene)
 
     for (usize i = 0; i < scene->numSegments; i++)
         DrawLineEx(scene->minimap[i].origin, scene->minimap[i].dest, 3.0f, scene->colors[i]);
+    if (scene->tiles) DrawTileMinimap(scene);
 
     Vector2 p = TranslatePoint(scene->player.pos, region);
     Vector2 pp = Vector2Subtract(p, Vector2Scale(scene->player.dir, 10.0f));
@@ -303,22 +383,41 @@ DrawMinimap(S3 *scene)
 void
 DrawWall(Player p, FSegment s, f32 height, Color color)
 {
-    FSegment sp = s;
+    DrawViewWall(p, ViewTransform(p, s.origin), ViewTransform(p, s.dest), height, color);
+}
+
+ViewVertex
+ViewTransform(Player p, Vector2 pt)
+{
+    return (ViewVertex){
+        .pos = pt,
+        .leftSide = FSegmentSide(p.left, pt),
+        .rightSide = FSegmentSide(p.right, pt),
+        .depth = Vector2DotProduct(p.dir, Vector2Subtract(pt, p.pos)),
+    };
+}
+
+void
+DrawViewWall(Player p, ViewVertex a, ViewVertex b, f32 height, Color color)
+{
+    FSegment s = { .origin = a.pos, .dest = b.pos };
     if (Vector2Determinant(p.dir, Vector2Subtract(s.dest, s.origin)) < 0.0f)
     {
-        sp.origin = s.dest;
-        sp.dest = s.origin;
+        ViewVertex tmp = a;
+        a = b;
+        b = tmp;
     }
+    FSegment sp = { .origin = a.pos, .dest = b.pos };
 
-    Side playerLeftShapeOriginSide = FSegmentSide(p.left, sp.origin);
-    Side playerLeftShapeDestSide = FSegmentSide(p.left, sp.dest);
+    Side playerLeftShapeOriginSide = a.leftSide;
+    Side playerLeftShapeDestSide = b.leftSide;
     if (playerLeftShapeOriginSide != FSideRight && playerLeftShapeDestSide != FSideRight) return;
 
-    Side playerRightShapeOriginSide = FSegmentSide(p.right, sp.origin);
-    Side playerRightShapeDestSide = FSegmentSide(p.right, sp.dest);
+    Side playerRightShapeOriginSide = a.rightSide;
+    Side playerRightShapeDestSide = b.rightSide;
     if (playerRightShapeOriginSide != FSideLeft && playerRightShapeDestSide != FSideLeft) return;
 
-    if (Vector2DotProduct(p.dir, Vector2Subtract(sp.origin, p.pos)) < 0.0f && Vector2DotProduct(p.dir, Vector2Subtract(sp.dest, p.pos)) < 0.0f) return;
+    if (a.depth < 0.0f && b.depth < 0.0f) return;
 
     if (playerLeftShapeOriginSide == FSideLeft && playerLeftShapeDestSide == FSideRight)
     {
@@ -0,0 +1,111 @@
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "bsp_tree.h"
+#include "spatial_index.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ******************** helpers ******************** */
+bool bspSpatialContains(const void *impl, DVector2 pt);
+bool bspSpatialRayCast(const void *impl, DVector2 origin, DVector2 dir, f64 maxDistance, SpatialHit *hit);
+usize bspSpatialQueryBox(const void *impl, SpatialBox box, u32 *segments, usize capacity);
+int bspSourceCmp(const void *a, const void *b);
+bool bspSpatialNearest(const void *impl, DVector2 pt, SpatialHit *hit);
+usize bspSpatialMemory(const void *impl);
+void bspSpatialFree(void *impl);
+/* ************************************************* */
+
+const SpatialIndexOps BspSpatialOps = {
+    .containsPoint = bspSpatialContains,
+    .rayCast = bspSpatialRayCast,
+    .queryBox = bspSpatialQueryBox,
+    .nearest = bspSpatialNearest,
+    .memoryUsage = bspSpatialMemory,
+    .free = bspSpatialFree,
+};
+
+void *
+BuildBspSpatialIndex(const DSegment *segments, usize numSegments)
+{
+    /* the build takes ownership of its array, so it gets a copy, numbered so hits can name their segment */
+    DSegment *copy = (DSegment *)malloc(max(numSegments, 1) * sizeof(DSegment));
+    memcpy(copy, segments, numSegments * sizeof(DSegment));
+    for (usize i = 0; i < numSegments; i++)
+        copy[i].id = (u32)i;
+    BspNode *root = BuildBspTree(copy, numSegments, NULL);
+    BspFlatTree *tree = FlattenBspTree(root);
+    FreeBspTree(root);
+    LabelBspFlatTree(tree);
+    BoundBspFlatTree(tree);
+    return tree;
+}
+
+bool
+bspSpatialContains(const void *impl, DVector2 pt)
+{
+    return BspFlatContainsPoint((const BspFlatTree *)impl, pt);
+}
+
+bool
+bspSpatialRayCast(const void *impl, DVector2 origin, DVector2 dir, f64 maxDistance, SpatialHit *hit)
+{
+    BspRayHit rayHit;
+    if (!BspFlatRayCast((const BspFlatTree *)impl, origin, dir, maxDistance, &rayHit)) return false;
+    *hit = (SpatialHit){ rayHit.distance, rayHit.point, rayHit.source };
+    return true;
+}
+
+usize
+bspSpatialQueryBox(const void *impl, SpatialBox box, u32 *segments, usize capacity)
+{ /*
+   * the tree reports fragments, and a segment split into several can show
+   * up more than once. the sources are sorted to drop repeats, when they
+   * don't all fit the query is run again into a buffer that holds them all
+   */
+    const BspFlatTree *tree = (const BspFlatTree *)impl;
+    BspBox query = { box.min, box.max };
+    usize found = BspFlatQueryBox(tree, query, segments, capacity);
+    u32 *ids = (found > capacity) ? (u32 *)malloc(found * sizeof(u32)) : segments;
+    if (ids != segments) BspFlatQueryBox(tree, query, ids, found);
+    for (usize i = 0; i < found; i++)
+        ids[i] = tree->fragments[ids[i]].source;
+    qsort(ids, found, sizeof(u32), bspSourceCmp);
+    usize numUnique = 0;
+    for (usize i = 0; i < found; i++)
+        if (numUnique == 0 || ids[i] != ids[numUnique - 1]) ids[numUnique++] = ids[i];
+    if (ids != segments)
+    {
+        memcpy(segments, ids, min(numUnique, capacity) * sizeof(u32));
+        free(ids);
+    }
+    return numUnique;
+}
+
+int
+bspSourceCmp(const void *a, const void *b)
+{
+    u32 ia = *(const u32 *)a, ib = *(const u32 *)b;
+    return (ia > ib) - (ia < ib);
+}
+
+bool
+bspSpatialNearest(const void *impl, DVector2 pt, SpatialHit *hit)
+{
+    BspRayHit nearest;
+    bool found = BspFlatNearestFragment((const BspFlatTree *)impl, pt, INFINITY, &nearest);
+    *hit = (SpatialHit){ nearest.distance, nearest.point, nearest.source };
+    return found;
+}
+
+usize
+bspSpatialMemory(const void *impl)
+{
+    return BspFlatTreeBytes((const BspFlatTree *)impl);
+}
+
+void
+bspSpatialFree(void *impl)
+{
+    FreeBspFlatTree((BspFlatTree *)impl);
+}
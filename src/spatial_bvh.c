@@ -0,0 +1,263 @@
+#include "bsp.h"
+#include "spatial_index.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BVH_LEAF_SIZE 4
+
+typedef struct BvhNode {
+    SpatialBox box; /* bounds of every segment below */
+    u32 first;      /* first child, the second is first + 1 (inner) / first segment (leaf) */
+    u32 count;      /* number of segments (leaves), 0 for inner nodes */
+} BvhNode;
+
+/*
+ * bounding volume hierarchy over segment bounding boxes, split at the median
+ * center along the longer side of each node's box. every segment lives in
+ * exactly one leaf (the segments are reordered so each leaf's are
+ * contiguous), the price is that sibling boxes may overlap
+ */
+typedef struct BvhSpatial {
+    BvhNode *nodes;
+    usize numNodes;
+    DSegment *segments; /* input segments, reordered by leaf */
+    u32 *ids;           /* index in the input of each reordered segment */
+    usize numSegments;
+} BvhSpatial;
+
+/* sort key of a segment along the axis being split */
+typedef struct BvhKey {
+    f64 center;
+    u32 id;
+} BvhKey;
+
+/* ******************** helpers ******************** */
+void buildBvhNode(BvhSpatial *bvh, u32 idx, const DSegment *segments, BvhKey *keys, usize first, usize n);
+int bvhKeyCmp(const void *a, const void *b);
+u32 bvhCrossings(const BvhSpatial *bvh, u32 idx, DVector2 pt);
+void bvhRayCast(const BvhSpatial *bvh, u32 idx, DVector2 origin, DVector2 dir, f64 tMax, SpatialHit *hit);
+usize bvhQueryBox(const BvhSpatial *bvh, u32 idx, SpatialBox query, u32 *segments, usize capacity, usize found);
+void bvhNearest(const BvhSpatial *bvh, u32 idx, DVector2 pt, SpatialHit *best);
+bool bvhSpatialContains(const void *impl, DVector2 pt);
+bool bvhSpatialRayCast(const void *impl, DVector2 origin, DVector2 dir, f64 maxDistance, SpatialHit *hit);
+usize bvhSpatialQueryBox(const void *impl, SpatialBox box, u32 *segments, usize capacity);
+bool bvhSpatialNearest(const void *impl, DVector2 pt, SpatialHit *hit);
+usize bvhSpatialMemory(const void *impl);
+void bvhSpatialFree(void *impl);
+/* ************************************************* */
+
+const SpatialIndexOps BvhSpatialOps = {
+    .containsPoint = bvhSpatialContains,
+    .rayCast = bvhSpatialRayCast,
+    .queryBox = bvhSpatialQueryBox,
+    .nearest = bvhSpatialNearest,
+    .memoryUsage = bvhSpatialMemory,
+    .free = bvhSpatialFree,
+};
+
+void *
+BuildBvhSpatialIndex(const DSegment *segments, usize numSegments)
+{
+    BvhSpatial *bvh = (BvhSpatial *)malloc(sizeof(BvhSpatial));
+    bvh->numSegments = numSegments;
+    bvh->segments = (DSegment *)malloc(max(numSegments, 1) * sizeof(DSegment));
+    bvh->ids = (u32 *)malloc(max(numSegments, 1) * sizeof(u32));
+    /* a binary tree with leaves of at least one segment has fewer than 2n nodes */
+    bvh->nodes = (BvhNode *)malloc(max(2 * numSegments, 1) * sizeof(BvhNode));
+    bvh->numNodes = 0;
+    if (numSegments == 0) return bvh;
+
+    BvhKey *keys = (BvhKey *)malloc(numSegments * sizeof(BvhKey));
+    for (usize i = 0; i < numSegments; i++) keys[i] = (BvhKey){ 0.0, (u32)i };
+    bvh->numNodes = 1;
+    buildBvhNode(bvh, 0, segments, keys, 0, numSegments);
+    for (usize i = 0; i < numSegments; i++)
+    {
+        bvh->ids[i] = keys[i].id;
+        bvh->segments[i] = segments[keys[i].id];
+    }
+    free(keys);
+    return bvh;
+}
+
+void
+buildBvhNode(BvhSpatial *bvh, u32 idx, const DSegment *segments, BvhKey *keys, usize first, usize n)
+{
+    SpatialBox box = SpatialSegmentBox(segments[keys[first].id]);
+    for (usize i = first + 1; i < first + n; i++)
+    {
+        SpatialBox b = SpatialSegmentBox(segments[keys[i].id]);
+        box.min = (DVector2){ min(box.min.x, b.min.x), min(box.min.y, b.min.y) };
+        box.max = (DVector2){ max(box.max.x, b.max.x), max(box.max.y, b.max.y) };
+    }
+    bvh->nodes[idx].box = box;
+    if (n <= BVH_LEAF_SIZE)
+    {
+        bvh->nodes[idx].first = (u32)first;
+        bvh->nodes[idx].count = (u32)n;
+        return;
+    }
+
+    bool xAxis = box.max.x - box.min.x >= box.max.y - box.min.y;
+    for (usize i = first; i < first + n; i++)
+    {
+        DSegment s = segments[keys[i].id];
+        keys[i].center = xAxis ? 0.5 * (s.left.x + s.right.x) : 0.5 * (s.left.y + s.right.y);
+    }
+    qsort(&keys[first], n, sizeof(BvhKey), bvhKeyCmp);
+    u32 children = bvh->numNodes;
+    bvh->numNodes += 2;
+    bvh->nodes[idx].first = children;
+    bvh->nodes[idx].count = 0;
+    buildBvhNode(bvh, children, segments, keys, first, n / 2);
+    buildBvhNode(bvh, children + 1, segments, keys, first + n / 2, n - n / 2);
+}
+
+int
+bvhKeyCmp(const void *a, const void *b)
+{
+    f64 ca = ((const BvhKey *)a)->center, cb = ((const BvhKey *)b)->center;
+    return (ca > cb) - (ca < cb);
+}
+
+bool
+bvhSpatialContains(const void *impl, DVector2 pt)
+{
+    const BvhSpatial *bvh = (const BvhSpatial *)impl;
+    return bvh->numSegments > 0 && (bvhCrossings(bvh, 0, pt) & 1);
+}
+
+u32
+bvhCrossings(const BvhSpatial *bvh, u32 idx, DVector2 pt)
+{
+    /* even-odd over the crossings of the ray to +x, each segment is in one leaf so nothing is counted twice */
+    const BvhNode *node = &bvh->nodes[idx];
+    if (pt.y < node->box.min.y || pt.y > node->box.max.y || pt.x >= node->box.max.x) return 0;
+    if (node->count == 0) return bvhCrossings(bvh, node->first, pt) + bvhCrossings(bvh, node->first + 1, pt);
+    u32 crossings = 0;
+    for (u32 i = node->first; i < node->first + node->count; i++)
+    {
+        f64 x;
+        crossings += SpatialCrossesRight(bvh->segments[i], pt, &x);
+    }
+    return crossings;
+}
+
+bool
+bvhSpatialRayCast(const void *impl, DVector2 origin, DVector2 dir, f64 maxDistance, SpatialHit *hit)
+{
+    const BvhSpatial *bvh = (const BvhSpatial *)impl;
+    hit->distance = INFINITY;
+    if (bvh->numSegments > 0) bvhRayCast(bvh, 0, origin, dir, maxDistance, hit);
+    return hit->distance < INFINITY;
+}
+
+void
+bvhRayCast(const BvhSpatial *bvh, u32 idx, DVector2 origin, DVector2 dir, f64 tMax, SpatialHit *hit)
+{ /*
+   * the child the ray enters first goes first, the other one is skipped
+   * once the best hit is closer than where the ray enters its box
+   */
+    const BvhNode *node = &bvh->nodes[idx];
+    if (node->count > 0)
+    {
+        for (u32 i = node->first; i < node->first + node->count; i++)
+        {
+            f64 t;
+            if (!DSegmentRayHit(bvh->segments[i], origin, dir, &t) || t > tMax + BSP_EPSILON || t >= hit->distance) continue;
+            hit->distance = t;
+            hit->point = (DVector2){ origin.x + t * dir.x, origin.y + t * dir.y };
+            hit->segment = bvh->ids[i];
+        }
+        return;
+    }
+    f64 enter[2], exit[2];
+    bool meets[2];
+    for (u32 c = 0; c < 2; c++)
+    {
+        enter[c] = 0.0;
+        exit[c] = tMax + BSP_EPSILON;
+        meets[c] = SpatialRayBox(bvh->nodes[node->first + c].box, origin, dir, &enter[c], &exit[c]);
+    }
+    u32 near = (meets[1] && (!meets[0] || enter[1] < enter[0])) ? 1 : 0;
+    u32 far = 1 - near;
+    if (meets[near]) bvhRayCast(bvh, node->first + near, origin, dir, tMax, hit);
+    if (meets[far] && enter[far] < hit->distance) bvhRayCast(bvh, node->first + far, origin, dir, tMax, hit);
+}
+
+usize
+bvhSpatialQueryBox(const void *impl, SpatialBox box, u32 *segments, usize capacity)
+{
+    const BvhSpatial *bvh = (const BvhSpatial *)impl;
+    return (bvh->numSegments > 0) ? bvhQueryBox(bvh, 0, box, segments, capacity, 0) : 0;
+}
+
+usize
+bvhQueryBox(const BvhSpatial *bvh, u32 idx, SpatialBox query, u32 *segments, usize capacity, usize found)
+{
+    const BvhNode *node = &bvh->nodes[idx];
+    if (node->box.max.x < query.min.x || node->box.min.x > query.max.x || node->box.max.y < query.min.y || node->box.min.y > query.max.y) return found;
+    if (node->count == 0)
+    {
+        found = bvhQueryBox(bvh, node->first, query, segments, capacity, found);
+        return bvhQueryBox(bvh, node->first + 1, query, segments, capacity, found);
+    }
+    for (u32 i = node->first; i < node->first + node->count; i++)
+    {
+        if (!DSegmentIntersectsBox(bvh->segments[i], query.min, query.max)) continue;
+        if (found < capacity) segments[found] = bvh->ids[i];
+        found++;
+    }
+    return found;
+}
+
+bool
+bvhSpatialNearest(const void *impl, DVector2 pt, SpatialHit *hit)
+{
+    const BvhSpatial *bvh = (const BvhSpatial *)impl;
+    hit->distance = INFINITY;
+    if (bvh->numSegments > 0) bvhNearest(bvh, 0, pt, hit);
+    return bvh->numSegments > 0;
+}
+
+void
+bvhNearest(const BvhSpatial *bvh, u32 idx, DVector2 pt, SpatialHit *best)
+{
+    const BvhNode *node = &bvh->nodes[idx];
+    if (node->count > 0)
+    {
+        for (u32 i = node->first; i < node->first + node->count; i++)
+        {
+            DVector2 closest = DSegmentClosestPoint(bvh->segments[i], pt);
+            f64 distance = DVector2Length(DVector2Subtract(closest, pt));
+            if (distance >= best->distance) continue;
+            *best = (SpatialHit){ distance, closest, bvh->ids[i] };
+        }
+        return;
+    }
+    /* closer box first, a box farther than the best so far can't hold anything better */
+    f64 d0 = SpatialBoxDistance(bvh->nodes[node->first].box, pt);
+    f64 d1 = SpatialBoxDistance(bvh->nodes[node->first + 1].box, pt);
+    u32 near = (d1 < d0) ? 1 : 0;
+    f64 dNear = near ? d1 : d0, dFar = near ? d0 : d1;
+    if (dNear < best->distance) bvhNearest(bvh, node->first + near, pt, best);
+    if (dFar < best->distance) bvhNearest(bvh, node->first + 1 - near, pt, best);
+}
+
+usize
+bvhSpatialMemory(const void *impl)
+{
+    const BvhSpatial *bvh = (const BvhSpatial *)impl;
+    return sizeof(BvhSpatial) + bvh->numNodes * sizeof(BvhNode) + bvh->numSegments * (sizeof(DSegment) + sizeof(u32));
+}
+
+void
+bvhSpatialFree(void *impl)
+{
+    BvhSpatial *bvh = (BvhSpatial *)impl;
+    free(bvh->nodes);
+    free(bvh->segments);
+    free(bvh->ids);
+    free(bvh);
+}
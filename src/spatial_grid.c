@@ -0,0 +1,291 @@
+#include "bsp.h"
+#include "spatial_index.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GRID_MAX_SIDE 4096
+
+/*
+ * uniform grid over the segments' bounds with about one cell per segment. a
+ * segment is referenced from every cell its bounding box touches, the
+ * references are stored cell by cell (cellStart[c] .. cellStart[c + 1]).
+ * queries that report segments report each from the one cell holding a
+ * point picked independently of the cell, so nothing comes out twice
+ */
+typedef struct GridSpatial {
+    u32 cols;
+    u32 rows;
+    SpatialBox bounds;  /* bounds of every segment */
+    DVector2 cellSize;  /* size of one cell */
+    u32 *cellStart;     /* first reference of each cell, cols * rows + 1 entries */
+    u32 *refs;          /* segment indices, grouped by cell */
+    usize numRefs;
+    DSegment *segments; /* copy of the input segments */
+    usize numSegments;
+} GridSpatial;
+
+/* ******************** helpers ******************** */
+u32 gridCol(const GridSpatial *grid, f64 x);
+u32 gridRow(const GridSpatial *grid, f64 y);
+void gridCellRange(const GridSpatial *grid, SpatialBox box, u32 *c0, u32 *r0, u32 *c1, u32 *r1);
+void gridNearestCell(const GridSpatial *grid, u32 col, u32 row, DVector2 pt, SpatialHit *best);
+bool gridSpatialContains(const void *impl, DVector2 pt);
+bool gridSpatialRayCast(const void *impl, DVector2 origin, DVector2 dir, f64 maxDistance, SpatialHit *hit);
+usize gridSpatialQueryBox(const void *impl, SpatialBox box, u32 *segments, usize capacity);
+bool gridSpatialNearest(const void *impl, DVector2 pt, SpatialHit *hit);
+usize gridSpatialMemory(const void *impl);
+void gridSpatialFree(void *impl);
+/* ************************************************* */
+
+const SpatialIndexOps GridSpatialOps = {
+    .containsPoint = gridSpatialContains,
+    .rayCast = gridSpatialRayCast,
+    .queryBox = gridSpatialQueryBox,
+    .nearest = gridSpatialNearest,
+    .memoryUsage = gridSpatialMemory,
+    .free = gridSpatialFree,
+};
+
+void *
+BuildGridSpatialIndex(const DSegment *segments, usize numSegments)
+{
+    GridSpatial *grid = (GridSpatial *)malloc(sizeof(GridSpatial));
+    grid->numSegments = numSegments;
+    grid->segments = (DSegment *)malloc(max(numSegments, 1) * sizeof(DSegment));
+    memcpy(grid->segments, segments, numSegments * sizeof(DSegment));
+
+    grid->bounds = (SpatialBox){ { 0.0, 0.0 }, { 0.0, 0.0 } };
+    for (usize i = 0; i < numSegments; i++)
+    {
+        SpatialBox b = SpatialSegmentBox(segments[i]);
+        grid->bounds.min = (i == 0) ? b.min : (DVector2){ min(grid->bounds.min.x, b.min.x), min(grid->bounds.min.y, b.min.y) };
+        grid->bounds.max = (i == 0) ? b.max : (DVector2){ max(grid->bounds.max.x, b.max.x), max(grid->bounds.max.y, b.max.y) };
+    }
+
+    /* about one cell per segment, shaped after the bounds */
+    f64 width = grid->bounds.max.x - grid->bounds.min.x;
+    f64 height = grid->bounds.max.y - grid->bounds.min.y;
+    f64 aspect = (width > 0.0 && height > 0.0) ? width / height : 1.0;
+    grid->cols = (width > 0.0) ? (u32)clamp(ceil(sqrt(numSegments * aspect)), 1.0, GRID_MAX_SIDE) : 1;
+    grid->rows = (height > 0.0) ? (u32)clamp(ceil((f64)numSegments / grid->cols), 1.0, GRID_MAX_SIDE) : 1;
+    grid->cellSize = (DVector2){ (width > 0.0) ? width / grid->cols : 1.0, (height > 0.0) ? height / grid->rows : 1.0 };
+
+    /* counts first, then the prefix sums, then the references */
+    usize numCells = (usize)grid->cols * grid->rows;
+    grid->cellStart = (u32 *)calloc(numCells + 1, sizeof(u32));
+    for (usize i = 0; i < numSegments; i++)
+    {
+        u32 c0, r0, c1, r1;
+        gridCellRange(grid, SpatialSegmentBox(segments[i]), &c0, &r0, &c1, &r1);
+        for (u32 r = r0; r <= r1; r++)
+            for (u32 c = c0; c <= c1; c++) grid->cellStart[(usize)r * grid->cols + c + 1]++;
+    }
+    for (usize c = 0; c < numCells; c++) grid->cellStart[c + 1] += grid->cellStart[c];
+    grid->numRefs = grid->cellStart[numCells];
+    grid->refs = (u32 *)malloc(max(grid->numRefs, 1) * sizeof(u32));
+    u32 *fill = (u32 *)malloc(numCells * sizeof(u32));
+    memcpy(fill, grid->cellStart, numCells * sizeof(u32));
+    for (usize i = 0; i < numSegments; i++)
+    {
+        u32 c0, r0, c1, r1;
+        gridCellRange(grid, SpatialSegmentBox(segments[i]), &c0, &r0, &c1, &r1);
+        for (u32 r = r0; r <= r1; r++)
+            for (u32 c = c0; c <= c1; c++) grid->refs[fill[(usize)r * grid->cols + c]++] = (u32)i;
+    }
+    free(fill);
+    return grid;
+}
+
+u32
+gridCol(const GridSpatial *grid, f64 x)
+{
+    return (u32)clamp(floor((x - grid->bounds.min.x) / grid->cellSize.x), 0.0, grid->cols - 1.0);
+}
+
+u32
+gridRow(const GridSpatial *grid, f64 y)
+{
+    return (u32)clamp(floor((y - grid->bounds.min.y) / grid->cellSize.y), 0.0, grid->rows - 1.0);
+}
+
+void
+gridCellRange(const GridSpatial *grid, SpatialBox box, u32 *c0, u32 *r0, u32 *c1, u32 *r1)
+{
+    *c0 = gridCol(grid, box.min.x);
+    *r0 = gridRow(grid, box.min.y);
+    *c1 = gridCol(grid, box.max.x);
+    *r1 = gridRow(grid, box.max.y);
+}
+
+bool
+gridSpatialContains(const void *impl, DVector2 pt)
+{ /*
+   * even-odd over the crossings of the ray to +x, walking the cells of pt's
+   * row. a crossing counts only in the cell of its x (clamped into the
+   * segment's box, so it's a cell the segment is referenced from)
+   */
+    const GridSpatial *grid = (const GridSpatial *)impl;
+    if (grid->numSegments == 0 || pt.y < grid->bounds.min.y || pt.y > grid->bounds.max.y || pt.x >= grid->bounds.max.x) return false;
+    u32 row = gridRow(grid, pt.y);
+    u32 crossings = 0;
+    for (u32 col = gridCol(grid, pt.x); col < grid->cols; col++)
+    {
+        usize cell = (usize)row * grid->cols + col;
+        for (u32 i = grid->cellStart[cell]; i < grid->cellStart[cell + 1]; i++)
+        {
+            DSegment s = grid->segments[grid->refs[i]];
+            f64 x;
+            if (!SpatialCrossesRight(s, pt, &x)) continue;
+            crossings += gridCol(grid, clamp(x, min(s.left.x, s.right.x), max(s.left.x, s.right.x))) == col;
+        }
+    }
+    return crossings & 1;
+}
+
+bool
+gridSpatialRayCast(const void *impl, DVector2 origin, DVector2 dir, f64 maxDistance, SpatialHit *hit)
+{ /*
+   * walks the cells along the ray in order (Amanatides & Woo). a hit found
+   * in a cell may lie in a later one, it's final once the walk has passed
+   * it
+   */
+    const GridSpatial *grid = (const GridSpatial *)impl;
+    f64 tMin = 0.0, tMax = maxDistance;
+    hit->distance = INFINITY;
+    if (grid->numSegments == 0 || !SpatialRayBox(grid->bounds, origin, dir, &tMin, &tMax)) return false;
+
+    DVector2 start = { origin.x + tMin * dir.x, origin.y + tMin * dir.y };
+    i64 col = gridCol(grid, start.x), row = gridRow(grid, start.y);
+    i64 stepCol = (dir.x > 0.0) ? 1 : ((dir.x < 0.0) ? -1 : 0);
+    i64 stepRow = (dir.y > 0.0) ? 1 : ((dir.y < 0.0) ? -1 : 0);
+    /* t where the ray leaves the current column / row, and how much t one cell takes */
+    f64 nextCol = INFINITY, nextRow = INFINITY, deltaCol = INFINITY, deltaRow = INFINITY;
+    if (stepCol != 0)
+    {
+        f64 edge = grid->bounds.min.x + (col + (stepCol > 0)) * grid->cellSize.x;
+        nextCol = (edge - origin.x) / dir.x;
+        deltaCol = grid->cellSize.x / babs(dir.x);
+    }
+    if (stepRow != 0)
+    {
+        f64 edge = grid->bounds.min.y + (row + (stepRow > 0)) * grid->cellSize.y;
+        nextRow = (edge - origin.y) / dir.y;
+        deltaRow = grid->cellSize.y / babs(dir.y);
+    }
+
+    while (col >= 0 && col < grid->cols && row >= 0 && row < grid->rows)
+    {
+        usize cell = (usize)row * grid->cols + col;
+        for (u32 i = grid->cellStart[cell]; i < grid->cellStart[cell + 1]; i++)
+        {
+            f64 t;
+            if (!DSegmentRayHit(grid->segments[grid->refs[i]], origin, dir, &t) || t > maxDistance + BSP_EPSILON || t >= hit->distance) continue;
+            hit->distance = t;
+            hit->point = (DVector2){ origin.x + t * dir.x, origin.y + t * dir.y };
+            hit->segment = grid->refs[i];
+        }
+        f64 leave = min(nextCol, nextRow);
+        if (hit->distance <= leave || leave > tMax) break;
+        if (nextCol < nextRow)
+        {
+            col += stepCol;
+            nextCol += deltaCol;
+        }
+        else
+        {
+            row += stepRow;
+            nextRow += deltaRow;
+        }
+    }
+    return hit->distance < INFINITY;
+}
+
+usize
+gridSpatialQueryBox(const void *impl, SpatialBox box, u32 *segments, usize capacity)
+{
+    const GridSpatial *grid = (const GridSpatial *)impl;
+    if (grid->numSegments == 0 || box.max.x < grid->bounds.min.x || box.min.x > grid->bounds.max.x || box.max.y < grid->bounds.min.y || box.min.y > grid->bounds.max.y) return 0;
+    u32 c0, r0, c1, r1;
+    gridCellRange(grid, box, &c0, &r0, &c1, &r1);
+    usize found = 0;
+    for (u32 r = r0; r <= r1; r++)
+    {
+        for (u32 c = c0; c <= c1; c++)
+        {
+            usize cell = (usize)r * grid->cols + c;
+            for (u32 i = grid->cellStart[cell]; i < grid->cellStart[cell + 1]; i++)
+            {
+                /* lower corner of the segment's box clipped to the query box, in one cell only */
+                u32 s = grid->refs[i];
+                SpatialBox b = SpatialSegmentBox(grid->segments[s]);
+                if (gridCol(grid, max(b.min.x, box.min.x)) != c || gridRow(grid, max(b.min.y, box.min.y)) != r) continue;
+                if (!DSegmentIntersectsBox(grid->segments[s], box.min, box.max)) continue;
+                if (found < capacity) segments[found] = s;
+                found++;
+            }
+        }
+    }
+    return found;
+}
+
+bool
+gridSpatialNearest(const void *impl, DVector2 pt, SpatialHit *hit)
+{ /*
+   * rings of cells around pt's cell, growing until every cell outside the
+   * rings seen so far is farther away than the best segment
+   */
+    const GridSpatial *grid = (const GridSpatial *)impl;
+    hit->distance = INFINITY;
+    if (grid->numSegments == 0) return false;
+    i64 col = gridCol(grid, pt.x), row = gridRow(grid, pt.y);
+    for (i64 ring = 0;; ring++)
+    {
+        i64 c0 = col - ring, c1 = col + ring, r0 = row - ring, r1 = row + ring;
+        for (i64 r = max(r0, 0); r <= min(r1, grid->rows - 1); r++)
+        {
+            bool edgeRow = r == r0 || r == r1;
+            for (i64 c = max(c0, 0); c <= min(c1, grid->cols - 1); c += (edgeRow || c == c1) ? 1 : c1 - c)
+                gridNearestCell(grid, (u32)c, (u32)r, pt, hit);
+        }
+
+        /* the closest any cell outside the block could be */
+        f64 bound = INFINITY;
+        if (c0 > 0) bound = min(bound, max(pt.x - (grid->bounds.min.x + c0 * grid->cellSize.x), 0.0));
+        if (c1 < grid->cols - 1) bound = min(bound, max(grid->bounds.min.x + (c1 + 1) * grid->cellSize.x - pt.x, 0.0));
+        if (r0 > 0) bound = min(bound, max(pt.y - (grid->bounds.min.y + r0 * grid->cellSize.y), 0.0));
+        if (r1 < grid->rows - 1) bound = min(bound, max(grid->bounds.min.y + (r1 + 1) * grid->cellSize.y - pt.y, 0.0));
+        if (hit->distance <= bound) break;
+    }
+    return true;
+}
+
+void
+gridNearestCell(const GridSpatial *grid, u32 col, u32 row, DVector2 pt, SpatialHit *best)
+{
+    usize cell = (usize)row * grid->cols + col;
+    for (u32 i = grid->cellStart[cell]; i < grid->cellStart[cell + 1]; i++)
+    {
+        DVector2 closest = DSegmentClosestPoint(grid->segments[grid->refs[i]], pt);
+        f64 distance = DVector2Length(DVector2Subtract(closest, pt));
+        if (distance >= best->distance) continue;
+        *best = (SpatialHit){ distance, closest, grid->refs[i] };
+    }
+}
+
+usize
+gridSpatialMemory(const void *impl)
+{
+    const GridSpatial *grid = (const GridSpatial *)impl;
+    return sizeof(GridSpatial) + ((usize)grid->cols * grid->rows + 1) * sizeof(u32) + grid->numRefs * sizeof(u32) + grid->numSegments * sizeof(DSegment);
+}
+
+void
+gridSpatialFree(void *impl)
+{
+    GridSpatial *grid = (GridSpatial *)impl;
+    free(grid->cellStart);
+    free(grid->refs);
+    free(grid->segments);
+    free(grid);
+}
@@ -0,0 +1,155 @@
+#include "spatial_index.h"
+#include "bsp.h"
+#include "f64_segment.h"
+#include "raylib.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+SpatialIndex *
+BuildSpatialIndex(SpatialBackend backend, const DSegment *segments, usize numSegments)
+{
+    SpatialIndex *index = (SpatialIndex *)malloc(sizeof(SpatialIndex));
+    index->backend = backend;
+    index->numSegments = numSegments;
+    switch (backend)
+    {
+    case SpatialBackendBsp:
+        index->ops = &BspSpatialOps;
+        index->impl = BuildBspSpatialIndex(segments, numSegments);
+        break;
+    case SpatialBackendKdTree:
+        index->ops = &KdSpatialOps;
+        index->impl = BuildKdSpatialIndex(segments, numSegments);
+        break;
+    case SpatialBackendBvh:
+        index->ops = &BvhSpatialOps;
+        index->impl = BuildBvhSpatialIndex(segments, numSegments);
+        break;
+    case SpatialBackendGrid:
+        index->ops = &GridSpatialOps;
+        index->impl = BuildGridSpatialIndex(segments, numSegments);
+        break;
+    }
+    return index;
+}
+
+void
+FreeSpatialIndex(SpatialIndex *index)
+{
+    index->ops->free(index->impl);
+    free(index);
+}
+
+bool
+ParseSpatialBackend(const char *name, SpatialBackend *backend)
+{
+    for (SpatialBackend b = SpatialBackendBsp; b <= SpatialBackendGrid; b++)
+    {
+        if (strcmp(name, SpatialBackendName(b)) != 0) continue;
+        *backend = b;
+        return true;
+    }
+    return false;
+}
+
+const char *
+SpatialBackendName(SpatialBackend backend)
+{
+    switch (backend)
+    {
+    case SpatialBackendBsp: return "bsp";
+    case SpatialBackendKdTree: return "kdtree";
+    case SpatialBackendBvh: return "bvh";
+    case SpatialBackendGrid: return "grid";
+    }
+    return "unknown";
+}
+
+bool
+SpatialContainsPoint(const SpatialIndex *index, DVector2 pt)
+{
+    /* queries a backend doesn't support answer as if nothing was there */
+    return index->ops->containsPoint ? index->ops->containsPoint(index->impl, pt) : false;
+}
+
+bool
+SpatialRayCast(const SpatialIndex *index, DVector2 origin, DVector2 dir, f64 maxDistance, SpatialHit *hit)
+{
+    return index->ops->rayCast ? index->ops->rayCast(index->impl, origin, dir, maxDistance, hit) : false;
+}
+
+usize
+SpatialQueryBox(const SpatialIndex *index, SpatialBox box, u32 *segments, usize capacity)
+{
+    return index->ops->queryBox ? index->ops->queryBox(index->impl, box, segments, capacity) : 0;
+}
+
+bool
+SpatialNearest(const SpatialIndex *index, DVector2 pt, SpatialHit *hit)
+{
+    return index->ops->nearest ? index->ops->nearest(index->impl, pt, hit) : false;
+}
+
+usize
+SpatialMemoryUsage(const SpatialIndex *index)
+{
+    return index->ops->memoryUsage(index->impl);
+}
+
+SpatialBox
+SpatialSegmentBox(DSegment s)
+{
+    return (SpatialBox){
+        .min = { min(s.left.x, s.right.x), min(s.left.y, s.right.y) },
+        .max = { max(s.left.x, s.right.x), max(s.left.y, s.right.y) },
+    };
+}
+
+bool
+SpatialBoxContains(SpatialBox box, DVector2 pt)
+{
+    return pt.x >= box.min.x && pt.x <= box.max.x && pt.y >= box.min.y && pt.y <= box.max.y;
+}
+
+f64
+SpatialBoxDistance(SpatialBox box, DVector2 pt)
+{
+    f64 dx = max(max(box.min.x - pt.x, pt.x - box.max.x), 0.0);
+    f64 dy = max(max(box.min.y - pt.y, pt.y - box.max.y), 0.0);
+    return sqrt(dx * dx + dy * dy);
+}
+
+bool
+SpatialRayBox(SpatialBox box, DVector2 origin, DVector2 dir, f64 *tMin, f64 *tMax)
+{
+    /* slab test, narrows [tMin, tMax] to the part of the ray inside box */
+    f64 o[2] = { origin.x, origin.y }, d[2] = { dir.x, dir.y };
+    f64 lo[2] = { box.min.x, box.min.y }, hi[2] = { box.max.x, box.max.y };
+    for (usize axis = 0; axis < 2; axis++)
+    {
+        if (d[axis] == 0.0)
+        {
+            if (o[axis] < lo[axis] || o[axis] > hi[axis]) return false;
+            continue;
+        }
+        f64 t0 = (lo[axis] - o[axis]) / d[axis];
+        f64 t1 = (hi[axis] - o[axis]) / d[axis];
+        *tMin = max(*tMin, min(t0, t1));
+        *tMax = min(*tMax, max(t0, t1));
+    }
+    return *tMin <= *tMax;
+}
+
+bool
+SpatialCrossesRight(DSegment s, DVector2 pt, f64 *x)
+{ /*
+   * whether s crosses the horizontal ray from pt to +x, x is where. an end
+   * counts as below the ray if it's on it, so a ray through a vertex
+   * crosses the two segments meeting there an even number of times exactly
+   * when it doesn't pass into or out of the polygon
+   */
+    if ((s.left.y > pt.y) == (s.right.y > pt.y)) return false;
+    *x = s.left.x + (pt.y - s.left.y) * (s.right.x - s.left.x) / (s.right.y - s.left.y);
+    return *x > pt.x;
+}
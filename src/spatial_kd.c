@@ -0,0 +1,331 @@
+#include "bsp.h"
+#include "spatial_index.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KD_LEAF_SIZE 6
+#define KD_MAX_DEPTH 32
+#define KD_LEAF 2u
+
+typedef struct KdNode {
+    f64 split; /* position of the splitting line (inner nodes) */
+    u32 axis;  /* 0 = x, 1 = y, KD_LEAF for leaves */
+    u32 first; /* first child, the second is first + 1 (inner) / first reference (leaf) */
+    u32 count; /* number of references (leaves) */
+} KdNode;
+
+/*
+ * kd-tree over segment bounding boxes, split at the median center along the
+ * longer side of each node's box. a segment straddling a split is
+ * referenced from both children, queries that report segments report a
+ * reference only from the leaf that owns a point of the segment picked
+ * independently of the leaf (leaf boxes are half-open, [min, max)), so
+ * every segment comes out once
+ */
+typedef struct KdSpatial {
+    KdNode *nodes;
+    usize numNodes;
+    usize nodeCapacity;
+    u32 *refs; /* segment indices of the leaves, grouped by leaf */
+    usize numRefs;
+    usize refCapacity;
+    const DSegment *segments; /* copy of the input segments */
+    usize numSegments;
+    SpatialBox bounds; /* bounds of every segment */
+} KdSpatial;
+
+/* ******************** helpers ******************** */
+void buildKdNode(KdSpatial *kd, u32 idx, SpatialBox box, u32 *ids, usize n, u32 depth);
+int kdCenterCmp(const void *a, const void *b);
+SpatialBox kdChildBox(SpatialBox box, u32 axis, f64 split, bool right);
+u32 kdCrossings(const KdSpatial *kd, u32 idx, SpatialBox box, DVector2 pt);
+bool kdRayCast(const KdSpatial *kd, u32 idx, DVector2 origin, DVector2 dir, f64 tMin, f64 tMax, SpatialHit *hit);
+usize kdQueryBox(const KdSpatial *kd, u32 idx, SpatialBox box, SpatialBox query, u32 *segments, usize capacity, usize found);
+void kdNearest(const KdSpatial *kd, u32 idx, SpatialBox box, DVector2 pt, SpatialHit *best);
+bool kdSpatialContains(const void *impl, DVector2 pt);
+bool kdSpatialRayCast(const void *impl, DVector2 origin, DVector2 dir, f64 maxDistance, SpatialHit *hit);
+usize kdSpatialQueryBox(const void *impl, SpatialBox box, u32 *segments, usize capacity);
+bool kdSpatialNearest(const void *impl, DVector2 pt, SpatialHit *hit);
+usize kdSpatialMemory(const void *impl);
+void kdSpatialFree(void *impl);
+/* ************************************************* */
+
+const SpatialIndexOps KdSpatialOps = {
+    .containsPoint = kdSpatialContains,
+    .rayCast = kdSpatialRayCast,
+    .queryBox = kdSpatialQueryBox,
+    .nearest = kdSpatialNearest,
+    .memoryUsage = kdSpatialMemory,
+    .free = kdSpatialFree,
+};
+
+void *
+BuildKdSpatialIndex(const DSegment *segments, usize numSegments)
+{
+    KdSpatial *kd = (KdSpatial *)malloc(sizeof(KdSpatial));
+    DSegment *copy = (DSegment *)malloc(max(numSegments, 1) * sizeof(DSegment));
+    memcpy(copy, segments, numSegments * sizeof(DSegment));
+    kd->segments = copy;
+    kd->numSegments = numSegments;
+    kd->nodeCapacity = 64;
+    kd->nodes = (KdNode *)malloc(kd->nodeCapacity * sizeof(KdNode));
+    kd->numNodes = 1;
+    kd->refCapacity = max(2 * numSegments, 64);
+    kd->refs = (u32 *)malloc(kd->refCapacity * sizeof(u32));
+    kd->numRefs = 0;
+
+    kd->bounds = (SpatialBox){ { 0.0, 0.0 }, { 0.0, 0.0 } };
+    u32 *ids = (u32 *)malloc(max(numSegments, 1) * sizeof(u32));
+    for (usize i = 0; i < numSegments; i++)
+    {
+        SpatialBox b = SpatialSegmentBox(segments[i]);
+        kd->bounds.min = (i == 0) ? b.min : (DVector2){ min(kd->bounds.min.x, b.min.x), min(kd->bounds.min.y, b.min.y) };
+        kd->bounds.max = (i == 0) ? b.max : (DVector2){ max(kd->bounds.max.x, b.max.x), max(kd->bounds.max.y, b.max.y) };
+        ids[i] = i;
+    }
+    buildKdNode(kd, 0, kd->bounds, ids, numSegments, 0);
+    free(ids);
+    return kd;
+}
+
+void
+buildKdNode(KdSpatial *kd, u32 idx, SpatialBox box, u32 *ids, usize n, u32 depth)
+{
+    u32 axis = (box.max.x - box.min.x >= box.max.y - box.min.y) ? 0 : 1;
+    usize numLeft = 0, numRight = 0;
+    f64 split = 0.0;
+    if (n > KD_LEAF_SIZE && depth < KD_MAX_DEPTH)
+    {
+        f64 *centers = (f64 *)malloc(n * sizeof(f64));
+        for (usize i = 0; i < n; i++)
+        {
+            DSegment s = kd->segments[ids[i]];
+            centers[i] = (axis == 0) ? 0.5 * (s.left.x + s.right.x) : 0.5 * (s.left.y + s.right.y);
+        }
+        qsort(centers, n, sizeof(f64), kdCenterCmp);
+        split = centers[n / 2];
+        free(centers);
+        for (usize i = 0; i < n; i++)
+        {
+            SpatialBox b = SpatialSegmentBox(kd->segments[ids[i]]);
+            numLeft += ((axis == 0) ? b.min.x : b.min.y) < split;
+            numRight += ((axis == 0) ? b.max.x : b.max.y) >= split;
+        }
+    }
+
+    /* a split that leaves every segment on both sides only duplicates them */
+    if (numLeft == 0 || numRight == 0 || (numLeft == n && numRight == n))
+    {
+        if (kd->numRefs + n > kd->refCapacity)
+        {
+            kd->refCapacity = max(2 * kd->refCapacity, kd->numRefs + n);
+            kd->refs = (u32 *)realloc(kd->refs, kd->refCapacity * sizeof(u32));
+        }
+        memcpy(&kd->refs[kd->numRefs], ids, n * sizeof(u32));
+        kd->nodes[idx] = (KdNode){ 0.0, KD_LEAF, (u32)kd->numRefs, (u32)n };
+        kd->numRefs += n;
+        return;
+    }
+
+    if (kd->numNodes + 2 > kd->nodeCapacity)
+    {
+        kd->nodeCapacity *= 2;
+        kd->nodes = (KdNode *)realloc(kd->nodes, kd->nodeCapacity * sizeof(KdNode));
+    }
+    u32 first = kd->numNodes;
+    kd->numNodes += 2;
+    kd->nodes[idx] = (KdNode){ split, axis, first, 0 };
+
+    u32 *left = (u32 *)malloc(numLeft * sizeof(u32));
+    u32 *right = (u32 *)malloc(numRight * sizeof(u32));
+    numLeft = numRight = 0;
+    for (usize i = 0; i < n; i++)
+    {
+        SpatialBox b = SpatialSegmentBox(kd->segments[ids[i]]);
+        if (((axis == 0) ? b.min.x : b.min.y) < split) left[numLeft++] = ids[i];
+        if (((axis == 0) ? b.max.x : b.max.y) >= split) right[numRight++] = ids[i];
+    }
+    buildKdNode(kd, first, kdChildBox(box, axis, split, false), left, numLeft, depth + 1);
+    buildKdNode(kd, first + 1, kdChildBox(box, axis, split, true), right, numRight, depth + 1);
+    free(left);
+    free(right);
+}
+
+int
+kdCenterCmp(const void *a, const void *b)
+{
+    f64 ca = *(const f64 *)a, cb = *(const f64 *)b;
+    return (ca > cb) - (ca < cb);
+}
+
+SpatialBox
+kdChildBox(SpatialBox box, u32 axis, f64 split, bool right)
+{
+    /* the median of a node's segments may fall outside the node when they straddle it */
+    if (axis == 0 && right) box.min.x = clamp(split, box.min.x, box.max.x);
+    else if (axis == 0) box.max.x = clamp(split, box.min.x, box.max.x);
+    else if (right) box.min.y = clamp(split, box.min.y, box.max.y);
+    else box.max.y = clamp(split, box.min.y, box.max.y);
+    return box;
+}
+
+bool
+kdSpatialContains(const void *impl, DVector2 pt)
+{
+    /* even-odd over the crossings of the ray to +x, the root box is unbounded so ownership needs no special case at the edges */
+    const KdSpatial *kd = (const KdSpatial *)impl;
+    SpatialBox everywhere = { { -INFINITY, -INFINITY }, { INFINITY, INFINITY } };
+    return kd->numSegments > 0 && (kdCrossings(kd, 0, everywhere, pt) & 1);
+}
+
+u32
+kdCrossings(const KdSpatial *kd, u32 idx, SpatialBox box, DVector2 pt)
+{
+    const KdNode *node = &kd->nodes[idx];
+    if (node->axis == KD_LEAF)
+    {
+        /* the crossing point picks the one leaf that counts it */
+        u32 crossings = 0;
+        for (u32 i = 0; i < node->count; i++)
+        {
+            f64 x;
+            if (SpatialCrossesRight(kd->segments[kd->refs[node->first + i]], pt, &x)) crossings += (x >= box.min.x && x < box.max.x);
+        }
+        return crossings;
+    }
+    u32 crossings = 0;
+    if (node->axis == 1) crossings += kdCrossings(kd, node->first + (pt.y >= node->split), kdChildBox(box, 1, node->split, pt.y >= node->split), pt);
+    else
+    {
+        if (pt.x < node->split) crossings += kdCrossings(kd, node->first, kdChildBox(box, 0, node->split, false), pt);
+        crossings += kdCrossings(kd, node->first + 1, kdChildBox(box, 0, node->split, true), pt);
+    }
+    return crossings;
+}
+
+bool
+kdSpatialRayCast(const void *impl, DVector2 origin, DVector2 dir, f64 maxDistance, SpatialHit *hit)
+{
+    const KdSpatial *kd = (const KdSpatial *)impl;
+    f64 tMin = 0.0, tMax = maxDistance;
+    if (kd->numSegments == 0 || !SpatialRayBox(kd->bounds, origin, dir, &tMin, &tMax)) return false;
+    hit->distance = INFINITY;
+    return kdRayCast(kd, 0, origin, dir, tMin, tMax, hit);
+}
+
+bool
+kdRayCast(const KdSpatial *kd, u32 idx, DVector2 origin, DVector2 dir, f64 tMin, f64 tMax, SpatialHit *hit)
+{ /*
+   * children in the order the ray passes through them, restricted to the
+   * part of [tMin, tMax] inside each. a hit inside the near child's
+   * interval can't be beaten by anything in the far one
+   */
+    const KdNode *node = &kd->nodes[idx];
+    if (node->axis == KD_LEAF)
+    {
+        for (u32 i = 0; i < node->count; i++)
+        {
+            u32 s = kd->refs[node->first + i];
+            f64 t;
+            if (!DSegmentRayHit(kd->segments[s], origin, dir, &t) || t > tMax + BSP_EPSILON || t >= hit->distance) continue;
+            hit->distance = t;
+            hit->point = (DVector2){ origin.x + t * dir.x, origin.y + t * dir.y };
+            hit->segment = s;
+        }
+        return hit->distance <= tMax + BSP_EPSILON;
+    }
+    f64 o = (node->axis == 0) ? origin.x : origin.y;
+    f64 d = (node->axis == 0) ? dir.x : dir.y;
+    u32 near = node->first + ((o > node->split || (o == node->split && d >= 0.0)) ? 1 : 0);
+    u32 far = (near == node->first) ? node->first + 1 : node->first;
+    if (d == 0.0) return kdRayCast(kd, near, origin, dir, tMin, tMax, hit);
+    f64 tSplit = (node->split - o) / d;
+    if (tSplit > tMax || tSplit < 0.0) return kdRayCast(kd, near, origin, dir, tMin, tMax, hit);
+    if (tSplit < tMin) return kdRayCast(kd, far, origin, dir, tMin, tMax, hit);
+    if (kdRayCast(kd, near, origin, dir, tMin, tSplit, hit)) return true;
+    return kdRayCast(kd, far, origin, dir, tSplit, tMax, hit);
+}
+
+usize
+kdSpatialQueryBox(const void *impl, SpatialBox box, u32 *segments, usize capacity)
+{
+    const KdSpatial *kd = (const KdSpatial *)impl;
+    SpatialBox everywhere = { { -INFINITY, -INFINITY }, { INFINITY, INFINITY } };
+    return (kd->numSegments > 0) ? kdQueryBox(kd, 0, everywhere, box, segments, capacity, 0) : 0;
+}
+
+usize
+kdQueryBox(const KdSpatial *kd, u32 idx, SpatialBox box, SpatialBox query, u32 *segments, usize capacity, usize found)
+{
+    const KdNode *node = &kd->nodes[idx];
+    if (node->axis == KD_LEAF)
+    {
+        for (u32 i = 0; i < node->count; i++)
+        {
+            /* lower corner of the segment's box clipped to the query box, owned by one leaf only */
+            u32 s = kd->refs[node->first + i];
+            SpatialBox b = SpatialSegmentBox(kd->segments[s]);
+            DVector2 corner = { max(b.min.x, query.min.x), max(b.min.y, query.min.y) };
+            if (corner.x < box.min.x || corner.x >= box.max.x || corner.y < box.min.y || corner.y >= box.max.y) continue;
+            if (!DSegmentIntersectsBox(kd->segments[s], query.min, query.max)) continue;
+            if (found < capacity) segments[found] = s;
+            found++;
+        }
+        return found;
+    }
+    f64 lo = (node->axis == 0) ? query.min.x : query.min.y;
+    f64 hi = (node->axis == 0) ? query.max.x : query.max.y;
+    if (lo < node->split) found = kdQueryBox(kd, node->first, kdChildBox(box, node->axis, node->split, false), query, segments, capacity, found);
+    if (hi >= node->split) found = kdQueryBox(kd, node->first + 1, kdChildBox(box, node->axis, node->split, true), query, segments, capacity, found);
+    return found;
+}
+
+bool
+kdSpatialNearest(const void *impl, DVector2 pt, SpatialHit *hit)
+{
+    const KdSpatial *kd = (const KdSpatial *)impl;
+    hit->distance = INFINITY;
+    if (kd->numSegments > 0) kdNearest(kd, 0, kd->bounds, pt, hit);
+    return kd->numSegments > 0;
+}
+
+void
+kdNearest(const KdSpatial *kd, u32 idx, SpatialBox box, DVector2 pt, SpatialHit *best)
+{
+    /* near child first, anything whose box is farther than the best so far is skipped */
+    if (SpatialBoxDistance(box, pt) >= best->distance) return;
+    const KdNode *node = &kd->nodes[idx];
+    if (node->axis == KD_LEAF)
+    {
+        for (u32 i = 0; i < node->count; i++)
+        {
+            u32 s = kd->refs[node->first + i];
+            DVector2 closest = DSegmentClosestPoint(kd->segments[s], pt);
+            f64 distance = DVector2Length(DVector2Subtract(closest, pt));
+            if (distance >= best->distance) continue;
+            *best = (SpatialHit){ distance, closest, s };
+        }
+        return;
+    }
+    bool right = ((node->axis == 0) ? pt.x : pt.y) >= node->split;
+    kdNearest(kd, node->first + right, kdChildBox(box, node->axis, node->split, right), pt, best);
+    kdNearest(kd, node->first + !right, kdChildBox(box, node->axis, node->split, !right), pt, best);
+}
+
+usize
+kdSpatialMemory(const void *impl)
+{
+    const KdSpatial *kd = (const KdSpatial *)impl;
+    return sizeof(KdSpatial) + kd->numNodes * sizeof(KdNode) + kd->numRefs * sizeof(u32) + kd->numSegments * sizeof(DSegment);
+}
+
+void
+kdSpatialFree(void *impl)
+{
+    KdSpatial *kd = (KdSpatial *)impl;
+    free(kd->nodes);
+    free(kd->refs);
+    free((DSegment *)kd->segments);
+    free(kd);
+}
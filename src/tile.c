@@ -0,0 +1,355 @@
+#define _POSIX_C_SOURCE 200809L
+#include "tile.h"
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "bsp_tree.h"
+#include "f64_segment.h"
+#include "raylib.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifndef __EMSCRIPTEN__
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+typedef struct TileBucket {
+    DSegment *segments; /* segments clipped to tile */
+    usize size;         /* number of segments in bucket */
+    usize capacity;     /* allocated size of segment array */
+} TileBucket;
+
+/* ************************* helpers ************************* */
+bool clipSegmentToTile(DSegment s, TileGrid grid, u32 col, u32 row, DSegment *clipped);
+void bucketAdd(TileBucket *bucket, DSegment s);
+bool writeTileTree(const DSegment *segments, usize numSegments, const char *directory, u32 col, u32 row);
+bool writeTileIndex(const TileBucket *buckets, TileGrid grid, const char *directory);
+/* *********************************************************** */
+
+TileGrid
+BuildTileGrid(BoundingRegion region, u32 cols, u32 rows)
+{
+    return (TileGrid){
+        .origin = (DVector2){ region.left, region.top },
+        .tileWidth = (f64)(region.right - region.left) / cols,
+        .tileHeight = (f64)(region.bottom - region.top) / rows,
+        .cols = cols,
+        .rows = rows,
+    };
+}
+
+DSegment *
+ClipTileSegments(const DSegment *segments, usize numSegments, TileGrid grid, u32 col, u32 row, usize *size)
+{
+    TileBucket bucket = { NULL, 0, 0 };
+    for (usize i = 0; i < numSegments; i++)
+    {
+        DSegment clipped;
+        if (clipSegmentToTile(segments[i], grid, col, row, &clipped)) bucketAdd(&bucket, clipped);
+    }
+    *size = bucket.size;
+    return bucket.segments;
+}
+
+usize
+BuildTileWorld(const DSegment *segments, usize numSegments, TileGrid grid, const char *directory, usize maxWorkers)
+{
+    usize numTiles = (usize)grid.cols * grid.rows;
+    /* the last tile has the longest name, if it fits they all do */
+    char lastPath[TILE_PATH_SIZE];
+    if (numTiles > 0 && !TilePath(directory, grid.cols - 1, grid.rows - 1, lastPath)) return numTiles;
+    TileBucket *buckets = (TileBucket *)calloc(numTiles, sizeof(TileBucket));
+
+    { /*
+       * bucket segments into every tile their bounding box overlaps, clipping
+       * them at the tile borders on the way
+       */
+        for (usize i = 0; i < numSegments; i++)
+        {
+            DSegment s = segments[i];
+            f64 x0 = (min(s.left.x, s.right.x) - grid.origin.x) / grid.tileWidth;
+            f64 x1 = (max(s.left.x, s.right.x) - grid.origin.x) / grid.tileWidth;
+            f64 y0 = (min(s.left.y, s.right.y) - grid.origin.y) / grid.tileHeight;
+            f64 y1 = (max(s.left.y, s.right.y) - grid.origin.y) / grid.tileHeight;
+            u32 colMin = (u32)clamp(x0, 0.0, grid.cols - 1.0), colMax = (u32)clamp(x1, 0.0, grid.cols - 1.0);
+            u32 rowMin = (u32)clamp(y0, 0.0, grid.rows - 1.0), rowMax = (u32)clamp(y1, 0.0, grid.rows - 1.0);
+            for (u32 row = rowMin; row <= rowMax; row++)
+                for (u32 col = colMin; col <= colMax; col++)
+                {
+                    DSegment clipped;
+                    if (clipSegmentToTile(s, grid, col, row, &clipped)) bucketAdd(&buckets[row * grid.cols + col], clipped);
+                }
+        }
+    }
+
+    mkdir(directory, 0755);
+    usize failed = 0;
+    if (!writeTileIndex(buckets, grid, directory))
+    {
+        TraceLog(LOG_ERROR, "TILES: could not write index to %s", directory);
+        failed = numTiles;
+    }
+    else
+    {
+        /* stale files from an older build would hide failed tiles */
+        for (usize t = 0; t < numTiles; t++)
+        {
+            char path[TILE_PATH_SIZE];
+            if (TilePath(directory, t % grid.cols, t / grid.cols, path)) remove(path);
+        }
+
+#ifdef __EMSCRIPTEN__
+        /* no worker processes on the web, build every tile in place */
+        for (usize t = 0; t < numTiles; t++)
+        {
+            if (buckets[t].size == 0) continue;
+            if (!writeTileTree(buckets[t].segments, buckets[t].size, directory, t % grid.cols, t / grid.cols)) failed += 1;
+        }
+#else
+        /*
+         * each tile is built in its own forked worker, which sees the buckets
+         * through copy-on-write pages, so nothing needs to be sent to it.
+         * at most maxWorkers are running at once
+         */
+        maxWorkers = max(maxWorkers, 1);
+        pid_t *workers = (pid_t *)malloc(maxWorkers * sizeof(pid_t));
+        usize *workerTiles = (usize *)malloc(maxWorkers * sizeof(usize));
+        usize running = 0;
+        bool forking = true;
+        for (usize t = 0; t <= numTiles; t++)
+        {
+            while (running > 0 && (running == maxWorkers || t == numTiles))
+            {
+                i32 status;
+                pid_t pid = wait(&status);
+                if (pid < 0 && errno == EINTR) continue;
+                if (pid < 0)
+                {
+                    /* workers that can't be reaped count as failed, the remaining tiles are built here */
+                    TraceLog(LOG_WARNING, "TILES: could not wait for %u worker(s), building the rest in process", (u32)running);
+                    failed += running;
+                    running = 0;
+                    forking = false;
+                    break;
+                }
+                for (usize w = 0; w < running; w++)
+                {
+                    if (workers[w] != pid) continue;
+                    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                    {
+                        TraceLog(LOG_WARNING, "TILES: tile (%u, %u) failed", (u32)(workerTiles[w] % grid.cols), (u32)(workerTiles[w] / grid.cols));
+                        failed += 1;
+                    }
+                    workers[w] = workers[running - 1];
+                    workerTiles[w] = workerTiles[running - 1];
+                    running -= 1;
+                    break;
+                }
+            }
+            if (t == numTiles) break;
+            if (buckets[t].size == 0) continue;
+
+            u32 col = t % grid.cols, row = t / grid.cols;
+            fflush(NULL);
+            pid_t pid = forking ? fork() : -1;
+            if (pid == 0) _exit(writeTileTree(buckets[t].segments, buckets[t].size, directory, col, row) ? 0 : 1);
+            else if (pid < 0)
+            {
+                /* out of processes (or lost track of them) => build this one ourselves */
+                if (!writeTileTree(buckets[t].segments, buckets[t].size, directory, col, row)) failed += 1;
+            }
+            else
+            {
+                workers[running] = pid;
+                workerTiles[running] = t;
+                running += 1;
+            }
+        }
+        free(workers);
+        free(workerTiles);
+#endif
+    }
+
+    for (usize t = 0; t < numTiles; t++)
+        free(buckets[t].segments);
+    free(buckets);
+    return failed;
+}
+
+bool
+RetryTile(const char *directory, const DSegment *segments, usize numSegments, u32 col, u32 row)
+{
+    TileIndex *index = ReadTileIndex(directory);
+    if (!index) return false;
+    bool ok = (col < index->grid.cols && row < index->grid.rows) && BuildTile(segments, numSegments, index->grid, col, row, directory);
+    FreeTileIndex(index);
+    return ok;
+}
+
+bool
+BuildTile(const DSegment *segments, usize numSegments, TileGrid grid, u32 col, u32 row, const char *directory)
+{
+    usize size = 0;
+    DSegment *clipped = ClipTileSegments(segments, numSegments, grid, col, row, &size);
+    bool ok = (size == 0) || writeTileTree(clipped, size, directory, col, row);
+    free(clipped);
+    return ok;
+}
+
+TileIndex *
+ReadTileIndex(const char *directory)
+{
+    char path[TILE_PATH_SIZE];
+    snprintf(path, TILE_PATH_SIZE, "%s/%s", directory, TILE_INDEX_NAME);
+    FILE *in = fopen(path, "r");
+    if (!in) return NULL;
+
+    TileIndex *index = (TileIndex *)malloc(sizeof(TileIndex));
+    snprintf(index->directory, TILE_PATH_SIZE, "%s", directory);
+    index->numSegments = NULL;
+
+    i32 version = 0;
+    TileGrid *grid = &index->grid;
+    bool ok = fscanf(in, "bsp-tiles %d\n", &version) == 1 && version == TILE_INDEX_VERSION;
+    ok = ok && fscanf(in, "grid %la %la %la %la %u %u\n", &grid->origin.x, &grid->origin.y, &grid->tileWidth, &grid->tileHeight, &grid->cols, &grid->rows) == 6;
+    if (ok)
+    {
+        index->numSegments = (u32 *)calloc((usize)grid->cols * grid->rows, sizeof(u32));
+        u32 col, row, count;
+        while (fscanf(in, "tile %u %u %u\n", &col, &row, &count) == 3)
+            if (col < grid->cols && row < grid->rows) index->numSegments[row * grid->cols + col] = count;
+    }
+    fclose(in);
+
+    if (!ok)
+    {
+        FreeTileIndex(index);
+        return NULL;
+    }
+    return index;
+}
+
+void
+FreeTileIndex(TileIndex *index)
+{
+    free(index->numSegments);
+    free(index);
+}
+
+BspFlatTree *
+ReadTile(const TileIndex *index, u32 col, u32 row)
+{
+    if (index->numSegments[row * index->grid.cols + col] == 0) return NULL;
+    char path[TILE_PATH_SIZE];
+    if (!TilePath(index->directory, col, row, path)) return NULL;
+    FILE *in = fopen(path, "rb");
+    if (!in) return NULL;
+    BspFlatTree *tree = ReadBspFlatTree(in);
+    fclose(in);
+    return tree;
+}
+
+bool
+TilePath(const char *directory, u32 col, u32 row, char *path)
+{
+    /* a cut off name could be another tile's, never use one */
+    i32 length = snprintf(path, TILE_PATH_SIZE, "%s/tile_%u_%u.bsp", directory, col, row);
+    if (length >= 0 && length < TILE_PATH_SIZE) return true;
+    TraceLog(LOG_ERROR, "TILES: path of tile (%u, %u) in %s is longer than %d characters", col, row, directory, TILE_PATH_SIZE - 1);
+    return false;
+}
+
+bool
+clipSegmentToTile(DSegment s, TileGrid grid, u32 col, u32 row, DSegment *clipped)
+{ /*
+   * liang-barsky clip against the tile rectangle. an end that gets cut off
+   * lies on the tile border, which acts like an earlier splitter, so it gets
+   * marked as split (segments cut at both ends are free splits in the tile)
+   */
+    f64 xMin = grid.origin.x + col * grid.tileWidth, xMax = xMin + grid.tileWidth;
+    f64 yMin = grid.origin.y + row * grid.tileHeight, yMax = yMin + grid.tileHeight;
+    DVector2 d = DVector2Subtract(s.right, s.left);
+    f64 p[4] = { -d.x, d.x, -d.y, d.y };
+    f64 q[4] = { s.left.x - xMin, xMax - s.left.x, s.left.y - yMin, yMax - s.left.y };
+    f64 t0 = 0.0, t1 = 1.0;
+    for (usize i = 0; i < 4; i++)
+    {
+        if (p[i] == 0.0)
+        {
+            if (q[i] < 0.0) return false;
+        }
+        else if (p[i] < 0.0) t0 = max(t0, q[i] / p[i]);
+        else t1 = min(t1, q[i] / p[i]);
+    }
+    if (t0 >= t1) return false;
+
+    *clipped = s;
+    if (t0 > 0.0)
+    {
+        clipped->left = DVector2Add(s.left, (DVector2){ t0 * d.x, t0 * d.y });
+        clipped->splitLeft = true;
+    }
+    if (t1 < 1.0)
+    {
+        clipped->right = DVector2Add(s.left, (DVector2){ t1 * d.x, t1 * d.y });
+        clipped->splitRight = true;
+    }
+    return !DVector2DIsEqual(clipped->left, clipped->right);
+}
+
+void
+bucketAdd(TileBucket *bucket, DSegment s)
+{
+    if (bucket->size == bucket->capacity)
+    {
+        bucket->capacity = max(2 * bucket->capacity, 16);
+        bucket->segments = (DSegment *)realloc(bucket->segments, bucket->capacity * sizeof(DSegment));
+    }
+    bucket->segments[bucket->size++] = s;
+}
+
+bool
+writeTileTree(const DSegment *segments, usize numSegments, const char *directory, u32 col, u32 row)
+{
+    char path[TILE_PATH_SIZE], tmpPath[TILE_PATH_SIZE + 4];
+    if (!TilePath(directory, col, row, path)) return false;
+
+    /* BuildBspTree takes ownership of (and frees) the segment list it's handed */
+    DSegment *copy = (DSegment *)malloc(numSegments * sizeof(DSegment));
+    memcpy(copy, segments, numSegments * sizeof(DSegment));
+    BspNode *root = BuildBspTree(copy, numSegments, NULL);
+    usize k = col + row;
+    for (BspNode *node = MinNode(root); node != NULL; node = SuccNode(node))
+        node->color = colors[k++ % numColors];
+    BspFlatTree *tree = FlattenBspTree(root);
+    FreeBspTree(root);
+
+    /* write next to the final path and rename, so a crashed worker never leaves a partial tile */
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    FILE *out = fopen(tmpPath, "wb");
+    bool ok = out && WriteBspFlatTree(tree, out);
+    if (out) ok = (fclose(out) == 0) && ok;
+    ok = ok && rename(tmpPath, path) == 0;
+    if (!ok) remove(tmpPath);
+
+    FreeBspFlatTree(tree);
+    return ok;
+}
+
+bool
+writeTileIndex(const TileBucket *buckets, TileGrid grid, const char *directory)
+{
+    char path[TILE_PATH_SIZE];
+    snprintf(path, TILE_PATH_SIZE, "%s/%s", directory, TILE_INDEX_NAME);
+    FILE *out = fopen(path, "w");
+    if (!out) return false;
+    fprintf(out, "bsp-tiles %d\n", TILE_INDEX_VERSION);
+    fprintf(out, "grid %a %a %a %a %u %u\n", grid.origin.x, grid.origin.y, grid.tileWidth, grid.tileHeight, grid.cols, grid.rows);
+    for (u32 row = 0; row < grid.rows; row++)
+        for (u32 col = 0; col < grid.cols; col++)
+            fprintf(out, "tile %u %u %u\n", col, row, (u32)buckets[row * grid.cols + col].size);
+    return fclose(out) == 0;
+}
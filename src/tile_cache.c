@@ -0,0 +1,247 @@
+#include "tile_cache.h"
+#include "bsp.h"
+#include "bsp_flat.h"
+#include "raylib.h"
+#include "raymath.h"
+#include "tile.h"
+#include <math.h>
+#include <stdlib.h>
+
+/* ************************ helpers ************************ */
+void *tileLoader(void *arg);
+void loadTile(TileCache *cache, u32 tile);
+usize addWantedBlock(const TileGrid *grid, Vector2 pos, u32 *wanted, usize numWanted);
+u32 tileDistance(const TileGrid *grid, u32 tile, i32 col, i32 row);
+void sortByTileDistance(const TileGrid *grid, u32 *tiles, usize numTiles, i32 col, i32 row);
+void lockCache(TileCache *cache);
+void unlockCache(TileCache *cache);
+/* ********************************************************* */
+
+TileCache *
+NewTileCache(const TileIndex *index, usize memoryCap)
+{
+    usize numTiles = (usize)index->grid.cols * index->grid.rows;
+    TileCache *cache = (TileCache *)malloc(sizeof(TileCache));
+    cache->index = index;
+    cache->slots = (TileSlot *)calloc(numTiles, sizeof(TileSlot));
+    for (usize t = 0; t < numTiles; t++)
+        cache->slots[t].state = (index->numSegments[t] == 0) ? TileEmpty : TileUnloaded;
+    cache->memoryCap = memoryCap;
+    cache->residentBytes = 0;
+    cache->frame = 0;
+    cache->queue = (u32 *)malloc(TILE_MAX_WANTED * sizeof(u32));
+    cache->queueHead = 0;
+    cache->queueSize = 0;
+    cache->quit = false;
+    cache->synchronous = true;
+#ifndef __EMSCRIPTEN__
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->wake, NULL);
+    cache->synchronous = pthread_create(&cache->loader, NULL, tileLoader, cache) != 0;
+    if (cache->synchronous) TraceLog(LOG_WARNING, "TILES: could not start loader thread, loading tiles synchronously");
+#endif
+    return cache;
+}
+
+void
+FreeTileCache(TileCache *cache)
+{
+#ifndef __EMSCRIPTEN__
+    if (!cache->synchronous)
+    {
+        lockCache(cache);
+        cache->quit = true;
+        pthread_cond_signal(&cache->wake);
+        unlockCache(cache);
+        pthread_join(cache->loader, NULL);
+    }
+    pthread_mutex_destroy(&cache->lock);
+    pthread_cond_destroy(&cache->wake);
+#endif
+    usize numTiles = (usize)cache->index->grid.cols * cache->index->grid.rows;
+    for (usize t = 0; t < numTiles; t++)
+        if (cache->slots[t].tree) FreeBspFlatTree(cache->slots[t].tree);
+    free(cache->slots);
+    free(cache->queue);
+    free(cache);
+}
+
+usize
+TileCacheUpdate(TileCache *cache, Vector2 pos, Vector2 velocity, u32 *resident, usize maxResident)
+{
+    const TileGrid *grid = &cache->index->grid;
+    usize numTiles = (usize)grid->cols * grid->rows;
+    i32 col = (i32)floor((pos.x - grid->origin.x) / grid->tileWidth);
+    i32 row = (i32)floor((pos.y - grid->origin.y) / grid->tileHeight);
+    cache->frame += 1;
+
+    /* tiles around the player come first, then tiles around where the player is heading */
+    u32 wanted[TILE_MAX_WANTED];
+    usize numWanted = addWantedBlock(grid, pos, wanted, 0);
+    numWanted = addWantedBlock(grid, Vector2Add(pos, Vector2Scale(velocity, TILE_LOOKAHEAD)), wanted, numWanted);
+    sortByTileDistance(grid, wanted, numWanted, col, row);
+
+    lockCache(cache);
+
+    { /* requeue from scratch so the loader always picks the closest tile still wanted */
+        for (usize i = cache->queueHead; i < cache->queueSize; i++)
+            if (cache->slots[cache->queue[i]].state == TileQueued) cache->slots[cache->queue[i]].state = TileUnloaded;
+        cache->queueHead = 0;
+        cache->queueSize = 0;
+        for (usize i = 0; i < numWanted; i++)
+        {
+            TileSlot *slot = &cache->slots[wanted[i]];
+            slot->lastWanted = cache->frame;
+            if (slot->state != TileUnloaded) continue;
+            slot->state = TileQueued;
+            cache->queue[cache->queueSize++] = wanted[i];
+        }
+#ifndef __EMSCRIPTEN__
+        if (cache->queueSize > 0) pthread_cond_signal(&cache->wake);
+#endif
+    }
+
+    { /* evict least recently wanted tiles until we're back under the memory cap */
+        while (cache->residentBytes > cache->memoryCap)
+        {
+            usize victim = numTiles;
+            for (usize t = 0; t < numTiles; t++)
+            {
+                TileSlot *slot = &cache->slots[t];
+                if (slot->state != TileResident || slot->lastWanted == cache->frame) continue;
+                if (victim == numTiles || slot->lastWanted < cache->slots[victim].lastWanted) victim = t;
+            }
+            if (victim == numTiles) break;
+            FreeBspFlatTree(cache->slots[victim].tree);
+            cache->slots[victim].tree = NULL;
+            cache->slots[victim].state = TileUnloaded;
+            cache->residentBytes -= cache->slots[victim].bytes;
+        }
+    }
+
+    usize numResident = 0;
+    for (usize t = 0; t < numTiles && numResident < maxResident; t++)
+        if (cache->slots[t].state == TileResident) resident[numResident++] = t;
+
+    unlockCache(cache);
+
+    /* no loader thread (the web, or it couldn't be started), queued tiles get loaded right away */
+    if (cache->synchronous)
+        for (; cache->queueHead < cache->queueSize; cache->queueHead++)
+            loadTile(cache, cache->queue[cache->queueHead]);
+
+    /* a tile only occludes tiles further away in manhattan distance, so this is front-to-back */
+    sortByTileDistance(grid, resident, numResident, col, row);
+    return numResident;
+}
+
+const BspFlatTree *
+TileCacheTree(const TileCache *cache, u32 tile)
+{
+    return cache->slots[tile].tree;
+}
+
+#ifndef __EMSCRIPTEN__
+void *
+tileLoader(void *arg)
+{
+    TileCache *cache = (TileCache *)arg;
+    lockCache(cache);
+    while (!cache->quit)
+    {
+        if (cache->queueHead == cache->queueSize)
+        {
+            pthread_cond_wait(&cache->wake, &cache->lock);
+            continue;
+        }
+        u32 tile = cache->queue[cache->queueHead++];
+        cache->slots[tile].state = TileLoading;
+        unlockCache(cache);
+        loadTile(cache, tile);
+        lockCache(cache);
+    }
+    unlockCache(cache);
+    return NULL;
+}
+#endif
+
+void
+loadTile(TileCache *cache, u32 tile)
+{
+    /* file i/o happens outside the lock, only the hand-off is locked */
+    u32 col = tile % cache->index->grid.cols, row = tile / cache->index->grid.cols;
+    BspFlatTree *tree = ReadTile(cache->index, col, row);
+
+    lockCache(cache);
+    TileSlot *slot = &cache->slots[tile];
+    slot->tree = tree;
+    if (tree)
+    {
+        slot->bytes = BspFlatTreeBytes(tree);
+        slot->state = TileResident;
+        cache->residentBytes += slot->bytes;
+    }
+    else
+    {
+        TraceLog(LOG_WARNING, "TILES: could not load tile (%u, %u)", col, row);
+        slot->state = TileMissing;
+    }
+    unlockCache(cache);
+}
+
+usize
+addWantedBlock(const TileGrid *grid, Vector2 pos, u32 *wanted, usize numWanted)
+{
+    i32 col = (i32)floor((pos.x - grid->origin.x) / grid->tileWidth);
+    i32 row = (i32)floor((pos.y - grid->origin.y) / grid->tileHeight);
+    for (i32 j = row - 1; j <= row + 1; j++)
+    {
+        for (i32 i = col - 1; i <= col + 1; i++)
+        {
+            if (i < 0 || j < 0 || i >= (i32)grid->cols || j >= (i32)grid->rows) continue;
+            u32 tile = j * grid->cols + i;
+            bool duplicate = false;
+            for (usize k = 0; k < numWanted; k++)
+                duplicate = duplicate || (wanted[k] == tile);
+            if (!duplicate) wanted[numWanted++] = tile;
+        }
+    }
+    return numWanted;
+}
+
+u32
+tileDistance(const TileGrid *grid, u32 tile, i32 col, i32 row)
+{
+    i32 i = tile % grid->cols, j = tile / grid->cols;
+    return babs(i - col) + babs(j - row);
+}
+
+void
+sortByTileDistance(const TileGrid *grid, u32 *tiles, usize numTiles, i32 col, i32 row)
+{
+    for (usize i = 1; i < numTiles; i++)
+    {
+        u32 tile = tiles[i];
+        u32 distance = tileDistance(grid, tile, col, row);
+        usize j = i;
+        for (; j > 0 && tileDistance(grid, tiles[j - 1], col, row) > distance; j--)
+            tiles[j] = tiles[j - 1];
+        tiles[j] = tile;
+    }
+}
+
+void
+lockCache(TileCache *cache)
+{
+#ifndef __EMSCRIPTEN__
+    pthread_mutex_lock(&cache->lock);
+#endif
+}
+
+void
+unlockCache(TileCache *cache)
+{
+#ifndef __EMSCRIPTEN__
+    pthread_mutex_unlock(&cache->lock);
+#endif
+}
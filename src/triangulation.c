@@ -2,12 +2,27 @@
 #include "bsp.h"
 #include "dcel.h"
 #include "f64_vector.h"
+#include "predicates.h"
 #include "raylib.h"
 #include <assert.h>
 #include <stdlib.h>
 
+typedef struct BridgeCandidate {
+    f64 distance;      /* squared distance from the hole vertex */
+    HalfEdgeEntry *to; /* half-edge leaving the boundary vertex */
+} BridgeCandidate;
+
 /* ******************* helpers ******************* */
 i32 vtxcmp(const VertexEntry u, const VertexEntry v);
+usize loopSize(const HalfEdgeEntry *e);
+f64 loopArea(const HalfEdgeEntry *e);
+void bridgeHole(DCEL *dcel, FaceEntry *face, f64 o);
+bool bridgeVisible(const FaceEntry *face, const VertexEntry *from, const VertexEntry *to);
+void clipEars(DCEL *dcel, FaceEntry *face, f64 o);
+bool isEar(const HalfEdgeEntry *e, f64 o);
+bool inCone(const HalfEdgeEntry *h, DVector2 pt, f64 o);
+bool segmentsMeet(DVector2 p1, DVector2 p2, DVector2 q1, DVector2 q2);
+i32 bridgeCandidateCmp(const void *a, const void *b);
 /* *********************************************** */
 
 Triangle *
@@ -45,7 +60,7 @@ MonotoneTriangulateDCEL(DCEL *dcel)
        * new half-edge count == 4n-6
        */
         usize n = dcel->numVertices;
-        ResizeDCEL(dcel, n, n - 1, 4 * n - 6);
+        ResizeDCEL(dcel, n, n - 1, 4 * n - 6, 1);
     }
 
     const bool RIGHT = true;
@@ -124,9 +139,7 @@ MonotoneTriangulateDCEL(DCEL *dcel)
                 while (stackSize >= 2)
                 {
                     VertexEntry *w = stack[stackSize - 1];
-                    DVector2 uv = DVector2Subtract(v->coordinates, u->coordinates);
-                    DVector2 uw = DVector2Subtract(w->coordinates, u->coordinates);
-                    f64 det = DVector2Determinant(uv, uw);
+                    f64 det = Orient2D(u->coordinates, v->coordinates, w->coordinates);
                     if (det < 0.0f && chainSide[i] == RIGHT) break;
                     else if (det > 0.0f && chainSide[i] == LEFT) break;
                     else
@@ -147,6 +160,73 @@ MonotoneTriangulateDCEL(DCEL *dcel)
     }
 }
 
+Triangle *
+TriangulatePolygon(DSegment *segments, const usize *ringSizes, const RingKind *ringKinds, usize numRings, usize *numTriangles)
+{
+    DCEL *dcel = BuildDCEL(segments, ringSizes, ringKinds, numRings);
+    TriangulateDCEL(dcel);
+    Triangle *triangles = (Triangle *)malloc(dcel->numFaces * sizeof(Triangle));
+    usize n = 0;
+    for (usize i = 0; i < dcel->numFaces; i++)
+    {
+        FaceEntry *face = dcel->faces[i];
+        if (!face->outerComponent || face->hole) continue;
+        DVector2 v1 = face->outerComponent->origin->coordinates;
+        DVector2 v2 = face->outerComponent->next->origin->coordinates;
+        DVector2 v3 = face->outerComponent->next->next->origin->coordinates;
+        /* raylib only fills triangles wound counter-clockwise on screen (y down) */
+        if (Orient2D(v1, v2, v3) > 0.0)
+        {
+            DVector2 tmp = v2;
+            v2 = v3;
+            v3 = tmp;
+        }
+        triangles[n++] = (Triangle){
+            .v1 = (Vector2){ v1.x, v1.y },
+            .v2 = (Vector2){ v2.x, v2.y },
+            .v3 = (Vector2){ v3.x, v3.y },
+        };
+    }
+    FreeDCEL(dcel);
+    *numTriangles = n;
+    return triangles;
+}
+
+void
+TriangulateDCEL(DCEL *dcel)
+{ /*
+   * ear clipping on every bounded face that isn't a hole, so it handles
+   * any simple polygon rather than just y-monotone ones. holes in a face are
+   * first joined to its outer boundary by bridges (the hole with the
+   * rightmost vertex first, to the closest boundary vertex it can see),
+   * leaving one boundary that walks around every hole. a boundary of n
+   * half-edges is then cut into n - 2 triangles by n - 3 diagonals
+   */
+    usize numFaces = dcel->numFaces, numBridges = 0, numDiagonals = 0;
+    for (usize i = 0; i < numFaces; i++)
+    {
+        FaceEntry *face = dcel->faces[i];
+        if (!face->outerComponent || face->hole) continue;
+        usize n = loopSize(face->outerComponent);
+        for (usize k = 0; k < face->numInnerComponents; k++)
+            n += loopSize(face->innerComponents[k]) + 2;
+        numBridges += face->numInnerComponents;
+        numDiagonals += n - 3;
+    }
+    ResizeDCEL(dcel, dcel->numVertices, dcel->numFaces + numDiagonals, dcel->numHalfEdges + 2 * (numBridges + numDiagonals), dcel->numComponents - numBridges);
+
+    for (usize i = 0; i < numFaces; i++)
+    {
+        FaceEntry *face = dcel->faces[i];
+        if (!face->outerComponent || face->hole) continue;
+        /* the face is on the left of its half-edges if its outer boundary is counter-clockwise */
+        f64 o = (loopArea(face->outerComponent) >= 0.0) ? 1.0 : -1.0;
+        while (face->numInnerComponents > 0)
+            bridgeHole(dcel, face, o);
+        clipEars(dcel, face, o);
+    }
+}
+
 Vector2
 TriangleCenter(Triangle t)
 {
@@ -171,3 +251,171 @@ vtxcmp(const VertexEntry u, const VertexEntry v)
     }
     else return (dy > 0) ? 1 : -1;
 }
+
+usize
+loopSize(const HalfEdgeEntry *e)
+{
+    usize size = 1;
+    for (const HalfEdgeEntry *tmp = e->next; tmp != e; tmp = tmp->next)
+        size += 1;
+    return size;
+}
+
+f64
+loopArea(const HalfEdgeEntry *e)
+{
+    f64 area = 0.0;
+    const HalfEdgeEntry *tmp = e;
+    do
+    {
+        DVector2 p = tmp->origin->coordinates, q = tmp->next->origin->coordinates;
+        area += (p.x * q.y) - (q.x * p.y);
+        tmp = tmp->next;
+    } while (tmp != e);
+    return area / 2.0;
+}
+
+void
+bridgeHole(DCEL *dcel, FaceEntry *face, f64 o)
+{
+    /* rightmost vertex of any hole left in the face */
+    HalfEdgeEntry *hole = NULL;
+    for (usize k = 0; k < face->numInnerComponents; k++)
+    {
+        HalfEdgeEntry *e = face->innerComponents[k];
+        do
+        {
+            if (!hole || e->origin->coordinates.x > hole->origin->coordinates.x) hole = e;
+            e = e->next;
+        } while (e != face->innerComponents[k]);
+    }
+    DVector2 from = hole->origin->coordinates;
+
+    /*
+     * boundary vertices the bridge would leave and arrive at on the face's
+     * side, closest first. only the first one nothing blocks gets checked
+     * against every edge
+     */
+    usize numCandidates = 0;
+    BridgeCandidate *candidates = (BridgeCandidate *)malloc(loopSize(face->outerComponent) * sizeof(BridgeCandidate));
+    HalfEdgeEntry *e = face->outerComponent;
+    do
+    {
+        DVector2 to = e->origin->coordinates;
+        DVector2 d = DVector2Subtract(to, from);
+        if (inCone(hole, to, o) && inCone(e, from, o)) candidates[numCandidates++] = (BridgeCandidate){ DVector2DotProduct(d, d), e };
+        e = e->next;
+    } while (e != face->outerComponent);
+    qsort(candidates, numCandidates, sizeof(BridgeCandidate), bridgeCandidateCmp);
+
+    HalfEdgeEntry *to = NULL;
+    for (usize i = 0; i < numCandidates && !to; i++)
+        if (bridgeVisible(face, hole->origin, candidates[i].to->origin)) to = candidates[i].to;
+    if (!to)
+    {
+        /* only degenerate input (a hole touching or crossing the boundary) gets here */
+        TraceLog(LOG_WARNING, "TRIANGULATION: no visible vertex to bridge hole at (%g, %g) to", from.x, from.y);
+        to = (numCandidates > 0) ? candidates[0].to : face->outerComponent;
+    }
+    free(candidates);
+    AddBridgeDCEL(dcel, to, hole);
+}
+
+bool
+bridgeVisible(const FaceEntry *face, const VertexEntry *from, const VertexEntry *to)
+{
+    /* no edge of the face meets from -> to, except for the edges ending in from or to */
+    for (usize k = 0; k <= face->numInnerComponents; k++)
+    {
+        const HalfEdgeEntry *start = (k < face->numInnerComponents) ? face->innerComponents[k] : face->outerComponent;
+        const HalfEdgeEntry *e = start;
+        do
+        {
+            const VertexEntry *p = e->origin, *q = e->next->origin;
+            bool shared = (p == from || p == to || q == from || q == to);
+            if (!shared && segmentsMeet(from->coordinates, to->coordinates, p->coordinates, q->coordinates)) return false;
+            e = e->next;
+        } while (e != start);
+    }
+    return true;
+}
+
+void
+clipEars(DCEL *dcel, FaceEntry *face, f64 o)
+{
+    HalfEdgeEntry *e = face->outerComponent;
+    usize remaining = loopSize(e);
+    usize misses = 0;
+    while (remaining > 3)
+    {
+        /* a whole lap without an ear only happens for degenerate (zero area) boundaries */
+        if (misses == remaining) TraceLog(LOG_WARNING, "TRIANGULATION: no ear left on a boundary of %u edges, clipping anyway", (u32)remaining);
+        if (isEar(e, o) || misses == remaining)
+        {
+            /* the diagonal keeps the face, the triangle e, e->next, diagonal twin becomes a new one */
+            HalfEdgeEntry *prev = e->prev;
+            SplitFaceDCEL(dcel, e, e->next->next);
+            e = prev;
+            remaining -= 1;
+            misses = 0;
+        }
+        else
+        {
+            e = e->next;
+            misses += 1;
+        }
+    }
+}
+
+bool
+isEar(const HalfEdgeEntry *e, f64 o)
+{
+    /* convex corner at b and no other boundary vertex in (or on) triangle a b c */
+    DVector2 a = e->origin->coordinates;
+    DVector2 b = e->next->origin->coordinates;
+    DVector2 c = e->next->next->origin->coordinates;
+    if (o * Orient2D(a, b, c) <= 0.0) return false;
+    for (const HalfEdgeEntry *h = e->next->next->next; h != e; h = h->next)
+    {
+        /* bridge ends show up twice on the boundary, the other copies of a b c aren't in the way */
+        const VertexEntry *v = h->origin;
+        if (v == e->origin || v == e->next->origin || v == e->next->next->origin) continue;
+        DVector2 pt = v->coordinates;
+        if (o * Orient2D(a, b, pt) >= 0.0 && o * Orient2D(b, c, pt) >= 0.0 && o * Orient2D(c, a, pt) >= 0.0) return false;
+    }
+    return true;
+}
+
+bool
+inCone(const HalfEdgeEntry *h, DVector2 pt, f64 o)
+{
+    /* pt is on the face's side of the corner at h's origin */
+    DVector2 a = h->prev->origin->coordinates;
+    DVector2 v = h->origin->coordinates;
+    DVector2 b = h->next->origin->coordinates;
+    bool leftOfIn = o * Orient2D(a, v, pt) > 0.0;
+    bool leftOfOut = o * Orient2D(v, b, pt) > 0.0;
+    if (o * Orient2D(a, v, b) >= 0.0) return leftOfIn && leftOfOut;
+    else return leftOfIn || leftOfOut;
+}
+
+bool
+segmentsMeet(DVector2 p1, DVector2 p2, DVector2 q1, DVector2 q2)
+{
+    /* closed segments, touching counts */
+    i32 d1 = sign(Orient2D(q1, q2, p1)), d2 = sign(Orient2D(q1, q2, p2));
+    i32 d3 = sign(Orient2D(p1, p2, q1)), d4 = sign(Orient2D(p1, p2, q2));
+    if (d1 * d2 < 0 && d3 * d4 < 0) return true;
+    if (d1 == 0 && min(q1.x, q2.x) <= p1.x && p1.x <= max(q1.x, q2.x) && min(q1.y, q2.y) <= p1.y && p1.y <= max(q1.y, q2.y)) return true;
+    if (d2 == 0 && min(q1.x, q2.x) <= p2.x && p2.x <= max(q1.x, q2.x) && min(q1.y, q2.y) <= p2.y && p2.y <= max(q1.y, q2.y)) return true;
+    if (d3 == 0 && min(p1.x, p2.x) <= q1.x && q1.x <= max(p1.x, p2.x) && min(p1.y, p2.y) <= q1.y && q1.y <= max(p1.y, p2.y)) return true;
+    if (d4 == 0 && min(p1.x, p2.x) <= q2.x && q2.x <= max(p1.x, p2.x) && min(p1.y, p2.y) <= q2.y && q2.y <= max(p1.y, p2.y)) return true;
+    return false;
+}
+
+i32
+bridgeCandidateCmp(const void *a, const void *b)
+{
+    f64 da = ((const BridgeCandidate *)a)->distance, db = ((const BridgeCandidate *)b)->distance;
+    return (da > db) - (da < db);
+}